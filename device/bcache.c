@@ -0,0 +1,382 @@
+#include "bcache.h"
+#include "global.h"
+#include "stdint.h"
+#include "list.h"
+#include "sync.h"
+#include "block.h"
+#include "memory.h"
+#include "string.h"
+#include "thread.h"
+#include "timer.h"
+#include "debug.h"
+#include "print.h"
+
+#define BCACHE_HASH_SIZE 256				// 哈希桶数,须为2的幂
+#define BUFS_PER_PAGE (PG_SIZE / BLOCK_SECTOR_SIZE)
+#define HEADS_PER_PAGE (PG_SIZE / sizeof(buf_head))
+#define RA_INIT 4										// 检测到顺序读后的初始预读窗口(扇区数)
+#define RA_MAX 64										// 预读窗口的上限,也是一次回写合并的扇区数上限
+#define STAGING_PAGES (RA_MAX * BLOCK_SECTOR_SIZE / PG_SIZE)
+
+/**
+ * 缓冲区缓存.
+ * 以(设备, 扇区号)为键缓存扇区,哈希表查找,CLOCK算法换出.
+ * bcache_lock保护哈希表、各缓冲区的键、引用计数和标志;缓冲区的内容由它自己的mutex保护.
+ * 磁盘读写期间不持有bcache_lock.
+ * 多扇区的读写经过中转缓冲区: 预读一次读入ra_buf再分发到各缓冲区,回写把连续的脏扇区收集到flush_buf一次写出
+*/
+static list hash_table[BCACHE_HASH_SIZE];
+static buf_head* bufs[BCACHE_MAX_BUFS];		// 所有已分配的缓冲区,CLOCK指针在其上循环
+static uint32_t nr_bufs;
+static uint32_t clock_hand;
+static buf_head* free_heads;							// 当前缓冲区头页中尚未使用的部分
+static uint32_t free_head_cnt;
+static uint8_t* free_data;								// 当前数据页中尚未使用的部分
+static uint32_t free_data_cnt;
+static lock bcache_lock;
+static bcache_stat bstat;
+
+/**
+ * 中转缓冲区.加锁顺序是先缓冲区后中转缓冲区;回写时对缓冲区只trylock,
+ * 所以持有某个缓冲区的线程再去读写其他扇区(包括因换不出缓冲区而同步回写)不会死锁
+*/
+static mutex ra_mutex;
+static uint8_t* ra_buf;
+static mutex flush_mutex;
+static uint8_t* flush_buf;
+
+static inline list* hash_bucket(block_device* bdev, uint32_t lba) {
+	return &hash_table[(lba ^ ((uint32_t)bdev >> 6)) & (BCACHE_HASH_SIZE - 1)];
+}
+
+/* 在哈希表中查找(bdev, lba),调用者须持有bcache_lock */
+static buf_head* buf_lookup(block_device* bdev, uint32_t lba) {
+	list* bucket = hash_bucket(bdev, lba);
+	list_elem* pelem = bucket->head.next;
+	while (pelem != &bucket->tail) {
+		buf_head* bh = elem2entry(buf_head, hash_tag, pelem);
+		if (bh->bdev == bdev && bh->lba == lba) {
+			return bh;
+		}
+		pelem = pelem->next;
+	}
+	return NULL;
+}
+
+/* 从kernel_pool分配一个新缓冲区,达到上限或内存不足时返回NULL.调用者须持有bcache_lock */
+static buf_head* buf_alloc(void) {
+	if (nr_bufs == BCACHE_MAX_BUFS) return NULL;
+	if (free_head_cnt == 0) {
+		free_heads = get_kernel_pages(1);
+		if (free_heads == NULL) return NULL;
+		free_head_cnt = HEADS_PER_PAGE;
+	}
+	if (free_data_cnt == 0) {
+		free_data = get_kernel_pages(1);
+		if (free_data == NULL) return NULL;
+		free_data_cnt = BUFS_PER_PAGE;
+	}
+	buf_head* bh = free_heads++;
+	--free_head_cnt;
+	bh->data = free_data;
+	free_data += BLOCK_SECTOR_SIZE;
+	--free_data_cnt;
+	bh->bdev = NULL;
+	bh->ref_cnt = 0;
+	bh->valid = bh->dirty = bh->referenced = false;
+	mutex_init(&bh->mutex);
+	bufs[nr_bufs++] = bh;
+	return bh;
+}
+
+/**
+ * 用CLOCK算法选出一个没有引用的干净缓冲区并从哈希表中摘下:
+ * 访问位为1的清0后跳过,转两圈仍找不到时返回NULL.调用者须持有bcache_lock
+*/
+static buf_head* buf_evict(void) {
+	uint32_t scan;
+	for (scan = 0; scan < 2 * nr_bufs; ++scan) {
+		buf_head* bh = bufs[clock_hand];
+		clock_hand = (clock_hand + 1) % nr_bufs;
+		if (bh->ref_cnt != 0 || bh->dirty) continue;
+		if (bh->referenced) {
+			bh->referenced = false;
+			continue;
+		}
+		if (bh->bdev != NULL) {
+			list_remove(&bh->hash_tag);
+			++bstat.evictions;
+		}
+		return bh;
+	}
+	return NULL;
+}
+
+/**
+ * 为不在缓存中的(bdev, lba)取一个缓冲区,未达上限时新分配,否则换出一个.
+ * 返回的缓冲区已加锁、已引用并放入哈希表,但内容无效.取不到时返回NULL.调用者须持有bcache_lock
+*/
+static buf_head* buf_get(block_device* bdev, uint32_t lba) {
+	buf_head* bh = buf_alloc();
+	if (bh == NULL) {
+		bh = buf_evict();
+		if (bh == NULL) return NULL;
+	}
+	bh->bdev = bdev;
+	bh->lba = lba;
+	bh->valid = false;
+	bh->dirty = false;
+	bh->referenced = true;
+	bh->ref_cnt = 1;
+	if (!mutex_trylock(&bh->mutex)) {
+		PANIC("bcache: free buffer is locked");
+	}
+	list_append(hash_bucket(bdev, lba), &bh->hash_tag);
+	return bh;
+}
+
+/**
+ * 查找(bdev, lba)的缓冲区并引用它,命中时返回true;
+ * 不在缓存中时取一个新缓冲区(已加锁,内容无效)存入*pbh,返回false.
+ * 缓冲区不是正被引用就是脏的时,先同步回写再重试.调用者须持有bcache_lock,返回时仍持有
+*/
+static bool buf_find(block_device* bdev, uint32_t lba, buf_head** pbh) {
+	++bstat.lookups;
+	while (1) {
+		buf_head* bh = buf_lookup(bdev, lba);
+		if (bh != NULL) {
+			++bstat.hits;
+			++bh->ref_cnt;
+			bh->referenced = true;
+			*pbh = bh;
+			return true;
+		}
+		if ((*pbh = buf_get(bdev, lba)) != NULL) {
+			return false;
+		}
+		lock_release(&bcache_lock);
+		bcache_sync();
+		thread_yield();
+		lock_acquire(&bcache_lock);
+	}
+}
+
+/**
+ * 读取bdev上扇区lba的缓冲区,返回时已加锁、已引用,用完须调用bcache_release.读盘出错时返回NULL.
+ * 未命中时若该扇区紧接着上次读的扇区,认为是顺序读,把其后不在缓存中的扇区一并读入,预读窗口随之翻倍
+*/
+buf_head* bcache_read(block_device* bdev, uint32_t lba) {
+	ASSERT(lba < bdev->sectors);
+	buf_head* ra[RA_MAX];
+	buf_head* bh;
+	uint32_t n, i;
+
+	lock_acquire(&bcache_lock);
+	if (buf_find(bdev, lba, &bh)) {
+		bdev->ra_next = lba + 1;
+		lock_release(&bcache_lock);
+		mutex_lock(&bh->mutex);
+		if (!bh->valid) {		// 之前读入它时出了错,这里重读
+			bh->valid = block_read(bdev, lba, bh->data, 1);
+			if (!bh->valid) {
+				bcache_release(bh);
+				return NULL;
+			}
+		}
+		return bh;
+	}
+
+	if (lba == bdev->ra_next) {
+		bdev->ra_window = bdev->ra_window == 0 ? RA_INIT : bdev->ra_window * 2;
+		if (bdev->ra_window > RA_MAX) bdev->ra_window = RA_MAX;
+	} else {
+		bdev->ra_window = 0;
+	}
+	uint32_t want = bdev->ra_window == 0 ? 1 : bdev->ra_window;
+	if (want > bdev->sectors - lba) want = bdev->sectors - lba;
+	ra[0] = bh;
+	for (n = 1; n < want && buf_lookup(bdev, lba + n) == NULL; ++n) {
+		if ((ra[n] = buf_get(bdev, lba + n)) == NULL) break;
+	}
+	bstat.readahead += n - 1;
+	bdev->ra_next = lba + 1;
+	lock_release(&bcache_lock);
+
+	bool ok;
+	if (n == 1) {
+		ok = block_read(bdev, lba, bh->data, 1);
+	} else {
+		mutex_lock(&ra_mutex);
+		ok = block_read(bdev, lba, ra_buf, n);
+		for (i = 0; ok && i < n; ++i) {
+			memcpy(ra[i]->data, ra_buf + i * BLOCK_SECTOR_SIZE, BLOCK_SECTOR_SIZE);
+		}
+		mutex_unlock(&ra_mutex);
+	}
+	for (i = 0; i < n; ++i) {
+		ra[i]->valid = ok;
+	}
+	if (n > 1) {
+		for (i = 1; i < n; ++i) {
+			mutex_unlock(&ra[i]->mutex);
+		}
+		lock_acquire(&bcache_lock);
+		for (i = 1; i < n; ++i) {
+			--ra[i]->ref_cnt;
+		}
+		lock_release(&bcache_lock);
+	}
+	if (!ok) {
+		bcache_release(bh);
+		return NULL;
+	}
+	return bh;
+}
+
+/**
+ * 取得bdev上扇区lba的缓冲区但不读盘,调用者将覆盖整个扇区.
+ * 返回时已加锁、已引用,内容视为有效,用完须调用bcache_release
+*/
+buf_head* bcache_get(block_device* bdev, uint32_t lba) {
+	ASSERT(lba < bdev->sectors);
+	buf_head* bh;
+	lock_acquire(&bcache_lock);
+	bool hit = buf_find(bdev, lba, &bh);
+	lock_release(&bcache_lock);
+	if (hit) {
+		mutex_lock(&bh->mutex);
+	}
+	bh->valid = true;
+	return bh;
+}
+
+/* 标记缓冲区的内容已被修改,稍后由回写线程写回.调用者须持有该缓冲区 */
+void bcache_dirty(buf_head* bh) {
+	ASSERT(bh->ref_cnt > 0 && bh->valid);
+	lock_acquire(&bcache_lock);
+	if (!bh->dirty) {
+		bh->dirty = true;
+		++bstat.nr_dirty;
+	}
+	lock_release(&bcache_lock);
+}
+
+/* 解锁并释放bcache_read得到的缓冲区 */
+void bcache_release(buf_head* bh) {
+	mutex_unlock(&bh->mutex);
+	lock_acquire(&bcache_lock);
+	ASSERT(bh->ref_cnt > 0);
+	--bh->ref_cnt;
+	lock_release(&bcache_lock);
+}
+
+/**
+ * 把bh所在的一段扇区号连续的脏缓冲区合并成一次写请求写回.
+ * 先向前找到这段的起点,再从起点向后收集,至多RA_MAX个.正被他人持有的缓冲区留待下次回写.
+ * 调用者须持有bcache_lock,写盘期间会释放它
+*/
+static void flush_run(buf_head* bh) {
+	buf_head* run[RA_MAX];
+	buf_head* prev;
+	uint32_t n, k, i;
+	for (n = 1; n < RA_MAX && bh->lba != 0; ++n) {
+		prev = buf_lookup(bh->bdev, bh->lba - 1);
+		if (prev == NULL || !prev->dirty) break;
+		bh = prev;
+	}
+	run[0] = bh;
+	for (n = 1; n < RA_MAX; ++n) {
+		run[n] = buf_lookup(bh->bdev, bh->lba + n);
+		if (run[n] == NULL || !run[n]->dirty) break;
+	}
+	for (i = 0; i < n; ++i) {
+		++run[i]->ref_cnt;
+	}
+	lock_release(&bcache_lock);
+
+	mutex_lock(&flush_mutex);
+	for (k = 0; k < n && mutex_trylock(&run[k]->mutex); ++k) {
+		memcpy(flush_buf + k * BLOCK_SECTOR_SIZE, run[k]->data, BLOCK_SECTOR_SIZE);
+	}
+	/* 在缓冲区锁内清除脏标记,写盘期间再被修改的缓冲区会重新变脏 */
+	lock_acquire(&bcache_lock);
+	for (i = 0; i < k; ++i) {
+		if (run[i]->dirty) {
+			run[i]->dirty = false;
+			--bstat.nr_dirty;
+		}
+	}
+	lock_release(&bcache_lock);
+	for (i = 0; i < k; ++i) {
+		mutex_unlock(&run[i]->mutex);
+	}
+	bool ok = k == 0 || block_write(bh->bdev, bh->lba, flush_buf, k);
+	mutex_unlock(&flush_mutex);
+
+	lock_acquire(&bcache_lock);
+	if (k != 0) {
+		++bstat.flushes;
+		bstat.flushed += k;
+	}
+	for (i = 0; i < n; ++i) {
+		if (!ok && i < k && !run[i]->dirty) {
+			run[i]->dirty = true;
+			++bstat.nr_dirty;
+		}
+		--run[i]->ref_cnt;
+	}
+}
+
+/* 把所有脏缓冲区写回磁盘 */
+void bcache_sync(void) {
+	uint32_t idx;
+	lock_acquire(&bcache_lock);
+	for (idx = 0; idx < nr_bufs; ++idx) {
+		buf_head* bh = bufs[idx];
+		if (bh->dirty) {
+			flush_run(bh);
+		}
+	}
+	lock_release(&bcache_lock);
+}
+
+/* 回写线程,周期性地把脏缓冲区写回磁盘 */
+static void bflushd(void* arg UNUSED) {
+	while (1) {
+		mtime_sleep(BCACHE_FLUSH_INTERVAL);
+		if (bstat.nr_dirty != 0) {
+			bcache_sync();
+		}
+	}
+}
+
+/**
+ * 把缓冲区缓存的统计复制到用户缓冲区buf中,buf不是可写的用户内存时什么也不做.
+ * 先在锁内取快照,释放锁后再写用户内存,不在持有bcache_lock时访问进程给出的地址
+*/
+void sys_bcache_stat(bcache_stat* buf) {
+	if (!user_range_ok(buf, sizeof(bcache_stat), true)) return;
+	lock_acquire(&bcache_lock);
+	bstat.nr_bufs = nr_bufs;
+	bcache_stat snap = bstat;
+	lock_release(&bcache_lock);
+	*buf = snap;
+}
+
+void bcache_init(void) {
+	put_str("bcache_init start\n");
+	uint32_t i;
+	for (i = 0; i < BCACHE_HASH_SIZE; ++i) {
+		list_init(&hash_table[i]);
+	}
+	lock_init(&bcache_lock, "bcache");
+	mutex_init(&ra_mutex);
+	mutex_init(&flush_mutex);
+	ra_buf = get_kernel_pages(STAGING_PAGES);
+	flush_buf = get_kernel_pages(STAGING_PAGES);
+	if (ra_buf == NULL || flush_buf == NULL) {
+		PANIC("bcache_init: no memory for staging buffers");
+	}
+	thread_start("bflushd", 31, bflushd, NULL);
+	put_str("bcache_init done\n");
+}
@@ -0,0 +1,46 @@
+#ifndef __DEVICE_BCACHE_H
+#define __DEVICE_BCACHE_H
+
+#include "stdint.h"
+#include "global.h"
+#include "list.h"
+#include "sync.h"
+#include "block.h"
+
+#define BCACHE_MAX_BUFS 1024				// 缓冲区个数上限,每个缓存一个扇区,即最多占用kernel_pool中512KB
+#define BCACHE_FLUSH_INTERVAL 1000	// 回写线程的周期(毫秒)
+
+/* 缓冲区,缓存块设备上的一个扇区 */
+typedef struct {
+	block_device* bdev;					// 所缓存扇区的设备,为NULL表示空闲
+	uint32_t lba;								// 所缓存扇区的扇区号
+	uint8_t* data;							// 扇区内容
+	uint32_t ref_cnt;						// 引用计数,大于0时不会被换出
+	bool valid;									// data中是否已是磁盘上的内容
+	bool dirty;									// data是否被修改过且尚未写回
+	bool referenced;						// CLOCK算法的访问位
+	mutex mutex;								// 缓冲区锁,持有者才能读写data
+	list_elem hash_tag;					// 挂在哈希桶上
+} buf_head;
+
+/* 缓冲区缓存的统计,命中率为hits / lookups */
+typedef struct {
+	uint32_t lookups;						// 查找次数
+	uint32_t hits;							// 命中次数
+	uint32_t readahead;					// 预读进来的扇区数
+	uint32_t evictions;					// 换出次数
+	uint32_t flushes;						// 回写请求次数
+	uint32_t flushed;						// 回写的扇区数
+	uint32_t nr_bufs;						// 已分配的缓冲区数
+	uint32_t nr_dirty;					// 当前的脏缓冲区数
+} bcache_stat;
+
+void bcache_init(void);
+buf_head* bcache_read(block_device* bdev, uint32_t lba);
+buf_head* bcache_get(block_device* bdev, uint32_t lba);
+void bcache_dirty(buf_head* bh);
+void bcache_release(buf_head* bh);
+void bcache_sync(void);
+void sys_bcache_stat(bcache_stat* buf);
+
+#endif
@@ -0,0 +1,165 @@
+#include "block.h"
+#include "global.h"
+#include "stdint.h"
+#include "list.h"
+#include "string.h"
+#include "debug.h"
+#include "interrupt.h"
+#include "printk.h"
+#include "stdio.h"
+
+#define MAX_PARTITIONS 16					// 所有硬盘上最多支持的分区数
+#define PART_TYPE_EXTENDED 0x5			// 扩展分区的类型
+#define PART_TYPE_EXTENDED_LBA 0xf
+
+/* 分区表项 */
+typedef struct {
+	uint8_t bootable;							// 是否可引导
+	uint8_t start_head;						// 起始磁头号
+	uint8_t start_sec;						// 起始扇区号
+	uint8_t start_chs;						// 起始柱面号
+	uint8_t fs_type;							// 分区类型
+	uint8_t end_head;							// 结束磁头号
+	uint8_t end_sec;							// 结束扇区号
+	uint8_t end_chs;							// 结束柱面号
+	uint32_t start_lba;						// 本分区起始扇区的lba地址,主分区相对于整个硬盘,逻辑分区相对于其EBR
+	uint32_t sec_cnt;							// 本分区的扇区数目
+} __attribute__((packed)) partition_table_entry;
+
+/* 引导扇区,mbr或ebr所在的扇区 */
+typedef struct {
+	uint8_t other[446];						// 引导代码
+	partition_table_entry partition_table[4];	// 分区表中有4项,共64字节
+	uint16_t signature;						// 启动扇区的结束标志是0x55,0xaa
+} __attribute__((packed)) boot_sector;
+
+/* 分区,作为块设备注册,读写时加上起始扇区号后转给所在的硬盘 */
+typedef struct {
+	block_device bdev;
+	block_device* disk;						// 分区所在的硬盘
+	uint32_t start_lba;						// 起始扇区,相对于整个硬盘
+} partition;
+
+list block_devices;						// 所有已注册的块设备
+static partition partitions[MAX_PARTITIONS];
+static uint32_t partition_cnt;
+
+void block_init(void) {
+	list_init(&block_devices);
+	partition_cnt = 0;
+}
+
+/* 注册块设备,驱动在初始化时调用 */
+void block_register(block_device* bdev) {
+	bdev->ra_next = 0;
+	bdev->ra_window = 0;
+	intr_status old_status = intr_disable();
+	list_append(&block_devices, &bdev->tag);
+	intr_set_status(old_status);
+	printk(LOG_INFO, "block: %s, %d sectors\n", bdev->name, bdev->sectors);
+}
+
+/* block_find的回调函数,按名称匹配 */
+static bool block_name_eq(list_elem* pelem, int arg) {
+	block_device* bdev = elem2entry(block_device, tag, pelem);
+	return strcmp(bdev->name, (const char*)arg) == 0;
+}
+
+/* 按名称查找块设备,找不到时返回NULL */
+block_device* block_find(const char* name) {
+	list_elem* pelem = list_traversal(&block_devices, block_name_eq, (int)name);
+	return pelem == NULL ? NULL : elem2entry(block_device, tag, pelem);
+}
+
+/* 按注册顺序取第idx个块设备,不存在时返回NULL */
+block_device* block_get(uint32_t idx) {
+	list_elem* pelem = block_devices.head.next;
+	while (pelem != &block_devices.tail) {
+		if (idx-- == 0) {
+			return elem2entry(block_device, tag, pelem);
+		}
+		pelem = pelem->next;
+	}
+	return NULL;
+}
+
+/* 从bdev的lba扇区起读入sec_cnt个扇区到buf */
+bool block_read(block_device* bdev, uint32_t lba, void* buf, uint32_t sec_cnt) {
+	ASSERT(lba + sec_cnt <= bdev->sectors && lba + sec_cnt >= lba);
+	return bdev->ops->read(bdev, lba, buf, sec_cnt);
+}
+
+/* 将buf中的sec_cnt个扇区写入bdev的lba扇区起 */
+bool block_write(block_device* bdev, uint32_t lba, const void* buf, uint32_t sec_cnt) {
+	ASSERT(lba + sec_cnt <= bdev->sectors && lba + sec_cnt >= lba);
+	return bdev->ops->write(bdev, lba, buf, sec_cnt);
+}
+
+/* disk上是否注册了分区,不属于任何分区的硬盘才可以整盘当作暂存区随意写 */
+bool block_has_partitions(block_device* disk) {
+	uint32_t i;
+	for (i = 0; i < partition_cnt; ++i) {
+		if (partitions[i].disk == disk) return true;
+	}
+	return false;
+}
+
+static bool part_read(block_device* bdev, uint32_t lba, void* buf, uint32_t sec_cnt) {
+	partition* part = bdev->priv;
+	return block_read(part->disk, part->start_lba + lba, buf, sec_cnt);
+}
+
+static bool part_write(block_device* bdev, uint32_t lba, const void* buf, uint32_t sec_cnt) {
+	partition* part = bdev->priv;
+	return block_write(part->disk, part->start_lba + lba, buf, sec_cnt);
+}
+
+static const block_ops part_ops = {part_read, part_write};
+
+/* 把disk上从start_lba起的sec_cnt个扇区注册为第part_no个分区,如sda1 */
+static void partition_add(block_device* disk, uint32_t part_no, uint32_t start_lba, uint32_t sec_cnt) {
+	if (partition_cnt == MAX_PARTITIONS || start_lba + sec_cnt > disk->sectors || sec_cnt == 0) {
+		printk(LOG_WARN, "%s: partition %d ignored\n", disk->name, part_no);
+		return;
+	}
+	partition* part = &partitions[partition_cnt++];
+	part->disk = disk;
+	part->start_lba = start_lba;
+	sprintf(part->bdev.name, "%s%d", disk->name, part_no);
+	part->bdev.sectors = sec_cnt;
+	part->bdev.ops = &part_ops;
+	part->bdev.priv = part;
+	block_register(&part->bdev);
+}
+
+/**
+ * 扫描硬盘disk上的分区表,把每个分区注册为块设备.
+ * 主分区编号为1~4,扩展分区中的逻辑分区沿ebr链依次编号为5、6...
+*/
+void block_partition_scan(block_device* disk) {
+	boot_sector bs;
+	uint32_t ext_lba_base = 0, ebr_lba = 0, logic_no = 5;
+	uint8_t i;
+
+	if (!block_read(disk, 0, &bs, 1) || bs.signature != 0xaa55) return;
+	for (i = 0; i < 4; ++i) {
+		partition_table_entry* p = &bs.partition_table[i];
+		if (p->fs_type == PART_TYPE_EXTENDED || p->fs_type == PART_TYPE_EXTENDED_LBA) {
+			ext_lba_base = p->start_lba;
+		} else if (p->fs_type != 0) {
+			partition_add(disk, i + 1, p->start_lba, p->sec_cnt);
+		}
+	}
+
+	/* ebr中第一项是逻辑分区,起始扇区相对于该ebr;第二项指向下一个ebr,起始扇区相对于扩展分区 */
+	ebr_lba = ext_lba_base;
+	while (ebr_lba != 0 && logic_no < 5 + MAX_PARTITIONS) {
+		if (ebr_lba >= disk->sectors || !block_read(disk, ebr_lba, &bs, 1) || bs.signature != 0xaa55) break;
+		partition_table_entry* p = &bs.partition_table[0];
+		if (p->fs_type != 0) {
+			partition_add(disk, logic_no++, ebr_lba + p->start_lba, p->sec_cnt);
+		}
+		p = &bs.partition_table[1];
+		ebr_lba = p->fs_type == 0 ? 0 : ext_lba_base + p->start_lba;
+	}
+}
@@ -0,0 +1,40 @@
+#ifndef __DEVICE_BLOCK_H
+#define __DEVICE_BLOCK_H
+
+#include "stdint.h"
+#include "global.h"
+#include "list.h"
+
+#define BLOCK_SECTOR_SIZE 512
+
+struct block_device;
+
+/* 块设备驱动提供的操作,按扇区读写,返回是否成功.调用者可能睡眠,只能在线程上下文中调用 */
+typedef struct {
+	bool (*read)(struct block_device* bdev, uint32_t lba, void* buf, uint32_t sec_cnt);
+	bool (*write)(struct block_device* bdev, uint32_t lba, const void* buf, uint32_t sec_cnt);
+} block_ops;
+
+/* 块设备,由驱动嵌入到自己的设备结构中并注册 */
+typedef struct block_device {
+	char name[8];
+	uint32_t sectors;						// 扇区总数
+	const block_ops* ops;
+	void* priv;									// 驱动私有数据
+	uint32_t ra_next;						// 预读: 若下次缺失的扇区恰是ra_next,则认为是顺序读
+	uint32_t ra_window;					// 预读: 当前预读窗口的扇区数,随顺序读翻倍
+	list_elem tag;							// 挂在block_devices上
+} block_device;
+
+extern list block_devices;
+
+void block_init(void);
+void block_register(block_device* bdev);
+void block_partition_scan(block_device* disk);
+block_device* block_find(const char* name);
+block_device* block_get(uint32_t idx);
+bool block_has_partitions(block_device* disk);
+bool block_read(block_device* bdev, uint32_t lba, void* buf, uint32_t sec_cnt);
+bool block_write(block_device* bdev, uint32_t lba, const void* buf, uint32_t sec_cnt);
+
+#endif
@@ -1,14 +1,120 @@
 #include "console.h"
 #include "print.h"
 #include "stdint.h"
+#include "global.h"
+#include "io.h"
 #include "sync.h"
 #include "thread.h"
+#include "string.h"
+#include "serial.h"
+
+#define CON_COLS 80							// 屏幕列数
+#define CON_ROWS 25							// 屏幕行数
+#define CON_ATTR 0x0700					// 黑底白字,放在字符的高字节
+#define CON_ALL_DIRTY ((1 << CON_ROWS) - 1)
+#define VIDEO_BASE ((uint32_t*)0xc00b8000)	// 显存在内核空间中的地址,低端1MB已映射到0xc0000000
+#define CRT_ADDR_REG 0x3d4			// CRT Controller的地址寄存器
+#define CRT_DATA_REG 0x3d5			// CRT Controller的数据寄存器
 
 static lock console_lock;				// 控制台锁
 
-/* 初始化终端 */
+/**
+ * 显存的影子缓冲区.
+ * 字符先写进内存中的shadow,记下哪些行被改过,每次输出结束时才把脏行一次性写入显存,
+ * 并只设置一次光标,不再每个字符都读写CRT端口.
+ * shadow是按行组成的环,top是屏幕第0行在shadow中的行号.滚屏只需把top后移一行并清空新的末行,
+ * 不搬动任何数据;因为整屏内容都变了,滚屏会让所有行变脏,但一次输出中不论滚多少行,显存只写一遍
+*/
+static uint16_t shadow[CON_ROWS][CON_COLS];
+static uint32_t top;						// 屏幕第0行对应shadow的第top行
+static uint32_t cur_row, cur_col;	// 光标所在的屏幕行和列
+static uint32_t dirty;					// 第i位为1表示屏幕第i行需要写回显存
+
+/* 屏幕第row行在shadow中的位置 */
+static inline uint16_t* screen_line(uint32_t row) {
+	uint32_t idx = top + row;
+	if (idx >= CON_ROWS) idx -= CON_ROWS;
+	return shadow[idx];
+}
+
+/* 上滚一行 */
+static void con_scroll(void) {
+	if (++top == CON_ROWS) top = 0;
+	uint16_t* line = screen_line(CON_ROWS - 1);
+	uint32_t col;
+	for (col = 0; col < CON_COLS; ++col) line[col] = CON_ATTR | ' ';
+	dirty = CON_ALL_DIRTY;
+}
+
+/* 光标移到下一行行首,到底时滚屏 */
+static void con_newline(void) {
+	cur_col = 0;
+	if (++cur_row == CON_ROWS) {
+		con_scroll();
+		cur_row = CON_ROWS - 1;
+	}
+}
+
+/* 将字符c写入shadow,\r与\n一样都表示换到下一行行首,\b删除光标前一个字符 */
+static void con_putc(uint8_t c) {
+	if (c == '\n' || c == '\r') {
+		con_newline();
+	} else if (c == '\b') {
+		if (cur_col > 0) {
+			--cur_col;
+		} else if (cur_row > 0) {
+			--cur_row;
+			cur_col = CON_COLS - 1;
+		} else {
+			return;
+		}
+		screen_line(cur_row)[cur_col] = CON_ATTR | ' ';
+		dirty |= 1 << cur_row;
+	} else {
+		screen_line(cur_row)[cur_col] = CON_ATTR | c;
+		dirty |= 1 << cur_row;
+		if (++cur_col == CON_COLS) con_newline();
+	}
+}
+
+/* 把脏行写回显存,再设置一次光标 */
+static void con_flush(void) {
+	uint32_t row;
+	for (row = 0; dirty != 0; ++row, dirty >>= 1) {
+		if (!(dirty & 1)) continue;
+		/* 每行160字节,按双字搬运 */
+		uint32_t* dst = VIDEO_BASE + row * CON_COLS / 2;
+		uint32_t* src = (uint32_t*)screen_line(row);
+		uint32_t i;
+		for (i = 0; i < CON_COLS / 2; ++i) dst[i] = src[i];
+	}
+	set_cursor(cur_row * CON_COLS + cur_col);
+}
+
+/**
+ * 初始化终端.此前的输出是print.S直接写到显存的,以显存和光标的现状作为shadow的初值.
+ * 此后的输出都须经console_*或printk,put_str不知道shadow的存在,它写的内容会在下次刷新时被覆盖
+*/
 void console_init() {
-	lock_init(&console_lock);
+	lock_init(&console_lock, "console");
+
+	uint32_t row, col;
+	uint16_t* video = (uint16_t*)VIDEO_BASE;
+	for (row = 0; row < CON_ROWS; ++row) {
+		for (col = 0; col < CON_COLS; ++col) {
+			shadow[row][col] = video[row * CON_COLS + col];
+		}
+	}
+	top = 0;
+	dirty = 0;
+
+	outb(CRT_ADDR_REG, 0x0e);
+	uint32_t pos = inb(CRT_DATA_REG) << 8;
+	outb(CRT_ADDR_REG, 0x0f);
+	pos |= inb(CRT_DATA_REG);
+	if (pos >= CON_ROWS * CON_COLS) pos = (CON_ROWS - 1) * CON_COLS;
+	cur_row = pos / CON_COLS;
+	cur_col = pos % CON_COLS;
 }
 
 /* 获取终端 */
@@ -21,23 +127,34 @@ void console_release() {
 	lock_release(&console_lock);
 }
 
-/* 终端中输出字符串 */
-void console_put_str(char* str) {
+/* 终端中输出buf中的len个字符,整批只刷新一次显存,同时镜像到串口 */
+void console_write(const char* buf, uint32_t len) {
 	console_acquire();
-	put_str(str);
+	uint32_t i;
+	for (i = 0; i < len; ++i) con_putc(buf[i]);
+	con_flush();
+	serial_write(buf, len);
 	console_release();
 }
 
+/* 终端中输出字符串 */
+void console_put_str(char* str) {
+	console_write(str, strlen(str));
+}
+
 /* 终端中输出字符 */
 void console_put_char(uint8_t char_asci) {
-	console_acquire();
-	put_char(char_asci);
-	console_release();
+	char c = char_asci;
+	console_write(&c, 1);
 }
 
-/* 终端中输出十六进制整数 */
+/* 终端中输出十六进制整数,与put_int一样不带0x前缀,不输出前导0 */
 void console_put_int(uint32_t num) {
-	console_acquire();
-	put_int(num);
-	console_release();
-}
\ No newline at end of file
+	char digits[8];
+	int32_t pos = 8;
+	do {
+		digits[--pos] = "0123456789ABCDEF"[num & 0xf];
+		num >>= 4;
+	} while (num != 0);
+	console_write(digits + pos, 8 - pos);
+}
@@ -6,6 +6,7 @@
 void console_init(void);
 void console_acquire(void);
 void console_release(void);
+void console_write(const char* buf, uint32_t len);
 void console_put_str(char* str);
 void console_put_char(uint8_t char_asci);
 void console_put_int(uint32_t num);
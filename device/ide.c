@@ -0,0 +1,389 @@
+#include "ide.h"
+#include "global.h"
+#include "stdint.h"
+#include "io.h"
+#include "interrupt.h"
+#include "memory.h"
+#include "sync.h"
+#include "debug.h"
+#include "stdio.h"
+#include "string.h"
+#include "pci.h"
+#include "block.h"
+#include "printk.h"
+#include "print.h"
+
+/* 定义硬盘各寄存器的端口号 */
+#define reg_data(channel)				(channel->port_base + 0)
+#define reg_error(channel)			(channel->port_base + 1)
+#define reg_sect_cnt(channel)		(channel->port_base + 2)
+#define reg_lba_l(channel)			(channel->port_base + 3)
+#define reg_lba_m(channel)			(channel->port_base + 4)
+#define reg_lba_h(channel)			(channel->port_base + 5)
+#define reg_dev(channel)				(channel->port_base + 6)
+#define reg_status(channel)			(channel->port_base + 7)
+#define reg_cmd(channel)				(reg_status(channel))
+#define reg_alt_status(channel)	(channel->ctrl_port)
+#define reg_ctl(channel)				reg_alt_status(channel)
+
+/* 定义总线主控各寄存器的端口号 */
+#define reg_bm_cmd(channel)			(channel->bmide_base + 0)
+#define reg_bm_status(channel)	(channel->bmide_base + 2)
+#define reg_bm_prdt(channel)		(channel->bmide_base + 4)
+
+/* reg_status寄存器的一些关键位 */
+#define BIT_STAT_BSY	0x80				// 硬盘忙
+#define BIT_STAT_DRDY	0x40				// 驱动器准备好
+#define BIT_STAT_DF		0x20				// 驱动器故障
+#define BIT_STAT_DRQ	0x8					// 数据传输准备好了
+#define BIT_STAT_ERR	0x1					// 命令出错
+
+/* device寄存器的一些关键位 */
+#define BIT_DEV_MBS	0xa0					// 第7位和第5位固定为1
+#define BIT_DEV_LBA	0x40
+#define BIT_DEV_DEV	0x10
+
+/* device control寄存器的位 */
+#define BIT_CTL_NIEN 0x2					// 为1时硬盘不发中断
+
+/* 一些硬盘操作的指令 */
+#define CMD_IDENTIFY			0xec		// identify指令
+#define CMD_READ_SECTOR		0x20		// 读扇区指令
+#define CMD_WRITE_SECTOR	0x30		// 写扇区指令
+#define CMD_READ_DMA			0xc8		// DMA读扇区指令
+#define CMD_WRITE_DMA			0xca		// DMA写扇区指令
+
+/* 总线主控命令寄存器和状态寄存器的位 */
+#define BM_CMD_START		0x1				// 开始传输,传输结束或出错后须由软件清0
+#define BM_CMD_READ			0x8				// 传输方向,为1表示从硬盘读入内存
+#define BM_STAT_ERR			0x2				// 传输出错,写1清0
+#define BM_STAT_INTR		0x4				// 硬盘发出了中断,写1清0
+
+#define PRD_EOT 0x8000						// prd_entry.flags中表示最后一项的位
+#define PRDT_MAX (PG_SIZE / sizeof(prd_entry))
+
+#define max_lba ((1 << 28) - 1)		// 只支持LBA28,最大128GB
+#define MAX_SEC_PER_CMD 256				// 一条命令最多读写的扇区数,扇区数寄存器写0表示256
+#define ATA_POLL_LIMIT 1000000		// 轮询状态寄存器的最多次数,每次读端口约1微秒
+#define IDE_VEC_BASE 0x2e					// 主通道接从片IRQ14,次通道接IRQ15
+
+uint8_t channel_cnt;							// 通道数
+ide_channel channels[2];					// 有两个ide通道
+
+static const block_ops ide_ops;
+
+/* 读4次alternate status寄存器,延时约400ns,等待选择硬盘或写命令后状态寄存器有效 */
+static void ata_delay(ide_channel* channel) {
+	uint8_t i;
+	for (i = 0; i < 4; ++i) {
+		inb(reg_alt_status(channel));
+	}
+}
+
+/* 轮询等待硬盘不忙,返回最后读到的状态;超时返回时BSY位仍为1 */
+static uint8_t busy_wait(ide_channel* channel) {
+	uint32_t cnt = ATA_POLL_LIMIT;
+	uint8_t status;
+	do {
+		status = inb(reg_alt_status(channel));
+	} while ((status & BIT_STAT_BSY) && --cnt);
+	return status;
+}
+
+/* 状态status是否表示数据已准备好传输 */
+static inline bool drq_ready(uint8_t status) {
+	return (status & (BIT_STAT_BSY | BIT_STAT_DF | BIT_STAT_ERR | BIT_STAT_DRQ)) == BIT_STAT_DRQ;
+}
+
+/* 选择读写的硬盘,lba的第24~27位也在device寄存器中 */
+static void select_disk(disk* hd, uint32_t lba) {
+	uint8_t reg_device = BIT_DEV_MBS | BIT_DEV_LBA | ((lba >> 24) & 0x0f);
+	if (hd->dev_no == 1) {	// 若是从盘就置DEV位为1
+		reg_device |= BIT_DEV_DEV;
+	}
+	outb(reg_dev(hd->my_channel), reg_device);
+	ata_delay(hd->my_channel);
+}
+
+/* 向硬盘控制器写入起始扇区地址及要读写的扇区数,sec_cnt为256时写入0 */
+static void select_sector(disk* hd, uint32_t lba, uint32_t sec_cnt) {
+	ASSERT(lba <= max_lba);
+	ide_channel* channel = hd->my_channel;
+	outb(reg_sect_cnt(channel), (uint8_t)sec_cnt);
+	outb(reg_lba_l(channel), lba);
+	outb(reg_lba_m(channel), lba >> 8);
+	outb(reg_lba_h(channel), lba >> 16);
+}
+
+/* 向通道channel发命令cmd,之后由中断处理程序唤醒等待在disk_done上的驱动程序 */
+static void cmd_out(ide_channel* channel, uint8_t cmd) {
+	channel->expecting_intr = true;
+	outb(reg_cmd(channel), cmd);
+}
+
+/**
+ * 以PIO方式读写至多MAX_SEC_PER_CMD个扇区.
+ * 读时硬盘每准备好一个扇区发一次中断;写时第一个扇区直接轮询DRQ写入,此后每写完一个扇区发一次中断
+*/
+static bool pio_rw(disk* hd, uint32_t lba, uint8_t* buf, uint32_t sec_cnt, bool is_write) {
+	ide_channel* channel = hd->my_channel;
+	uint32_t i;
+	channel->dma_active = false;
+	select_sector(hd, lba, sec_cnt);
+	if (!is_write) {
+		cmd_out(channel, CMD_READ_SECTOR);
+		for (i = 0; i < sec_cnt; ++i) {
+			sema_down(&channel->disk_done);
+			if (!drq_ready(channel->status)) return false;
+			/* 读走本扇区后硬盘才会为下一扇区发中断,所以先置上等待标志 */
+			channel->expecting_intr = i + 1 < sec_cnt;
+			insw(reg_data(channel), buf + i * BLOCK_SECTOR_SIZE, BLOCK_SECTOR_SIZE / 2);
+		}
+	} else {
+		outb(reg_cmd(channel), CMD_WRITE_SECTOR);
+		for (i = 0; i < sec_cnt; ++i) {
+			if (!drq_ready(busy_wait(channel))) return false;
+			channel->expecting_intr = true;
+			outsw(reg_data(channel), buf + i * BLOCK_SECTOR_SIZE, BLOCK_SECTOR_SIZE / 2);
+			sema_down(&channel->disk_done);
+			if (channel->status & (BIT_STAT_DF | BIT_STAT_ERR)) return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * 按buf所在的物理页填写PRD表.
+ * 缓冲区在虚拟地址上连续,物理页却未必,因此逐页查物理地址,物理上相连且不跨64KB边界的页合并为一项
+*/
+static void prdt_fill(ide_channel* channel, uint8_t* buf, uint32_t bytes) {
+	uint32_t vaddr = (uint32_t)buf;
+	uint32_t idx = 0, run_addr = 0, run_len = 0;
+	while (bytes > 0) {
+		uint32_t len = PG_SIZE - (vaddr & (PG_SIZE - 1));
+		if (len > bytes) len = bytes;
+		uint32_t paddr = addr_v2p(vaddr);
+		if (run_len != 0 && paddr == run_addr + run_len && (run_addr >> 16) == ((paddr + len - 1) >> 16)) {
+			run_len += len;
+		} else {
+			if (run_len != 0) {
+				channel->prdt[idx].addr = run_addr;
+				channel->prdt[idx].byte_cnt = (uint16_t)run_len;
+				channel->prdt[idx].flags = 0;
+				++idx;
+			}
+			run_addr = paddr;
+			run_len = len;
+		}
+		vaddr += len;
+		bytes -= len;
+	}
+	ASSERT(idx < PRDT_MAX);
+	channel->prdt[idx].addr = run_addr;
+	channel->prdt[idx].byte_cnt = (uint16_t)run_len;		// 恰为64KB时写入0
+	channel->prdt[idx].flags = PRD_EOT;
+}
+
+/* 以总线主控DMA方式读写至多MAX_SEC_PER_CMD个扇区,整个传输只有一次中断 */
+static bool dma_rw(disk* hd, uint32_t lba, uint8_t* buf, uint32_t sec_cnt, bool is_write) {
+	ide_channel* channel = hd->my_channel;
+	uint8_t dir = is_write ? 0 : BM_CMD_READ;
+	prdt_fill(channel, buf, sec_cnt * BLOCK_SECTOR_SIZE);
+
+	outb(reg_bm_cmd(channel), 0);
+	outl(reg_bm_prdt(channel), channel->prdt_phy);
+	outb(reg_bm_cmd(channel), dir);
+	/* 状态寄存器的第5、6位是硬盘的DMA能力,原样写回;ERR和INTR位写1清0 */
+	outb(reg_bm_status(channel), inb(reg_bm_status(channel)) | BM_STAT_ERR | BM_STAT_INTR);
+
+	select_sector(hd, lba, sec_cnt);
+	channel->dma_active = true;
+	cmd_out(channel, is_write ? CMD_WRITE_DMA : CMD_READ_DMA);
+	outb(reg_bm_cmd(channel), dir | BM_CMD_START);
+	sema_down(&channel->disk_done);
+	channel->dma_active = false;
+	return !(channel->status & (BIT_STAT_DF | BIT_STAT_ERR)) && !(channel->bm_status & BM_STAT_ERR);
+}
+
+/* 读写硬盘hd从lba起的sec_cnt个扇区,按每条命令最多MAX_SEC_PER_CMD个扇区分批 */
+static bool ide_rw(disk* hd, uint32_t lba, uint8_t* buf, uint32_t sec_cnt, bool is_write) {
+	ASSERT(hd->present && lba + sec_cnt <= hd->bdev.sectors);
+	ide_channel* channel = hd->my_channel;
+	/* PRD中的物理地址须2字节对齐,奇地址的缓冲区只能用PIO */
+	bool use_dma = hd->dma && ((uint32_t)buf & 1) == 0;
+	bool ok = true;
+
+	lock_acquire(&channel->lock);
+	while (sec_cnt > 0) {
+		uint32_t cnt = sec_cnt < MAX_SEC_PER_CMD ? sec_cnt : MAX_SEC_PER_CMD;
+		select_disk(hd, lba);
+		ok = !(busy_wait(channel) & BIT_STAT_BSY);
+		if (ok) {
+			ok = use_dma ? dma_rw(hd, lba, buf, cnt, is_write) : pio_rw(hd, lba, buf, cnt, is_write);
+		}
+		if (!ok) {
+			channel->expecting_intr = false;
+			printk(LOG_ERR, "%s: %s error at sector %d, status %x\n", hd->name, is_write ? "write" : "read", lba, channel->status);
+			break;
+		}
+		lba += cnt;
+		buf += cnt * BLOCK_SECTOR_SIZE;
+		sec_cnt -= cnt;
+	}
+	lock_release(&channel->lock);
+	return ok;
+}
+
+/* 从硬盘读取sec_cnt个扇区到buf */
+bool ide_read(disk* hd, uint32_t lba, void* buf, uint32_t sec_cnt) {
+	return ide_rw(hd, lba, buf, sec_cnt, false);
+}
+
+/* 将buf中sec_cnt扇区数据写入硬盘 */
+bool ide_write(disk* hd, uint32_t lba, const void* buf, uint32_t sec_cnt) {
+	return ide_rw(hd, lba, (uint8_t*)buf, sec_cnt, true);
+}
+
+static bool ide_bdev_read(block_device* bdev, uint32_t lba, void* buf, uint32_t sec_cnt) {
+	return ide_read(bdev->priv, lba, buf, sec_cnt);
+}
+
+static bool ide_bdev_write(block_device* bdev, uint32_t lba, const void* buf, uint32_t sec_cnt) {
+	return ide_write(bdev->priv, lba, buf, sec_cnt);
+}
+
+static const block_ops ide_ops = {ide_bdev_read, ide_bdev_write};
+
+/* 将dst中len个相邻字节交换位置后存入buf,identify返回的字符串每个字中的两个字节是反的 */
+static void swap_pairs_bytes(const char* dst, char* buf, uint32_t len) {
+	uint8_t idx;
+	for (idx = 0; idx < len; idx += 2) {
+		buf[idx + 1] = *dst++;
+		buf[idx] = *dst++;
+	}
+	buf[idx] = '\0';
+}
+
+/**
+ * 向硬盘发identify命令,获得硬盘的扇区数和DMA能力.
+ * 此时尚未开中断,通道已用nIEN屏蔽硬盘中断,全程轮询.不存在或不是ATA硬盘时返回false
+*/
+static bool identify_disk(disk* hd) {
+	ide_channel* channel = hd->my_channel;
+	char id_info[512];
+	select_disk(hd, 0);
+	select_sector(hd, 0, 0);
+	outb(reg_cmd(channel), CMD_IDENTIFY);
+	ata_delay(channel);
+	if (inb(reg_alt_status(channel)) == 0) return false;		// 状态为0表示没有这块盘
+
+	uint8_t status = busy_wait(channel);
+	/* ATAPI光驱等设备会在lba_m、lba_h中留下签名并报错 */
+	if ((status & BIT_STAT_BSY) || inb(reg_lba_m(channel)) != 0 || inb(reg_lba_h(channel)) != 0) {
+		return false;
+	}
+	uint32_t cnt = ATA_POLL_LIMIT;
+	while (!(status & (BIT_STAT_DRQ | BIT_STAT_ERR)) && --cnt) {
+		status = inb(reg_alt_status(channel));
+	}
+	if (!drq_ready(status)) return false;
+	insw(reg_data(channel), id_info, 256);
+
+	char model[41];
+	uint8_t model_start = 27 * 2;
+	uint8_t capabilities = 49 * 2, sectors_start = 60 * 2;
+	swap_pairs_bytes(&id_info[model_start], model, 40);
+	hd->bdev.sectors = *(uint32_t*)&id_info[sectors_start];
+	hd->dma = channel->bmide_base != 0 && (id_info[capabilities + 1] & 0x1);	// 第49字的第8位表示支持DMA
+	printk(LOG_INFO, "%s: %s, %d sectors, %s\n", hd->name, model, hd->bdev.sectors, hd->dma ? "dma" : "pio");
+	return hd->bdev.sectors != 0;
+}
+
+/* 硬盘中断处理程序 */
+static void intr_hd_handler(uint8_t irq_no) {
+	ASSERT(irq_no == IDE_VEC_BASE || irq_no == IDE_VEC_BASE + 1);
+	uint8_t ch_no = irq_no - IDE_VEC_BASE;
+	if (ch_no >= channel_cnt) return;
+	ide_channel* channel = &channels[ch_no];
+	if (channel->dma_active) {
+		/* 停止总线主控,ERR和INTR位写1清0 */
+		channel->bm_status = inb(reg_bm_status(channel));
+		outb(reg_bm_cmd(channel), inb(reg_bm_cmd(channel)) & ~BM_CMD_START);
+		outb(reg_bm_status(channel), channel->bm_status);
+	}
+	/* 读取状态寄存器使硬盘认为此次中断已被处理,从而硬盘可以继续执行新的读写 */
+	channel->status = inb(reg_status(channel));
+	if (channel->expecting_intr) {
+		channel->expecting_intr = false;
+		sema_up(&channel->disk_done);
+	}
+}
+
+/**
+ * 在PCI总线上找IDE控制器(类代码01h,子类代码01h),取BAR4作为总线主控寄存器的基址并允许其发起DMA.
+ * 只支持兼容模式,两个通道仍使用固定的端口和IRQ14/15.找不到时返回0,只用PIO
+*/
+static uint16_t bmide_probe(void) {
+	pci_addr addr;
+	if (!pci_find_class(0x01, 0x01, &addr)) return 0;
+	uint32_t bar4 = pci_read_config(&addr, PCI_BAR0 + 4 * 4);
+	if (!(bar4 & 0x1)) return 0;		// 总线主控寄存器应在I/O空间
+	/* 高16位是状态寄存器,写0不改变它 */
+	uint32_t command = pci_read_config(&addr, PCI_COMMAND) & 0xffff;
+	pci_write_config(&addr, PCI_COMMAND, command | PCI_COMMAND_IO | PCI_COMMAND_MASTER);
+	return bar4 & 0xfffc;
+}
+
+/* 硬盘数据结构初始化 */
+void ide_init(void) {
+	put_str("ide_init start\n");
+	uint16_t bmide_base = bmide_probe();
+	uint8_t channel_no, dev_no;
+	channel_cnt = 2;
+	for (channel_no = 0; channel_no < channel_cnt; ++channel_no) {
+		ide_channel* channel = &channels[channel_no];
+		sprintf(channel->name, "ide%d", channel_no);
+		channel->port_base = channel_no == 0 ? 0x1f0 : 0x170;
+		channel->ctrl_port = channel_no == 0 ? 0x3f6 : 0x376;
+		channel->irq_no = IDE_VEC_BASE + channel_no;
+		channel->bmide_base = bmide_base == 0 ? 0 : bmide_base + channel_no * 8;
+		channel->expecting_intr = false;
+		channel->dma_active = false;
+		lock_init(&channel->lock, channel->name);
+		/* 初始化为0,目的是向硬盘控制器请求数据后,驱动程序对sema_down此信号量会阻塞线程,
+			直到硬盘完成后通过发中断,由中断处理程序将此信号量sema_up,唤醒线程 */
+		sema_init(&channel->disk_done, 0);
+		if (channel->bmide_base != 0) {
+			channel->prdt = get_kernel_pages(1);
+			if (channel->prdt == NULL) {
+				channel->bmide_base = 0;
+			} else {
+				channel->prdt_phy = addr_v2p((uint32_t)channel->prdt);
+			}
+		}
+		register_handler(channel->irq_no, intr_hd_handler);
+
+		for (dev_no = 0; dev_no < 2; ++dev_no) {
+			disk* hd = &channel->devices[dev_no];
+			hd->my_channel = channel;
+			hd->dev_no = dev_no;
+			hd->present = false;
+			sprintf(hd->name, "sd%c", 'a' + channel_no * 2 + dev_no);
+		}
+		if (inb(reg_status(channel)) == 0xff) continue;		// 总线浮空,通道上没有设备
+
+		outb(reg_ctl(channel), BIT_CTL_NIEN);
+		for (dev_no = 0; dev_no < 2; ++dev_no) {
+			disk* hd = &channel->devices[dev_no];
+			hd->present = identify_disk(hd);
+			if (hd->present) {
+				strcpy(hd->bdev.name, hd->name);
+				hd->bdev.ops = &ide_ops;
+				hd->bdev.priv = hd;
+				block_register(&hd->bdev);
+			}
+		}
+		outb(reg_ctl(channel), 0);
+	}
+	put_str("ide_init done\n");
+}
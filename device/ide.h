@@ -0,0 +1,53 @@
+#ifndef __DEVICE_IDE_H
+#define __DEVICE_IDE_H
+
+#include "stdint.h"
+#include "global.h"
+#include "sync.h"
+#include "block.h"
+
+/* PIIX总线主控DMA的物理区域描述符(PRD),描述一段物理上连续、不跨64KB边界的内存 */
+typedef struct {
+	uint32_t addr;							// 物理地址,须2字节对齐
+	uint16_t byte_cnt;					// 字节数,0表示64KB
+	uint16_t flags;							// 最高位为1表示这是表中最后一项
+} __attribute__((packed)) prd_entry;
+
+struct ide_channel;
+
+/* 硬盘结构 */
+typedef struct {
+	char name[8];								// 本硬盘的名称,如sda等
+	struct ide_channel* my_channel;	// 此块硬盘归属于哪个ide通道
+	uint8_t dev_no;							// 本硬盘是主0还是从1
+	bool present;								// 是否探测到了硬盘
+	bool dma;										// 是否用总线主控DMA读写
+	block_device bdev;					// 注册到块设备层的设备
+} disk;
+
+/* ata通道结构 */
+typedef struct ide_channel {
+	char name[8];								// 本ata通道名称
+	uint16_t port_base;					// 本通道的起始端口号
+	uint16_t ctrl_port;					// 本通道的控制块寄存器端口号(alternate status/device control)
+	uint16_t bmide_base;				// 本通道的总线主控寄存器端口号,为0表示不支持DMA
+	uint8_t irq_no;							// 本通道所用的中断号
+	lock lock;									// 通道锁,同一时刻一个通道只处理一个请求
+	volatile bool expecting_intr;	// 表示等待硬盘的中断
+	bool dma_active;						// 当前请求是否使用DMA
+	semaphore disk_done;				// 用于阻塞、唤醒驱动程序
+	uint8_t status;							// 中断处理程序读到的状态寄存器
+	uint8_t bm_status;					// 中断处理程序读到的总线主控状态寄存器
+	prd_entry* prdt;						// 本通道的PRD表,占一页
+	uint32_t prdt_phy;					// PRD表的物理地址
+	disk devices[2];						// 一个通道上连接两个硬盘,一主一从
+} ide_channel;
+
+extern uint8_t channel_cnt;
+extern ide_channel channels[];
+
+void ide_init(void);
+bool ide_read(disk* hd, uint32_t lba, void* buf, uint32_t sec_cnt);
+bool ide_write(disk* hd, uint32_t lba, const void* buf, uint32_t sec_cnt);
+
+#endif
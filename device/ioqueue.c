@@ -2,88 +2,115 @@
 #include "interrupt.h"
 #include "global.h"
 #include "debug.h"
-#include "sync.h"
+#include "string.h"
+#include "wait_queue.h"
 
-/* 初始化io队列 ioq */
-void ioqueue_init(ioqueue* ioq) {
-	lock_init(&ioq->lock);									// 初始化 io 队列的锁
-	ioq->producer = ioq->consumer = NULL;		// 生产者和消费者置空
-	ioq->head = ioq->tail = 0;							// 队列的首尾指针指向缓冲区数组第0个位置
+/* 编译器屏障.x86不会把写操作与更早的写重排,也不会把读与更早的读重排,只需阻止编译器重排 */
+#define barrier() asm volatile ("" : : : "memory")
+
+/* 初始化io队列ioq,缓冲区为buf,大小size须为2的幂 */
+void ioqueue_init(ioqueue* ioq, char* buf, uint32_t size) {
+	ASSERT(size != 0 && (size & (size - 1)) == 0);
+	wq_init(&ioq->not_full);
+	wq_init(&ioq->not_empty);
+	ioq->buf = buf;
+	ioq->size = size;
+	ioq->mask = size - 1;
+	ioq->head = ioq->tail = 0;
 }
 
-/* 返回pos在缓冲区中的下一个位置值 */
-static int32_t next_pos(int32_t pos) {
-	return (pos + 1) % bufsize;
+/* 返回队列中的字节数 */
+uint32_t ioq_len(ioqueue* ioq) {
+	return ioq->head - ioq->tail;
 }
 
 /* 判断队列是否已满 */
 bool ioq_full(ioqueue* ioq) {
-	ASSERT(intr_get_status() == INTR_OFF);
-	return next_pos(ioq->head) == ioq->tail;
+	return ioq_len(ioq) == ioq->size;
 }
 
 /* 判断队列是否已空 */
 bool ioq_empty(ioqueue* ioq) {
-	ASSERT(intr_get_status() == INTR_OFF);
 	return ioq->head == ioq->tail;
 }
 
-/* 使当前生产者或消费者在此缓冲区上等待 */
-static void ioq_wait(task_struct **waiter) {
-	ASSERT(*waiter == NULL && waiter != NULL);
-	*waiter = running_thread();
-	thread_block(TASK_BLOCKED);
-}
+/**
+ * 从ioq中读出至多n个字节到buf,队列为空时阻塞直到至少有1个字节,返回读出的字节数.
+ * 数据在缓冲区中至多分成两段连续区域,各用一次memcpy搬运
+*/
+uint32_t ioq_read(ioqueue* ioq, void* buf, uint32_t n) {
+	if (n == 0) return 0;
+	/* 判空和阻塞须在关中断下完成,否则生产者可能在两者之间写入并唤醒,这次唤醒就丢了 */
+	if (ioq_empty(ioq)) {
+		intr_status old_status = intr_disable();
+		while (ioq_empty(ioq)) {
+			wq_wait(&ioq->not_empty, true);
+		}
+		intr_set_status(old_status);
+	}
+
+	uint32_t tail = ioq->tail;
+	uint32_t avail = ioq->head - tail;
+	barrier();													// 先读head,再读数据
+	if (n > avail) n = avail;
+	uint32_t off = tail & ioq->mask;
+	uint32_t first = ioq->size - off;
+	if (first > n) first = n;
+	memcpy(buf, ioq->buf + off, first);
+	memcpy((char*)buf + first, ioq->buf, n - first);
+	barrier();													// 数据读完再让出空间
+	ioq->tail = tail + n;
 
-/* 唤醒 waiter */
-static void wakeup(task_struct **waiter) {
-	ASSERT(*waiter != NULL && waiter != NULL);
-	thread_unblock(*waiter);
-	*waiter = NULL;
+	if (!wq_empty(&ioq->not_full)) wq_wake_one(&ioq->not_full);
+	return n;
 }
 
-/* 消费者从ioq队列中获取一个字符 */
-char ioq_getchar(ioqueue* ioq) {
-	ASSERT(intr_get_status() == INTR_OFF);
+/**
+ * 将buf中的n个字节全部写入ioq,缓冲区满时阻塞等待,返回n.
+ * 中断处理程序不能阻塞,应先用ioq_len确认空间足够.
+ * 每写完一批才唤醒一次消费者,写满需要等待前也会先唤醒消费者来腾出空间
+*/
+uint32_t ioq_write(ioqueue* ioq, const void* buf, uint32_t n) {
+	const char* src = buf;
+	uint32_t left = n;
+	while (left > 0) {
+		if (ioq_full(ioq)) {
+			if (!wq_empty(&ioq->not_empty)) wq_wake_one(&ioq->not_empty);
+			intr_status old_status = intr_disable();
+			while (ioq_full(ioq)) {
+				wq_wait(&ioq->not_full, true);
+			}
+			intr_set_status(old_status);
+		}
 
-	/* 	若缓冲区(队列)为空,把消费者ioq->consumer记为当前线程自己
-			目的是将来生产者往缓冲区里装商品后,生产者知道唤醒哪个消费者,
-			也就是唤醒当前线程自己
-	 */
-	// ! 如果当ioq为空时有多个消费者调用ioq_getchar,之后另一个线程多次调用ioq_putchar,
-	// ! 那么只会释放一个消费者,其余消费者还会继续阻塞
-	while (ioq_empty(ioq)) {
-		lock_acquire(&ioq->lock);
-		ioq_wait(&ioq->consumer);
-		lock_release(&ioq->lock);
-	}
+		uint32_t head = ioq->head;
+		uint32_t space = ioq->size - (head - ioq->tail);
+		barrier();												// 先读tail,再写数据
+		uint32_t chunk = left < space ? left : space;
+		uint32_t off = head & ioq->mask;
+		uint32_t first = ioq->size - off;
+		if (first > chunk) first = chunk;
+		memcpy(ioq->buf + off, src, first);
+		memcpy(ioq->buf, src + first, chunk - first);
+		barrier();												// 数据写完再发布
+		ioq->head = head + chunk;
 
-	char byte = ioq->buf[ioq->tail];
-	ioq->tail = next_pos(ioq->tail);
+		src += chunk;
+		left -= chunk;
+	}
 
-	if (ioq->producer != NULL) wakeup(&ioq->producer);
+	if (!wq_empty(&ioq->not_empty)) wq_wake_one(&ioq->not_empty);
+	return n;
+}
 
+/* 消费者从ioq队列中获取一个字符 */
+char ioq_getchar(ioqueue* ioq) {
+	char byte;
+	ioq_read(ioq, &byte, 1);
 	return byte;
 }
 
 /* 生产者往ioq队列中写入一个字符byte */
 void ioq_putchar(ioqueue* ioq, char byte) {
-	ASSERT(intr_get_status() == INTR_OFF);
-
-	/*
-		若缓冲区(队列)已经满了,把生产者ioq->producer记为自己,
-		为的是当缓冲区里的东西被消费者取完后让消费者知道唤醒哪个生产者,
-		也就是唤醒当前线程自己 
-	*/
-	// ! 同上所述
-	while (ioq_full(ioq)) {
-		lock_acquire(&ioq->lock);
-		ioq_wait(&ioq->producer);
-		lock_release(&ioq->lock);
-	}
-
-	ioq->buf[ioq->head] = byte;
-	ioq->head = next_pos(ioq->head);
-
-	if (ioq->consumer != NULL) wakeup(&ioq->consumer);
-}
\ No newline at end of file
+	ioq_write(ioq, &byte, 1);
+}
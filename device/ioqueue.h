@@ -3,25 +3,35 @@
 
 #include "stdint.h"
 #include "thread.h"
-#include "sync.h"
+#include "wait_queue.h"
 
-#define bufsize 64
-
-/* 环形队列 */
+/**
+ * 环形队列.
+ * 容量为2的幂,head和tail是只增不减的字节计数,用(计数 & mask)求下标,
+ * head - tail即队列中的字节数,无需取模,也不必空出一个字节来区分空和满.
+ * 单生产者单消费者时无锁:head只由生产者写,tail只由消费者写,
+ * 各自先搬数据再更新计数,另一方看到新计数时数据必已就位.
+ * 有多个生产者或多个消费者时,同一方须由调用者自行互斥.
+ * 缓冲区满时生产者在not_full上等待,空时消费者在not_empty上等待,
+ * 每批数据搬完只唤醒对方一次
+*/
 typedef struct {
-	// 生产者消费者问题
-	lock lock;
-	task_struct *producer;								// 生产者,缓冲区不满时就继续往里面放数据,否则就睡眠,此项记录哪个生产者在此缓冲区上睡眠
-	task_struct *consumer;								// 消费者,缓冲区不空时就继续从里面拿数据,否则就睡眠,此项记录哪个消费者在此缓冲区上睡眠
-	char buf[bufsize];										// 缓冲区大小
-	int32_t head;													// 队首，数据往队首处写入
-	int32_t tail;													// 队尾，数据从队尾处读出
+	wait_queue not_full;									// 等待缓冲区有空位的生产者
+	wait_queue not_empty;									// 等待缓冲区有数据的消费者
+	char* buf;														// 缓冲区,由调用者提供
+	uint32_t size;												// 缓冲区大小,须为2的幂
+	uint32_t mask;												// size - 1
+	volatile uint32_t head;								// 已写入的字节总数,数据往head & mask处写入
+	volatile uint32_t tail;								// 已读出的字节总数,数据从tail & mask处读出
 } ioqueue;
 
-void ioqueue_init(ioqueue* ioq);
+void ioqueue_init(ioqueue* ioq, char* buf, uint32_t size);
+uint32_t ioq_len(ioqueue* ioq);
 bool ioq_full(ioqueue* ioq);
 bool ioq_empty(ioqueue* ioq);
+uint32_t ioq_read(ioqueue* ioq, void* buf, uint32_t n);
+uint32_t ioq_write(ioqueue* ioq, const void* buf, uint32_t n);
 char ioq_getchar(ioqueue* ioq);
 void ioq_putchar(ioqueue* ioq, char byte);
 
-#endif
\ No newline at end of file
+#endif
@@ -4,6 +4,8 @@
 #include "io.h"
 #include "global.h"
 #include "ioqueue.h"
+#include "printk.h"
+#include "softirq.h"
 
 #define KBD_BUF_PORT 0x60			// 键盘buffer寄存器端口号为0x60
 
@@ -37,7 +39,15 @@
 
 /* 定义以下变量记录相应键是否按下的状态, ext_scancode用于记录makecode是否以0xe0开头 */
 static bool ctrl_status, shift_status, alt_status, caps_lock_status, ext_scancode;
-ioqueue kbd_buf;
+#define KBD_BUF_SIZE 64					// 键盘缓冲区大小,须为2的幂
+static char kbd_buf_space[KBD_BUF_SIZE];
+ioqueue kbd_buf;								// 键盘tasklet是唯一的生产者
+
+/* 中断处理程序只把扫描码存入scancode_buf,解码工作由kbd_tasklet在软中断中完成 */
+#define SCANCODE_BUF_SIZE 16
+static char scancode_buf_space[SCANCODE_BUF_SIZE];
+static ioqueue scancode_buf;
+static tasklet kbd_tasklet;
 
 
 /* 以通码make_code为索引的二维数组 */
@@ -106,9 +116,9 @@ static char keymap[][2] = {
 /*其它按键暂不处理*/
 };
 
-/* 键盘中断处理程序 */
-static void intr_keyboard_handler(void) {
-	/* 这次中断发生前的上一次中断,以下任意三个键是否有按下 */
+/* 解码一个扫描码,更新控制键状态,可见字符放入kbd_buf */
+static void kbd_decode(uint16_t scancode) {
+	/* 这次扫描码之前,以下任意三个键是否有按下 */
 
 	__attribute__((unused)) bool ctrl_down_last = ctrl_status;
 	bool shift_down_last = shift_status;
@@ -116,8 +126,7 @@ static void intr_keyboard_handler(void) {
 
 	bool break_code;
 	/* 若扫描码scancode是e0开头的,表示此键的按下将产生多个扫描码,
-	 		所以马上结束此次中断处理函数,等待下一个扫描码进来 */
-	uint16_t scancode = inb(KBD_BUF_PORT);
+	 		所以马上结束此次解码,等待下一个扫描码进来 */
 	if (scancode == 0xe0) {
 		ext_scancode = true;
 		return;
@@ -177,14 +186,32 @@ static void intr_keyboard_handler(void) {
 		else if (scancode == alt_l_make || scancode == alt_r_make) alt_status = true;
 		else if (scancode == caps_lock_make) caps_lock_status = !caps_lock_status;
 	} else {
-		put_str("unknown key\n");
+		printk(LOG_WARN, "keyboard: unknown key\n");
+	}
+}
+
+/* 键盘tasklet,开中断执行,解码中断处理程序攒下的全部扫描码 */
+static void kbd_tasklet_func(uint32_t data UNUSED) {
+	while (!ioq_empty(&scancode_buf)) {
+		kbd_decode((uint8_t)ioq_getchar(&scancode_buf));
+	}
+}
+
+/* 键盘中断处理程序,只读出扫描码,其余工作推迟到kbd_tasklet */
+static void intr_keyboard_handler(void) {
+	uint8_t scancode = inb(KBD_BUF_PORT);		// 必须读出输出缓冲区,8042才会产生下一次中断
+	if (!ioq_full(&scancode_buf)) {
+		ioq_putchar(&scancode_buf, scancode);
 	}
+	tasklet_schedule(&kbd_tasklet);
 }
 
 	/* 键盘初始化 */
 void keyboard_init() {
 	put_str("keyboard init start\n");
-	ioqueue_init(&kbd_buf);
+	ioqueue_init(&kbd_buf, kbd_buf_space, KBD_BUF_SIZE);
+	ioqueue_init(&scancode_buf, scancode_buf_space, SCANCODE_BUF_SIZE);
+	tasklet_init(&kbd_tasklet, kbd_tasklet_func, 0);
 	register_handler(0x21, intr_keyboard_handler);
 	put_str("keyboard init done\n");
 }
\ No newline at end of file
@@ -0,0 +1,166 @@
+#include "pci.h"
+#include "global.h"
+#include "stdint.h"
+#include "io.h"
+#include "printk.h"
+#include "print.h"
+
+#define PCI_CONFIG_ADDRESS 0xcf8			// 配置地址端口
+#define PCI_CONFIG_DATA 0xcfc					// 配置数据端口
+#define PCI_MAX_DEV 32
+#define PCI_MAX_FUNC 8
+#define PCI_MAX_DEVICES 32						// 最多登记的设备功能数
+
+#define PCI_HEADER_NORMAL 0						// 配置头类型: 普通设备
+#define PCI_HEADER_BRIDGE 1						// 配置头类型: PCI到PCI的桥
+
+/* 枚举得到的设备功能,按发现的顺序存放,初始化后不再改变 */
+static pci_device pci_devices[PCI_MAX_DEVICES];
+static uint32_t pci_device_cnt;
+
+/* 生成配置地址: 最高位为使能位,其后依次是总线号、设备号、功能号和按双字对齐的寄存器偏移 */
+static inline uint32_t config_address(pci_addr* addr, uint8_t reg) {
+	return 0x80000000 | (uint32_t)addr->bus << 16 | (uint32_t)addr->dev << 11 | \
+		(uint32_t)addr->func << 8 | (reg & 0xfc);
+}
+
+/* 读取addr处设备配置空间中偏移为reg的双字 */
+uint32_t pci_read_config(pci_addr* addr, uint8_t reg) {
+	outl(PCI_CONFIG_ADDRESS, config_address(addr, reg));
+	return inl(PCI_CONFIG_DATA);
+}
+
+/* 向addr处设备配置空间中偏移为reg的双字写入value */
+void pci_write_config(pci_addr* addr, uint8_t reg, uint32_t value) {
+	outl(PCI_CONFIG_ADDRESS, config_address(addr, reg));
+	outl(PCI_CONFIG_DATA, value);
+}
+
+/**
+ * 探测前bar_cnt个基址寄存器的类型和大小.
+ * 写入全1后读回,未实现的位读回0,由此得到大小;探测期间关闭设备的译码,以免全1的地址与其它设备冲突.
+ * 64位的内存BAR占用两个寄存器,只支持位于4GB以下的
+*/
+static void bar_probe(pci_device* pdev, uint8_t bar_cnt) {
+	uint32_t command = pci_read_config(&pdev->addr, PCI_COMMAND) & 0xffff;
+	pci_write_config(&pdev->addr, PCI_COMMAND, command & ~(PCI_COMMAND_IO | PCI_COMMAND_MEMORY));
+	uint8_t i;
+	for (i = 0; i < bar_cnt; ++i) {
+		uint8_t reg = PCI_BAR0 + i * 4;
+		uint32_t orig = pci_read_config(&pdev->addr, reg);
+		pci_write_config(&pdev->addr, reg, 0xffffffff);
+		uint32_t mask = pci_read_config(&pdev->addr, reg);
+		pci_write_config(&pdev->addr, reg, orig);
+		if (mask == 0) continue;
+
+		pci_bar* bar = &pdev->bars[i];
+		if (orig & 0x1) {
+			bar->is_io = true;
+			bar->base = orig & ~0x3;
+			bar->size = (~(mask & ~0x3) & 0xffff) + 1;	// I/O空间只有64KB,高16位可能读回0
+		} else {
+			bar->is_io = false;
+			bar->prefetchable = (orig & 0x8) != 0;
+			bar->base = orig & ~0xf;
+			bar->size = ~(mask & ~0xf) + 1;
+			if (((orig >> 1) & 0x3) == 0x2) ++i;		// 64位BAR,跳过存放高32位的寄存器
+		}
+	}
+	pci_write_config(&pdev->addr, PCI_COMMAND, command);
+}
+
+static void pci_scan_bus(uint8_t bus);
+
+/* 登记addr处的设备功能,若是PCI桥则继续扫描桥下的总线 */
+static void pci_scan_function(pci_addr* addr, uint32_t id) {
+	if (pci_device_cnt == PCI_MAX_DEVICES) {
+		printk(LOG_WARN, "pci: too many devices, %d:%d.%d ignored\n", addr->bus, addr->dev, addr->func);
+		return;
+	}
+	pci_device* pdev = &pci_devices[pci_device_cnt++];
+	pdev->addr = *addr;
+	pdev->vendor_id = id & 0xffff;
+	pdev->device_id = id >> 16;
+	uint32_t class_rev = pci_read_config(addr, PCI_CLASS_REVISION);
+	pdev->class_code = class_rev >> 24;
+	pdev->subclass = (class_rev >> 16) & 0xff;
+	pdev->prog_if = (class_rev >> 8) & 0xff;
+	pdev->revision = class_rev & 0xff;
+	pdev->header_type = (pci_read_config(addr, PCI_HEADER_TYPE) >> 16) & 0x7f;
+	uint32_t intr = pci_read_config(addr, PCI_INTERRUPT_LINE);
+	pdev->irq_line = intr & 0xff;
+	pdev->irq_pin = (intr >> 8) & 0xff;
+
+	if (pdev->header_type == PCI_HEADER_NORMAL) {
+		bar_probe(pdev, PCI_BAR_CNT);
+	} else if (pdev->header_type == PCI_HEADER_BRIDGE) {
+		bar_probe(pdev, 2);
+	}
+	printk(LOG_INFO, "pci: %d:%d.%d %x:%x class %x.%x irq %d\n", addr->bus, addr->dev, addr->func,
+		pdev->vendor_id, pdev->device_id, pdev->class_code, pdev->subclass, pdev->irq_pin == 0 ? -1 : pdev->irq_line);
+
+	if (pdev->header_type == PCI_HEADER_BRIDGE) {
+		uint8_t secondary = (pci_read_config(addr, PCI_SECONDARY_BUS) >> 8) & 0xff;
+		if (secondary > addr->bus) {		// 次级总线号总比桥所在的总线大,防止错误的配置导致无限递归
+			pci_scan_bus(secondary);
+		}
+	}
+}
+
+/* 扫描总线bus上的所有设备,多功能设备逐个扫描其功能 */
+static void pci_scan_bus(uint8_t bus) {
+	pci_addr addr;
+	addr.bus = bus;
+	for (addr.dev = 0; addr.dev < PCI_MAX_DEV; ++addr.dev) {
+		uint8_t func_cnt = 1;
+		for (addr.func = 0; addr.func < func_cnt; ++addr.func) {
+			uint32_t id = pci_read_config(&addr, PCI_VENDOR_ID);
+			if ((id & 0xffff) == 0xffff) {
+				if (addr.func == 0) break;		// 功能0不存在则整个设备不存在
+				continue;
+			}
+			if (addr.func == 0 && (pci_read_config(&addr, PCI_HEADER_TYPE) & 0x800000)) {
+				func_cnt = PCI_MAX_FUNC;
+			}
+			pci_scan_function(&addr, id);
+		}
+	}
+}
+
+/* 从0号总线开始,经PCI桥递归地枚举所有设备功能,登记其BAR和IRQ */
+void pci_init(void) {
+	put_str("pci_init start\n");
+	pci_device_cnt = 0;
+	pci_scan_bus(0);
+	put_str("pci_init done\n");
+}
+
+/* 查找第一个类代码为class_code、子类代码为subclass的设备功能,找到时填入addr并返回true */
+bool pci_find_class(uint8_t class_code, uint8_t subclass, pci_addr* addr) {
+	uint32_t i;
+	for (i = 0; i < pci_device_cnt; ++i) {
+		if (pci_devices[i].class_code == class_code && pci_devices[i].subclass == subclass) {
+			*addr = pci_devices[i].addr;
+			return true;
+		}
+	}
+	return false;
+}
+
+/* 查找from之后第一个厂商号和设备号匹配的设备功能,from为NULL时从头找,找不到返回NULL */
+pci_device* pci_find_device(uint16_t vendor_id, uint16_t device_id, pci_device* from) {
+	uint32_t i = from == NULL ? 0 : (uint32_t)(from - pci_devices) + 1;
+	for (; i < pci_device_cnt; ++i) {
+		if (pci_devices[i].vendor_id == vendor_id && pci_devices[i].device_id == device_id) {
+			return &pci_devices[i];
+		}
+	}
+	return NULL;
+}
+
+/* 置位命令寄存器中的command_bits,如允许I/O译码和总线主控 */
+void pci_enable(pci_device* pdev, uint16_t command_bits) {
+	/* 高16位是状态寄存器,写0不改变它 */
+	uint32_t command = pci_read_config(&pdev->addr, PCI_COMMAND) & 0xffff;
+	pci_write_config(&pdev->addr, PCI_COMMAND, command | command_bits);
+}
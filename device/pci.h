@@ -0,0 +1,60 @@
+#ifndef __DEVICE_PCI_H
+#define __DEVICE_PCI_H
+
+#include "stdint.h"
+#include "global.h"
+
+/* 配置空间中常用寄存器的偏移 */
+#define PCI_VENDOR_ID 0x00
+#define PCI_COMMAND 0x04
+#define PCI_CLASS_REVISION 0x08				// 高8位类代码,次8位子类代码,再8位编程接口,低8位版本号
+#define PCI_HEADER_TYPE 0x0c					// 第2字节为头类型,最高位为1表示多功能设备
+#define PCI_BAR0 0x10
+#define PCI_SECONDARY_BUS 0x18				// PCI桥的配置头中,第2字节为桥下的次级总线号
+#define PCI_INTERRUPT_LINE 0x3c				// 低8位为BIOS分配的IRQ号,次8位为中断引脚
+
+#define PCI_BAR_CNT 6									// 普通设备有6个基址寄存器,PCI桥只有前2个
+
+/* 命令寄存器中的位 */
+#define PCI_COMMAND_IO 0x1						// 响应I/O空间访问
+#define PCI_COMMAND_MEMORY 0x2				// 响应内存空间访问
+#define PCI_COMMAND_MASTER 0x4				// 允许设备作为总线主控发起DMA
+
+/* 一个设备功能在配置空间中的地址 */
+typedef struct {
+	uint8_t bus;
+	uint8_t dev;
+	uint8_t func;
+} pci_addr;
+
+/* 基址寄存器描述的一段地址空间 */
+typedef struct {
+	uint32_t base;								// 起始地址,I/O空间时为端口号
+	uint32_t size;								// 字节数,为0表示未实现
+	bool is_io;										// 是否在I/O空间
+	bool prefetchable;						// 内存空间是否可预取
+} pci_bar;
+
+/* 枚举时登记的设备功能 */
+typedef struct {
+	pci_addr addr;
+	uint16_t vendor_id;
+	uint16_t device_id;
+	uint8_t class_code;
+	uint8_t subclass;
+	uint8_t prog_if;							// 编程接口
+	uint8_t revision;
+	uint8_t header_type;					// 配置头类型,0为普通设备,1为PCI桥
+	uint8_t irq_line;							// BIOS分配的IRQ号,0xff表示未连接
+	uint8_t irq_pin;							// 0表示不用INTx中断,1～4为INTA#～INTD#
+	pci_bar bars[PCI_BAR_CNT];
+} pci_device;
+
+void pci_init(void);
+uint32_t pci_read_config(pci_addr* addr, uint8_t reg);
+void pci_write_config(pci_addr* addr, uint8_t reg, uint32_t value);
+bool pci_find_class(uint8_t class_code, uint8_t subclass, pci_addr* addr);
+pci_device* pci_find_device(uint16_t vendor_id, uint16_t device_id, pci_device* from);
+void pci_enable(pci_device* pdev, uint16_t command_bits);
+
+#endif
@@ -0,0 +1,163 @@
+#include "serial.h"
+#include "stdint.h"
+#include "global.h"
+#include "io.h"
+#include "interrupt.h"
+#include "ioqueue.h"
+#include "print.h"
+
+#define COM1_PORT 0x3f8					// COM1的基地址
+#define COM1_IRQ_VEC 0x24				// COM1接在主片IR4上
+
+/* 16550各寄存器相对基地址的偏移 */
+#define UART_DATA 0							// 收发数据寄存器(RBR/THR),DLAB=1时为除数低字节
+#define UART_IER 1							// 中断使能寄存器,DLAB=1时为除数高字节
+#define UART_IIR 2							// 读:中断标识寄存器
+#define UART_FCR 2							// 写:FIFO控制寄存器
+#define UART_LCR 3							// 线路控制寄存器
+#define UART_MCR 4							// modem控制寄存器
+#define UART_LSR 5							// 线路状态寄存器
+#define UART_SCR 7							// 暂存寄存器
+
+#define IER_RDI 0x01						// 收到数据时中断
+#define IER_THRI 0x02						// 发送保持寄存器空时中断
+#define LCR_8N1 0x03						// 8位数据,无校验,1位停止位
+#define LCR_DLAB 0x80						// 置1后前两个寄存器用于设置波特率除数
+#define FCR_ENABLE 0xc7					// 开启FIFO,清空收发FIFO,接收FIFO满14字节时中断
+#define MCR_DTR_RTS_OUT2 0x0b		// OUT2须置1,否则UART的中断不会送到8259A
+#define LSR_DR 0x01							// 接收缓冲中有数据
+#define LSR_THRE 0x20						// 发送保持寄存器(及FIFO)为空
+#define IIR_NO_INT 0x01					// 没有待处理的中断
+
+#define UART_FIFO_SIZE 16				// 16550的发送FIFO深度
+#define BAUD_DIVISOR 1					// 115200 / 1 = 115200波特
+
+#define SERIAL_TX_SIZE 4096			// 发送缓冲区大小,须为2的幂
+#define SERIAL_RX_SIZE 256			// 接收缓冲区大小,须为2的幂
+
+/**
+ * COM1驱动.
+ * 写者把数据放进tx环形队列后立即返回,由发送中断每次往FIFO里填16字节,
+ * 写者不必等待慢速的串口.tx的消费者是中断处理程序和serial_kick,两者都在关中断下运行,
+ * 生产者须由调用者互斥(终端的输出都在console_lock下).收到的数据由中断处理程序放入rx
+*/
+static char tx_space[SERIAL_TX_SIZE];
+static char rx_space[SERIAL_RX_SIZE];
+static ioqueue tx_buf;
+static ioqueue rx_buf;
+static bool uart_present;				// 是否检测到了UART
+static bool tx_active;					// 发送中断是否已打开,即FIFO中是否还有待发数据
+
+/* 从tx取出数据填满发送FIFO,取空后关闭发送中断.须在关中断下调用,且发送FIFO须为空 */
+static void serial_fill_fifo(void) {
+	char chunk[UART_FIFO_SIZE];
+	uint32_t cnt = 0;
+	if (!ioq_empty(&tx_buf)) {
+		cnt = ioq_read(&tx_buf, chunk, UART_FIFO_SIZE);
+	}
+	uint32_t i;
+	for (i = 0; i < cnt; ++i) {
+		outb(COM1_PORT + UART_DATA, chunk[i]);
+	}
+
+	bool active = cnt > 0;
+	if (active != tx_active) {
+		tx_active = active;
+		outb(COM1_PORT + UART_IER, active ? (IER_RDI | IER_THRI) : IER_RDI);
+	}
+}
+
+/* 发送中断没开时由写者启动发送,此后由中断接力 */
+static void serial_kick(void) {
+	intr_status old_status = intr_disable();
+	if (!tx_active && (inb(COM1_PORT + UART_LSR) & LSR_THRE)) {
+		serial_fill_fifo();
+	}
+	intr_set_status(old_status);
+}
+
+/* COM1中断处理程序 */
+static void intr_serial_handler(void) {
+	while (!(inb(COM1_PORT + UART_IIR) & IIR_NO_INT)) {
+		uint8_t lsr = inb(COM1_PORT + UART_LSR);
+		/* 收:读空接收FIFO,缓冲区满时丢弃 */
+		while (lsr & LSR_DR) {
+			char c = inb(COM1_PORT + UART_DATA);
+			if (!ioq_full(&rx_buf)) {
+				ioq_putchar(&rx_buf, c);
+			}
+			lsr = inb(COM1_PORT + UART_LSR);
+		}
+		/* 发:FIFO空了就再填一批 */
+		if (lsr & LSR_THRE) {
+			serial_fill_fifo();
+		}
+	}
+}
+
+/**
+ * 将buf中的len个字节送往串口,'\n'前补'\r'以适应主机端终端.
+ * 在线程中调用且tx已满时会阻塞,直到发送中断腾出空间;
+ * 在关中断的上下文中不能阻塞,放不下的字节直接丢弃
+*/
+void serial_write(const char* buf, uint32_t len) {
+	if (!uart_present) return;
+	bool can_block = intr_get_status() == INTR_ON;
+	char chunk[64];
+	uint32_t cnt = 0;
+	while (len > 0) {
+		/* 攒一批转换好的字节再整批写入 */
+		while (len > 0 && cnt < sizeof(chunk) - 1) {
+			if (*buf == '\n') chunk[cnt++] = '\r';
+			chunk[cnt++] = *buf++;
+			--len;
+		}
+		if (!can_block) {
+			uint32_t space = tx_buf.size - ioq_len(&tx_buf);
+			if (cnt > space) cnt = space;
+		}
+		ioq_write(&tx_buf, chunk, cnt);
+		serial_kick();
+		cnt = 0;
+	}
+}
+
+/* 从串口读一个字符,没有数据时阻塞 */
+char serial_getchar(void) {
+	return ioq_getchar(&rx_buf);
+}
+
+/* 是否检测到了串口 */
+bool serial_present(void) {
+	return uart_present;
+}
+
+/* 初始化COM1: 115200波特,8N1,开启FIFO和接收中断 */
+void serial_init(void) {
+	put_str("serial_init start\n");
+	ioqueue_init(&tx_buf, tx_space, SERIAL_TX_SIZE);
+	ioqueue_init(&rx_buf, rx_space, SERIAL_RX_SIZE);
+	tx_active = false;
+
+	/* 通过暂存寄存器检测UART是否存在 */
+	outb(COM1_PORT + UART_SCR, 0xae);
+	uart_present = inb(COM1_PORT + UART_SCR) == 0xae;
+	if (!uart_present) {
+		put_str("serial_init: no uart on COM1\n");
+		return;
+	}
+
+	outb(COM1_PORT + UART_IER, 0);							// 设置期间先关闭中断
+	outb(COM1_PORT + UART_LCR, LCR_DLAB);
+	outb(COM1_PORT + UART_DATA, BAUD_DIVISOR & 0xff);
+	outb(COM1_PORT + UART_IER, BAUD_DIVISOR >> 8);
+	outb(COM1_PORT + UART_LCR, LCR_8N1);
+	outb(COM1_PORT + UART_FCR, FCR_ENABLE);
+	outb(COM1_PORT + UART_MCR, MCR_DTR_RTS_OUT2);
+	inb(COM1_PORT + UART_LSR);									// 读一次清掉残留的状态
+	inb(COM1_PORT + UART_DATA);
+	outb(COM1_PORT + UART_IER, IER_RDI);
+
+	register_handler(COM1_IRQ_VEC, intr_serial_handler);
+	put_str("serial_init done\n");
+}
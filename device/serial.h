@@ -0,0 +1,12 @@
+#ifndef __DEVICE_SERIAL_H
+#define __DEVICE_SERIAL_H
+
+#include "stdint.h"
+#include "global.h"
+
+void serial_init(void);
+bool serial_present(void);
+void serial_write(const char* buf, uint32_t len);
+char serial_getchar(void);
+
+#endif
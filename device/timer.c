@@ -4,8 +4,11 @@
 #include "interrupt.h"
 #include "thread.h"
 #include "debug.h"
+#include "global.h"
+#include "wait_queue.h"
 
 #define IRQ0_FREQUENCY 100
+#define mil_seconds_per_intr (1000 / IRQ0_FREQUENCY)
 #define INPUT_FREQUENCY 1193180
 #define COUNTER0_VALUE INPUT_FREQUENCY / IRQ0_FREQUENCY
 #define CONTRER0_PORT 0x40
@@ -16,6 +19,13 @@
 
 uint32_t ticks;							// ticks是内核自中断开启以来总共的嘀嗒数
 
+/**
+ * 睡眠的线程都在sleep_wq上等待,next_wakeup是其中最早的到期嘀嗒数.
+ * 时钟中断只在有线程到期时唤醒全部睡眠者,未到期的线程重新登记自己的到期时刻后继续睡
+*/
+static wait_queue sleep_wq;
+static uint32_t next_wakeup;
+
 static void intr_timer_handler(void) {
 	task_struct *cur_thread = running_thread();
 	ASSERT(cur_thread->stack_magic == 0x19870916); // 检查栈是否溢出
@@ -23,8 +33,12 @@ static void intr_timer_handler(void) {
 	++cur_thread->elapsed_ticks;									// 记录此线程占用的cpu时间
 	++ticks;					//从内核第一次处理时间中断后开始至今的滴哒数,内核态和用户态总共的嘀哒数
 
-	if (cur_thread->ticks == 0) {	// 若进程时间片用完,就开始调度新的进程上cpu
-		schedule();
+	if (!wq_empty(&sleep_wq) && (int32_t)(ticks - next_wakeup) >= 0) {
+		wq_wake_all(&sleep_wq);
+	}
+
+	if (cur_thread->ticks == 0) {	// 若进程时间片用完,由中断退出路径调度新的进程上cpu
+		need_resched = true;
 	} else {	// 将当前进程的时间片-1
 		--cur_thread->ticks;
 	}
@@ -42,11 +56,32 @@ static void frequency_set(uint8_t counter_port, uint8_t counter_no, uint8_t rwl,
 }
 
 
+/* 以tick为单位的sleep,任何时间形式的sleep会转换此ticks形式 */
+static void ticks_to_sleep(uint32_t sleep_ticks) {
+	uint32_t deadline = ticks + sleep_ticks;
+	intr_status old_status = intr_disable();
+	while ((int32_t)(ticks - deadline) < 0) {
+		if (wq_empty(&sleep_wq) || (int32_t)(deadline - next_wakeup) < 0) {
+			next_wakeup = deadline;
+		}
+		wq_wait(&sleep_wq, false);
+	}
+	intr_set_status(old_status);
+}
+
+/* 以毫秒为单位的sleep, 1秒 = 1000毫秒 */
+void mtime_sleep(uint32_t m_seconds) {
+	uint32_t sleep_ticks = DIV_ROUND_UP(m_seconds, mil_seconds_per_intr);
+	ASSERT(sleep_ticks > 0);
+	ticks_to_sleep(sleep_ticks);
+}
+
 /*初始化 PIT8253*/
 void timer_init(void) {
 	put_str("timer_init start\n");
 	/* 设置8253的定时周期,也就是发中断的周期 */
 	frequency_set(CONTRER0_PORT, COUNTER0_NO, READ_WRITE_LATCH, COUNTER_MODE, COUNTER0_VALUE);
+	wq_init(&sleep_wq);
 	register_handler(0x20, intr_timer_handler);
 	put_str("timer_init done\n");
 }
\ No newline at end of file
@@ -1,6 +1,11 @@
 #ifndef __DEVICE_TIMER_H
 #define __DEVICE_TIMER_H
 
+#include "stdint.h"
+
+extern uint32_t ticks;
+
 void timer_init(void);
+void mtime_sleep(uint32_t m_seconds);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,322 @@
+#include "virtio_blk.h"
+#include "global.h"
+#include "stdint.h"
+#include "io.h"
+#include "interrupt.h"
+#include "memory.h"
+#include "sync.h"
+#include "debug.h"
+#include "stdio.h"
+#include "string.h"
+#include "pci.h"
+#include "block.h"
+#include "printk.h"
+#include "print.h"
+
+#define VIRTIO_VENDOR_ID 0x1af4
+#define VIRTIO_BLK_DEVICE_ID 0x1001			// 过渡(transitional)设备,支持传统接口
+#define VIRTIO_BLK_MAX 4								// 最多支持的设备数
+
+/* 传统接口BAR0中各寄存器的偏移,未启用MSI-X时设备配置紧随其后 */
+#define VIRTIO_PCI_HOST_FEATURES 0x00		// 设备支持的特性,32位
+#define VIRTIO_PCI_GUEST_FEATURES 0x04	// 驱动选用的特性,32位
+#define VIRTIO_PCI_QUEUE_PFN 0x08				// 所选队列的物理页框号,32位
+#define VIRTIO_PCI_QUEUE_NUM 0x0c				// 所选队列的大小,16位,只读
+#define VIRTIO_PCI_QUEUE_SEL 0x0e				// 选择队列,16位
+#define VIRTIO_PCI_QUEUE_NOTIFY 0x10		// 写入队列号以通知设备,16位
+#define VIRTIO_PCI_STATUS 0x12					// 设备状态,8位
+#define VIRTIO_PCI_ISR 0x13							// 中断状态,8位,读取即清0并撤销中断
+#define VIRTIO_PCI_CONFIG 0x14					// 设备配置,virtio-blk开头是64位的扇区数
+
+/* 设备状态位 */
+#define VIRTIO_STATUS_ACKNOWLEDGE 0x1		// 驱动已发现设备
+#define VIRTIO_STATUS_DRIVER 0x2				// 驱动知道如何驱动它
+#define VIRTIO_STATUS_DRIVER_OK 0x4			// 驱动已就绪
+#define VIRTIO_STATUS_FAILED 0x80				// 驱动放弃了该设备
+
+#define VIRTIO_RING_F_EVENT_IDX 29			// 用used_event和avail_event抑制中断和通知
+#define VIRTIO_ISR_QUEUE 0x1						// ISR中表示有队列中断的位
+
+#define VIRTQ_DESC_F_NEXT 0x1						// 链中还有下一个描述符
+#define VIRTQ_DESC_F_WRITE 0x2					// 设备写、驱动读的缓冲区
+#define VIRTQ_USED_F_NO_NOTIFY 0x1			// 未协商EVENT_IDX时,设备用它表示暂不需要通知
+#define VIRTQ_ALIGN PG_SIZE							// 传统接口中已用环按页对齐
+
+#define VIRTIO_BLK_T_IN 0								// 读
+#define VIRTIO_BLK_T_OUT 1							// 写
+#define VIRTIO_BLK_S_OK 0
+
+#define MAX_SEC_PER_REQ 128							// 一个请求最多读写的扇区数,即64KB
+#define IRQ_VEC_BASE 0x20								// 主片IR0对应的中断向量号
+
+static virtio_blk virtio_blks[VIRTIO_BLK_MAX];
+static uint8_t virtio_blk_cnt;
+
+/* 禁止编译器把此前后的内存访问重排 */
+static inline void barrier(void) {
+	asm volatile ("" : : : "memory");
+}
+
+/* 完整的内存屏障,设备在宿主机的其它cpu上运行,写可用环索引与读avail_event之间不能被cpu重排 */
+static inline void mb(void) {
+	asm volatile ("lock; addl $0, (%%esp)" : : : "memory");
+}
+
+/* 请求头和状态字节所在的物理地址 */
+static inline uint32_t req_phy(virtio_blk* vblk, void* p) {
+	return vblk->reqs_phy + ((uint32_t)p - (uint32_t)vblk->reqs);
+}
+
+static inline void desc_set(virtio_blk* vblk, uint16_t idx, uint32_t paddr, uint32_t len, uint16_t flags) {
+	virtq_desc* d = &vblk->desc[idx];
+	d->addr = paddr;
+	d->len = len;
+	d->flags = flags;
+	d->next = flags & VIRTQ_DESC_F_NEXT ? idx + 1 : 0;
+}
+
+/**
+ * 在本批次第slot个请求中读写从lba起的sec_cnt个扇区,描述符从第head个开始,返回用掉的描述符数.
+ * 一个请求是一条描述符链: 请求头、数据缓冲区、状态字节.
+ * 缓冲区在虚拟地址上连续,物理页却未必,因此逐页查物理地址,物理上相连的页合并为一个描述符
+*/
+static uint16_t req_build(virtio_blk* vblk, uint16_t slot, uint16_t head, uint32_t lba, uint8_t* buf, uint32_t sec_cnt, bool is_write) {
+	virtio_blk_req* req = &vblk->reqs[slot];
+	req->hdr.type = is_write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN;
+	req->hdr.reserved = 0;
+	req->hdr.sector = lba;
+	req->status = 0xff;
+
+	uint16_t idx = head;
+	desc_set(vblk, idx++, req_phy(vblk, &req->hdr), sizeof(virtio_blk_req_hdr), VIRTQ_DESC_F_NEXT);
+	uint16_t data_flags = VIRTQ_DESC_F_NEXT | (is_write ? 0 : VIRTQ_DESC_F_WRITE);
+	uint32_t vaddr = (uint32_t)buf, bytes = sec_cnt * BLOCK_SECTOR_SIZE;
+	while (bytes > 0) {
+		uint32_t len = PG_SIZE - (vaddr & (PG_SIZE - 1));
+		if (len > bytes) len = bytes;
+		uint32_t paddr = addr_v2p(vaddr);
+		virtq_desc* prev = &vblk->desc[idx - 1];
+		if (idx - 1 != head && (uint32_t)prev->addr + prev->len == paddr) {
+			prev->len += len;
+		} else {
+			desc_set(vblk, idx++, paddr, len, data_flags);
+		}
+		vaddr += len;
+		bytes -= len;
+	}
+	desc_set(vblk, idx++, req_phy(vblk, &req->status), 1, VIRTQ_DESC_F_WRITE);
+
+	vblk->avail->ring[vblk->avail_idx++ & (vblk->qsize - 1)] = head;
+	return idx - head;
+}
+
+/**
+ * 提交本批次的req_cnt个请求并等待全部完成,返回是否都成功.
+ * 所有请求一次写入可用环,至多通知设备一次;协商了EVENT_IDX时,
+ * 把used_event设为最后一个请求完成时的位置,整批只产生一次中断
+*/
+static bool batch_submit(virtio_blk* vblk, uint16_t req_cnt) {
+	uint16_t old_idx = vblk->avail->idx;
+	vblk->wait_used = vblk->last_used + req_cnt;
+	*vblk->used_event = vblk->wait_used - 1;
+	vblk->expecting_intr = true;
+	barrier();
+	vblk->avail->idx = vblk->avail_idx;
+	mb();
+
+	bool kick;
+	if (vblk->event_idx) {
+		/* 设备等待的avail_event落在本次新增的区间内才需要通知 */
+		kick = (uint16_t)(vblk->avail_idx - *vblk->avail_event - 1) < (uint16_t)(vblk->avail_idx - old_idx);
+	} else {
+		kick = !(vblk->used->flags & VIRTQ_USED_F_NO_NOTIFY);
+	}
+	if (kick) {
+		outw(vblk->io_base + VIRTIO_PCI_QUEUE_NOTIFY, 0);
+	}
+	sema_down(&vblk->batch_done);
+
+	/* 批次中的请求都已完成,逐个检查状态 */
+	vblk->last_used = vblk->wait_used;
+	bool ok = true;
+	uint16_t i;
+	for (i = 0; i < req_cnt; ++i) {
+		if (vblk->reqs[i].status != VIRTIO_BLK_S_OK) {
+			printk(LOG_ERR, "%s: error at sector %d, status %d\n", vblk->name, (uint32_t)vblk->reqs[i].hdr.sector, vblk->reqs[i].status);
+			ok = false;
+		}
+	}
+	return ok;
+}
+
+/**
+ * 读写从lba起的sec_cnt个扇区.
+ * 按每个请求最多MAX_SEC_PER_REQ个扇区拆分,描述符和请求槽位够用时尽量放进同一批次.
+ * 同一时刻只有一个批次在设备上,描述符每批都从0开始分配,无需空闲链表
+*/
+static bool virtio_blk_rw(virtio_blk* vblk, uint32_t lba, uint8_t* buf, uint32_t sec_cnt, bool is_write) {
+	ASSERT(lba + sec_cnt <= vblk->bdev.sectors);
+	bool ok = true;
+	lock_acquire(&vblk->lock);
+	while (sec_cnt > 0 && ok) {
+		uint16_t desc_cnt = 0, req_cnt = 0;
+		while (sec_cnt > 0 && req_cnt < vblk->max_reqs) {
+			uint32_t cnt = sec_cnt < MAX_SEC_PER_REQ ? sec_cnt : MAX_SEC_PER_REQ;
+			/* 请求头、状态各一个,数据最坏情况下每页一个,起始不对齐时多一个 */
+			uint32_t need = 2 + DIV_ROUND_UP(cnt * BLOCK_SECTOR_SIZE, PG_SIZE) + 1;
+			if (desc_cnt + need > vblk->qsize) break;
+			desc_cnt += req_build(vblk, req_cnt++, desc_cnt, lba, buf, cnt, is_write);
+			lba += cnt;
+			buf += cnt * BLOCK_SECTOR_SIZE;
+			sec_cnt -= cnt;
+		}
+		ok = batch_submit(vblk, req_cnt);
+	}
+	lock_release(&vblk->lock);
+	return ok;
+}
+
+static bool virtio_blk_read(block_device* bdev, uint32_t lba, void* buf, uint32_t sec_cnt) {
+	return virtio_blk_rw(bdev->priv, lba, buf, sec_cnt, false);
+}
+
+static bool virtio_blk_write(block_device* bdev, uint32_t lba, const void* buf, uint32_t sec_cnt) {
+	return virtio_blk_rw(bdev->priv, lba, (uint8_t*)buf, sec_cnt, true);
+}
+
+static const block_ops virtio_blk_ops = {virtio_blk_read, virtio_blk_write};
+
+/* 中断处理程序,PCI中断可能与其它设备共用,所以检查每个使用该向量的设备 */
+static void intr_virtio_blk_handler(uint8_t irq_no) {
+	uint8_t i;
+	for (i = 0; i < virtio_blk_cnt; ++i) {
+		virtio_blk* vblk = &virtio_blks[i];
+		if (vblk->irq_no != irq_no) continue;
+		/* 读ISR使设备撤销电平触发的中断 */
+		if (!(inb(vblk->io_base + VIRTIO_PCI_ISR) & VIRTIO_ISR_QUEUE)) continue;
+		/* 未协商EVENT_IDX时每个请求完成都会有中断,整批完成后才唤醒驱动 */
+		if (vblk->expecting_intr && vblk->used->idx == vblk->wait_used) {
+			vblk->expecting_intr = false;
+			sema_up(&vblk->batch_done);
+		}
+	}
+}
+
+/* 传统接口中队列所占的字节数: 描述符表和可用环,按页对齐后是已用环 */
+static uint32_t vring_size(uint16_t qsize) {
+	uint32_t avail_end = sizeof(virtq_desc) * qsize + sizeof(uint16_t) * (3 + qsize);
+	return DIV_ROUND_UP(avail_end, VIRTQ_ALIGN) * VIRTQ_ALIGN + sizeof(uint16_t) * 3 + sizeof(virtq_used_elem) * qsize;
+}
+
+/* vaddr起的pg_cnt页在物理上是否连续,设备只知道队列的起始页框 */
+static bool phys_contiguous(void* vaddr, uint32_t pg_cnt) {
+	uint32_t first = addr_v2p((uint32_t)vaddr), i;
+	for (i = 1; i < pg_cnt; ++i) {
+		if (addr_v2p((uint32_t)vaddr + i * PG_SIZE) != first + i * PG_SIZE) return false;
+	}
+	return true;
+}
+
+/* 建立0号队列并告知设备,失败时返回false */
+static bool virtqueue_setup(virtio_blk* vblk) {
+	outw(vblk->io_base + VIRTIO_PCI_QUEUE_SEL, 0);
+	vblk->qsize = inw(vblk->io_base + VIRTIO_PCI_QUEUE_NUM);
+	/* 传统接口的队列大小由设备决定,须是2的幂 */
+	if (vblk->qsize == 0 || (vblk->qsize & (vblk->qsize - 1))) return false;
+
+	uint32_t pg_cnt = DIV_ROUND_UP(vring_size(vblk->qsize), PG_SIZE);
+	uint8_t* ring = get_kernel_pages(pg_cnt);
+	if (ring == NULL) return false;
+	if (!phys_contiguous(ring, pg_cnt)) {
+		free_kernel_pages(ring, pg_cnt);
+		return false;
+	}
+	vblk->reqs = get_kernel_pages(1);
+	if (vblk->reqs == NULL) {
+		free_kernel_pages(ring, pg_cnt);
+		return false;
+	}
+	vblk->reqs_phy = addr_v2p((uint32_t)vblk->reqs);
+
+	/* used_event和avail_event分别紧跟在两个环之后 */
+	uint32_t avail_off = sizeof(virtq_desc) * vblk->qsize;
+	uint32_t used_off = DIV_ROUND_UP(avail_off + sizeof(uint16_t) * (3 + vblk->qsize), VIRTQ_ALIGN) * VIRTQ_ALIGN;
+	vblk->desc = (virtq_desc*)ring;
+	vblk->avail = (virtq_avail*)(ring + avail_off);
+	vblk->used_event = (volatile uint16_t*)(ring + avail_off + sizeof(uint16_t) * (2 + vblk->qsize));
+	vblk->used = (virtq_used*)(ring + used_off);
+	vblk->avail_event = (volatile uint16_t*)(ring + used_off + sizeof(uint16_t) * 2 + sizeof(virtq_used_elem) * vblk->qsize);
+	vblk->avail_idx = 0;
+	vblk->last_used = 0;
+
+	/* 每个请求至少用3个描述符 */
+	vblk->max_reqs = vblk->qsize / 3;
+	if (vblk->max_reqs > PG_SIZE / sizeof(virtio_blk_req)) {
+		vblk->max_reqs = PG_SIZE / sizeof(virtio_blk_req);
+	}
+	outl(vblk->io_base + VIRTIO_PCI_QUEUE_PFN, addr_v2p((uint32_t)ring) / PG_SIZE);
+	return true;
+}
+
+/* 按传统接口的流程初始化设备: 复位、确认、协商特性、建立队列、就绪 */
+static bool virtio_blk_probe(virtio_blk* vblk, pci_device* pdev) {
+	pci_bar* bar0 = &pdev->bars[0];
+	if (!bar0->is_io || bar0->size < VIRTIO_PCI_CONFIG + 8) return false;
+	if (pdev->irq_pin == 0 || pdev->irq_line >= 16) return false;	// 只支持经8259A的INTx中断
+	vblk->pdev = pdev;
+	vblk->io_base = bar0->base;
+	vblk->irq_no = IRQ_VEC_BASE + pdev->irq_line;
+	pci_enable(pdev, PCI_COMMAND_IO | PCI_COMMAND_MASTER);
+
+	uint16_t io = vblk->io_base;
+	outb(io + VIRTIO_PCI_STATUS, 0);
+	outb(io + VIRTIO_PCI_STATUS, VIRTIO_STATUS_ACKNOWLEDGE);
+	outb(io + VIRTIO_PCI_STATUS, VIRTIO_STATUS_ACKNOWLEDGE | VIRTIO_STATUS_DRIVER);
+
+	uint32_t features = inl(io + VIRTIO_PCI_HOST_FEATURES) & (1 << VIRTIO_RING_F_EVENT_IDX);
+	outl(io + VIRTIO_PCI_GUEST_FEATURES, features);
+	vblk->event_idx = features != 0;
+
+	if (!virtqueue_setup(vblk)) {
+		outb(io + VIRTIO_PCI_STATUS, VIRTIO_STATUS_FAILED);
+		return false;
+	}
+
+	/* 扇区数是64位的,只支持LBA在32位以内的部分 */
+	uint32_t cap_low = inl(io + VIRTIO_PCI_CONFIG), cap_high = inl(io + VIRTIO_PCI_CONFIG + 4);
+	vblk->bdev.sectors = cap_high != 0 ? 0xffffffff : cap_low;
+
+	vblk->expecting_intr = false;
+	lock_init(&vblk->lock, vblk->name);
+	sema_init(&vblk->batch_done, 0);
+	register_handler(vblk->irq_no, intr_virtio_blk_handler);
+	pic_irq_unmask(pdev->irq_line);
+	outb(io + VIRTIO_PCI_STATUS, VIRTIO_STATUS_ACKNOWLEDGE | VIRTIO_STATUS_DRIVER | VIRTIO_STATUS_DRIVER_OK);
+
+	printk(LOG_INFO, "%s: virtio-blk at %d:%d.%d, io %x, irq %d, queue %d%s\n", vblk->name, pdev->addr.bus,
+		pdev->addr.dev, pdev->addr.func, io, pdev->irq_line, vblk->qsize, vblk->event_idx ? ", event idx" : "");
+	return true;
+}
+
+/* 找出所有virtio-blk设备,初始化后注册为块设备vda、vdb等 */
+void virtio_blk_init(void) {
+	put_str("virtio_blk_init start\n");
+	virtio_blk_cnt = 0;
+	pci_device* pdev = NULL;
+	while (virtio_blk_cnt < VIRTIO_BLK_MAX &&
+		(pdev = pci_find_device(VIRTIO_VENDOR_ID, VIRTIO_BLK_DEVICE_ID, pdev)) != NULL) {
+		virtio_blk* vblk = &virtio_blks[virtio_blk_cnt];
+		sprintf(vblk->name, "vd%c", 'a' + virtio_blk_cnt);
+		if (!virtio_blk_probe(vblk, pdev)) {
+			printk(LOG_WARN, "%s: can not initialize virtio-blk at %d:%d.%d\n", vblk->name,
+				pdev->addr.bus, pdev->addr.dev, pdev->addr.func);
+			continue;
+		}
+		++virtio_blk_cnt;
+		strcpy(vblk->bdev.name, vblk->name);
+		vblk->bdev.ops = &virtio_blk_ops;
+		vblk->bdev.priv = vblk;
+		block_register(&vblk->bdev);
+	}
+	put_str("virtio_blk_init done\n");
+}
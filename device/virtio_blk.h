@@ -0,0 +1,77 @@
+#ifndef __DEVICE_VIRTIO_BLK_H
+#define __DEVICE_VIRTIO_BLK_H
+
+#include "stdint.h"
+#include "global.h"
+#include "sync.h"
+#include "block.h"
+#include "pci.h"
+
+/* split virtqueue的描述符,描述一段物理上连续的缓冲区 */
+typedef struct {
+	uint64_t addr;							// 物理地址
+	uint32_t len;
+	uint16_t flags;							// VIRTQ_DESC_F_*
+	uint16_t next;							// flags含VIRTQ_DESC_F_NEXT时,链中下一个描述符的下标
+} __attribute__((packed)) virtq_desc;
+
+/* 驱动提供给设备的可用环,ring之后紧跟used_event */
+typedef struct {
+	uint16_t flags;
+	uint16_t idx;								// 下一个要写入ring的位置,只增不减,按队列大小取模
+	uint16_t ring[];						// 各请求首个描述符的下标
+} __attribute__((packed)) virtq_avail;
+
+typedef struct {
+	uint32_t id;								// 已完成请求的首个描述符的下标
+	uint32_t len;								// 设备写入的字节数
+} __attribute__((packed)) virtq_used_elem;
+
+/* 设备归还给驱动的已用环,ring之后紧跟avail_event */
+typedef struct {
+	uint16_t flags;
+	uint16_t idx;
+	virtq_used_elem ring[];
+} __attribute__((packed)) virtq_used;
+
+/* 请求头,设备只读 */
+typedef struct {
+	uint32_t type;							// VIRTIO_BLK_T_IN或VIRTIO_BLK_T_OUT
+	uint32_t reserved;
+	uint64_t sector;						// 起始扇区
+} __attribute__((packed)) virtio_blk_req_hdr;
+
+/* 一个请求中驱动自己的部分: 请求头和设备写回的状态字节,都要有物理地址 */
+typedef struct {
+	virtio_blk_req_hdr hdr;
+	uint8_t status;							// 设备写入VIRTIO_BLK_S_*
+} virtio_blk_req;
+
+/* virtio-blk设备,使用传统(legacy)的I/O端口接口和一个split virtqueue */
+typedef struct {
+	char name[8];								// 块设备名,如vda
+	pci_device* pdev;
+	uint16_t io_base;						// BAR0的I/O端口基址
+	uint8_t irq_no;							// 中断向量号
+	uint16_t qsize;							// 队列大小,即描述符的个数
+	bool event_idx;							// 是否协商了VIRTIO_RING_F_EVENT_IDX
+	virtq_desc* desc;
+	volatile virtq_avail* avail;
+	volatile virtq_used* used;
+	volatile uint16_t* used_event;	// 设备在used->idx越过它之后才发中断
+	volatile uint16_t* avail_event;	// 设备告诉驱动,avail->idx越过它之后才需要通知
+	uint16_t avail_idx;					// 驱动下一个要写入可用环的位置
+	uint16_t last_used;					// 驱动已回收到的已用环位置
+	uint16_t wait_used;					// 当前批次全部完成时used->idx的值
+	volatile bool expecting_intr;	// 是否在等待本批次完成的中断
+	virtio_blk_req* reqs;				// 各请求的头和状态,占一页
+	uint32_t reqs_phy;					// reqs的物理地址
+	uint16_t max_reqs;					// 一个批次最多的请求数
+	lock lock;									// 同一时刻只处理一个批次
+	semaphore batch_done;				// 中断处理程序在本批次全部完成后唤醒驱动
+	block_device bdev;					// 注册到块设备层的设备
+} virtio_blk;
+
+void virtio_blk_init(void);
+
+#endif
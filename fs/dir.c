@@ -0,0 +1,78 @@
+#include "dir.h"
+#include "fs.h"
+#include "inode.h"
+#include "bcache.h"
+#include "string.h"
+#include "debug.h"
+
+/**
+ * 目录的前cur_fs->sb.dir_buckets块是散列桶,文件名按fs_name_hash落入其中一块.
+ * 每块的第0个目录项位置存放fs_dir_head,桶满后在目录末尾追加溢出块,由head->next串起来.
+ * 查找只需读所在桶的块链,不必扫描整个目录
+*/
+
+/* 在目录dir中查找名为name的目录项,找到时存入de.调用者须持有dir->lock */
+bool dir_lookup(inode* dir, const char* name, fs_dirent* de) {
+	uint32_t file_blk = fs_name_hash(name) % cur_fs->sb.dir_buckets;
+	do {
+		uint32_t lba = inode_map(dir, file_blk);
+		if (lba == 0) return false;
+		buf_head* bh = bcache_read(cur_fs->bdev, lba);
+		if (bh == NULL) return false;
+		fs_dir_head* head = (fs_dir_head*)bh->data;
+		fs_dirent* ents = (fs_dirent*)bh->data;
+		uint32_t i;
+		for (i = 1; i <= FS_DIRENTS_PER_BLOCK; ++i) {
+			if (ents[i].f_type != FT_UNKNOWN && !strcmp(ents[i].name, name)) {
+				*de = ents[i];
+				bcache_release(bh);
+				return true;
+			}
+		}
+		file_blk = head->next;
+		bcache_release(bh);
+	} while (file_blk != 0);
+	return false;
+}
+
+/* 在目录dir中添加目录项,桶链已满时追加溢出块.调用者须持有dir->lock,并已确认name不存在 */
+bool dir_add(inode* dir, const char* name, uint32_t i_no, uint8_t f_type) {
+	ASSERT(strlen(name) < FS_NAME_LEN);
+	uint32_t file_blk = fs_name_hash(name) % cur_fs->sb.dir_buckets;
+	while (1) {
+		uint32_t lba = inode_map(dir, file_blk);
+		if (lba == 0) return false;
+		buf_head* bh = bcache_read(cur_fs->bdev, lba);
+		if (bh == NULL) return false;
+		fs_dir_head* head = (fs_dir_head*)bh->data;
+		fs_dirent* ents = (fs_dirent*)bh->data;
+
+		if (head->used < FS_DIRENTS_PER_BLOCK) {
+			uint32_t i = 1;
+			while (ents[i].f_type != FT_UNKNOWN) ++i;
+			memset(&ents[i], 0, sizeof(fs_dirent));
+			strcpy(ents[i].name, name);
+			ents[i].i_no = i_no;
+			ents[i].f_type = f_type;
+			++head->used;
+			bcache_dirty(bh);
+			bcache_release(bh);
+			return true;
+		}
+
+		if (head->next == 0) {
+			/* 新块由inode_grow清零,其fs_dir_head为空 */
+			uint32_t new_blk = dir->blk_cnt;
+			if (!inode_grow(dir, new_blk + 1)) {
+				bcache_release(bh);
+				return false;
+			}
+			dir->i_size = dir->blk_cnt * FS_BLOCK_SIZE;
+			inode_sync(dir);
+			head->next = new_blk;
+			bcache_dirty(bh);
+		}
+		file_blk = head->next;
+		bcache_release(bh);
+	}
+}
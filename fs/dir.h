@@ -0,0 +1,12 @@
+#ifndef __FS_DIR_H
+#define __FS_DIR_H
+
+#include "stdint.h"
+#include "global.h"
+#include "inode.h"
+#include "fs_disk.h"
+
+bool dir_lookup(inode* dir, const char* name, fs_dirent* de);
+bool dir_add(inode* dir, const char* name, uint32_t i_no, uint8_t f_type);
+
+#endif
@@ -0,0 +1,127 @@
+#include "file.h"
+#include "fs.h"
+#include "inode.h"
+#include "bcache.h"
+#include "thread.h"
+#include "interrupt.h"
+#include "string.h"
+#include "debug.h"
+
+/* 文件表,0、1、2留给标准输入输出,不使用 */
+file file_table[MAX_FILE_OPEN];
+
+/* 在file_table中找一项空闲的填入ino和flag,返回其下标,没有空闲项时返回-1 */
+int32_t get_free_slot_in_global(inode* ino, uint32_t flag) {
+	int32_t fd_idx;
+	intr_status old_status = intr_disable();
+	for (fd_idx = 3; fd_idx < MAX_FILE_OPEN; ++fd_idx) {
+		if (file_table[fd_idx].fd_inode == NULL) {
+			file_table[fd_idx].fd_inode = ino;
+			file_table[fd_idx].fd_flag = flag;
+			file_table[fd_idx].fd_pos = 0;
+			file_table[fd_idx].fd_ref = 1;
+			intr_set_status(old_status);
+			return fd_idx;
+		}
+	}
+	intr_set_status(old_status);
+	return -1;
+}
+
+/* 归还file_table中的一项 */
+void file_slot_release(int32_t global_fd_idx) {
+	file_table[global_fd_idx].fd_inode = NULL;
+}
+
+/* 释放对文件f的一个引用,最后一个引用释放时关闭inode并归还这一项 */
+void file_put(file* f) {
+	intr_status old_status = intr_disable();
+	ASSERT(f->fd_ref > 0);
+	inode* ino = --f->fd_ref == 0 ? f->fd_inode : NULL;
+	intr_set_status(old_status);
+	if (ino != NULL) {
+		inode_close(ino);
+		file_slot_release(f - file_table);
+	}
+}
+
+/* 把全局下标安装到当前任务的文件描述符表中,返回文件描述符,描述符用尽时返回-1 */
+int32_t pcb_fd_install(int32_t global_fd_idx) {
+	task_struct* cur = running_thread();
+	int32_t local_fd_idx;
+	for (local_fd_idx = 3; local_fd_idx < MAX_FILES_OPEN_PER_PROC; ++local_fd_idx) {
+		if (cur->fd_table[local_fd_idx] == -1) {
+			cur->fd_table[local_fd_idx] = global_fd_idx;
+			return local_fd_idx;
+		}
+	}
+	return -1;
+}
+
+/* 从文件f的当前位置读count个字节到buf,返回读出的字节数,已到文件末尾时返回0,出错返回-1 */
+int32_t file_read(file* f, void* buf, uint32_t count) {
+	inode* ino = f->fd_inode;
+	uint8_t* dst = buf;
+	uint32_t done = 0;
+
+	mutex_lock(&ino->lock);
+	uint32_t left = f->fd_pos >= ino->i_size ? 0 : ino->i_size - f->fd_pos;
+	if (count > left) count = left;
+	while (done < count) {
+		uint32_t offset = f->fd_pos % FS_BLOCK_SIZE;
+		uint32_t chunk = FS_BLOCK_SIZE - offset;
+		if (chunk > count - done) chunk = count - done;
+		uint32_t lba = inode_map(ino, f->fd_pos / FS_BLOCK_SIZE);
+		buf_head* bh = lba == 0 ? NULL : bcache_read(cur_fs->bdev, lba);
+		if (bh == NULL) break;
+		memcpy(dst + done, bh->data + offset, chunk);
+		bcache_release(bh);
+		done += chunk;
+		f->fd_pos += chunk;
+	}
+	mutex_unlock(&ino->lock);
+	return (done == 0 && count != 0) ? -1 : (int32_t)done;
+}
+
+/**
+ * 把buf中的count个字节写到文件f的当前位置,返回写入的字节数,出错返回-1.
+ * 需要的块一次分配好,整块覆盖的扇区不必先读盘
+*/
+int32_t file_write(file* f, const void* buf, uint32_t count) {
+	inode* ino = f->fd_inode;
+	const uint8_t* src = buf;
+	uint32_t done = 0;
+
+	mutex_lock(&ino->lock);
+	uint32_t end = f->fd_pos + count;
+	if (end < f->fd_pos) {
+		mutex_unlock(&ino->lock);
+		return -1;
+	}
+	uint32_t old_blk_cnt = ino->blk_cnt;
+	if (!inode_grow(ino, DIV_ROUND_UP(end, FS_BLOCK_SIZE))) {
+		/* 空间不足时只写已分配到的部分 */
+		end = ino->blk_cnt * FS_BLOCK_SIZE;
+		count = end > f->fd_pos ? end - f->fd_pos : 0;
+	}
+	while (done < count) {
+		uint32_t offset = f->fd_pos % FS_BLOCK_SIZE;
+		uint32_t chunk = FS_BLOCK_SIZE - offset;
+		if (chunk > count - done) chunk = count - done;
+		uint32_t lba = inode_map(ino, f->fd_pos / FS_BLOCK_SIZE);
+		ASSERT(lba != 0);
+		buf_head* bh = chunk == FS_BLOCK_SIZE ? bcache_get(cur_fs->bdev, lba) : bcache_read(cur_fs->bdev, lba);
+		if (bh == NULL) break;
+		memcpy(bh->data + offset, src + done, chunk);
+		bcache_dirty(bh);
+		bcache_release(bh);
+		done += chunk;
+		f->fd_pos += chunk;
+	}
+	if (f->fd_pos > ino->i_size || ino->blk_cnt != old_blk_cnt) {
+		if (f->fd_pos > ino->i_size) ino->i_size = f->fd_pos;
+		inode_sync(ino);
+	}
+	mutex_unlock(&ino->lock);
+	return (done == 0 && count != 0) ? -1 : (int32_t)done;
+}
@@ -0,0 +1,27 @@
+#ifndef __FS_FILE_H
+#define __FS_FILE_H
+
+#include "stdint.h"
+#include "global.h"
+#include "inode.h"
+
+/* 文件结构,每次打开文件都会在file_table中占一项 */
+typedef struct {
+	uint32_t fd_pos;							// 当前读写位置
+	uint32_t fd_flag;							// 打开时的enum oflags
+	inode* fd_inode;							// 为NULL表示空闲
+	uint32_t fd_ref;							// 引用数: 文件描述符表中的1个,加上正在使用它的读写操作
+} file;
+
+#define MAX_FILE_OPEN 32				// 系统可打开的最大文件数
+
+extern file file_table[MAX_FILE_OPEN];
+
+int32_t get_free_slot_in_global(inode* ino, uint32_t flag);
+void file_slot_release(int32_t global_fd_idx);
+void file_put(file* f);
+int32_t pcb_fd_install(int32_t global_fd_idx);
+int32_t file_read(file* f, void* buf, uint32_t count);
+int32_t file_write(file* f, const void* buf, uint32_t count);
+
+#endif
@@ -0,0 +1,352 @@
+#include "fs.h"
+#include "global.h"
+#include "stdint.h"
+#include "list.h"
+#include "bitmap.h"
+#include "sync.h"
+#include "block.h"
+#include "bcache.h"
+#include "inode.h"
+#include "dir.h"
+#include "file.h"
+#include "thread.h"
+#include "interrupt.h"
+#include "memory.h"
+#include "string.h"
+#include "debug.h"
+#include "printk.h"
+#include "console.h"
+#include "keyboard.h"
+#include "ioqueue.h"
+#include "syscall.h"
+
+filesys* cur_fs;							// 当前挂载的文件系统,未挂载时为NULL
+
+static filesys fs_mounted;
+static mutex stdin_lock;			// kbd_buf只允许一个读者,多个任务读标准输入时须排队
+
+/* 把位图中从bit_idx开始的cnt位所在的扇区写入缓存,由bflushd回写.调用者须持有cur_fs->lock */
+void bitmap_sync(uint32_t bit_idx, uint32_t cnt, uint8_t btmp_type) {
+	bitmap* btmp;
+	uint32_t base_lba;
+	if (btmp_type == INODE_BITMAP) {
+		btmp = &cur_fs->inode_bitmap;
+		base_lba = cur_fs->sb.inode_bitmap_lba;
+	} else {
+		btmp = &cur_fs->block_bitmap;
+		base_lba = cur_fs->sb.block_bitmap_lba;
+	}
+	uint32_t sec = bit_idx / FS_BITS_PER_BLOCK;
+	uint32_t sec_end = (bit_idx + cnt - 1) / FS_BITS_PER_BLOCK;
+	for (; sec <= sec_end; ++sec) {
+		buf_head* bh = bcache_get(cur_fs->bdev, base_lba + sec);
+		memcpy(bh->data, btmp->bits + sec * FS_BLOCK_SIZE, FS_BLOCK_SIZE);
+		bcache_dirty(bh);
+		bcache_release(bh);
+	}
+}
+
+/**
+ * 分配最多want个连续的块,实际分配的块数存入got,返回起始扇区号,空间用尽时返回0.
+ * 先试goal处,以便紧接着文件已有的块分配;不行再找want个连续的空闲块,
+ * 还不行就取第一个空闲块,从它往后能连续分配多少算多少
+*/
+uint32_t block_alloc(uint32_t goal, uint32_t want, uint32_t* got) {
+	bitmap* btmp = &cur_fs->block_bitmap;
+	uint32_t sec_cnt = cur_fs->sb.sec_cnt;
+	ASSERT(want > 0);
+	lock_acquire(&cur_fs->lock);
+	int32_t start = -1;
+	if (goal < sec_cnt && !bitmap_scan_test(btmp, goal)) {
+		start = goal;
+	} else if ((start = bitmap_scan(btmp, want)) == -1) {
+		start = bitmap_scan(btmp, 1);
+	}
+	if (start == -1) {
+		lock_release(&cur_fs->lock);
+		return 0;
+	}
+
+	uint32_t cnt = 0;
+	while (cnt < want && start + cnt < sec_cnt && !bitmap_scan_test(btmp, start + cnt)) {
+		bitmap_set(btmp, start + cnt, 1);
+		++cnt;
+	}
+	bitmap_sync(start, cnt, BLOCK_BITMAP);
+	lock_release(&cur_fs->lock);
+	*got = cnt;
+	return start;
+}
+
+/* 释放从lba开始的cnt个块 */
+void block_free(uint32_t lba, uint32_t cnt) {
+	uint32_t i;
+	lock_acquire(&cur_fs->lock);
+	for (i = 0; i < cnt; ++i) {
+		bitmap_set(&cur_fs->block_bitmap, lba + i, 0);
+	}
+	bitmap_sync(lba, cnt, BLOCK_BITMAP);
+	lock_release(&cur_fs->lock);
+}
+
+/* 从分区读入sects个扇区的位图 */
+static bool bitmap_load(bitmap* btmp, uint32_t lba, uint32_t sects) {
+	btmp->btmp_bytes_len = sects * FS_BLOCK_SIZE;
+	btmp->bits = get_kernel_pages(DIV_ROUND_UP(btmp->btmp_bytes_len, PG_SIZE));
+	if (btmp->bits == NULL) return false;
+	return block_read(cur_fs->bdev, lba, btmp->bits, sects);
+}
+
+/* 挂载bdev上超级块为sb的文件系统 */
+static bool fs_mount(block_device* bdev, fs_super_block* sb) {
+	cur_fs = &fs_mounted;
+	cur_fs->bdev = bdev;
+	memcpy(&cur_fs->sb, sb, sizeof(fs_super_block));
+	list_init(&cur_fs->open_inodes);
+	lock_init(&cur_fs->lock, "filesys");
+	if (!bitmap_load(&cur_fs->block_bitmap, sb->block_bitmap_lba, sb->block_bitmap_sects) ||
+		!bitmap_load(&cur_fs->inode_bitmap, sb->inode_bitmap_lba, sb->inode_bitmap_sects)) {
+		cur_fs = NULL;
+		return false;
+	}
+	return true;
+}
+
+/* 扫描各硬盘的分区表,在各块设备中找到第一个文件系统并挂载 */
+void filesys_init(void) {
+	console_put_str("filesys_init start\n");
+	inode_cache_init();
+	mutex_init(&stdin_lock);
+
+	/* 扫描中注册的分区追加在链表末尾,只扫描此前已注册的硬盘 */
+	list_elem* last = block_devices.tail.prev;
+	list_elem* pelem = block_devices.head.next;
+	while (pelem != &block_devices.tail) {
+		block_device* bdev = elem2entry(block_device, tag, pelem);
+		block_partition_scan(bdev);
+		if (pelem == last) break;
+		pelem = pelem->next;
+	}
+
+	fs_super_block* sb = get_kernel_pages(1);
+	if (sb == NULL) {
+		PANIC("filesys_init: no memory");
+	}
+	for (pelem = block_devices.head.next; pelem != &block_devices.tail; pelem = pelem->next) {
+		block_device* bdev = elem2entry(block_device, tag, pelem);
+		if (bdev->sectors <= FS_SUPER_LBA || !block_read(bdev, FS_SUPER_LBA, sb, 1)) {
+			continue;
+		}
+		if (sb->magic == FS_MAGIC && sb->sec_cnt <= bdev->sectors && sb->dir_buckets != 0) {
+			if (fs_mount(bdev, sb)) {
+				printk(LOG_INFO, "filesys: %s mounted, %d sectors, %d inodes\n", bdev->name, sb->sec_cnt, sb->inode_cnt);
+			} else {
+				printk(LOG_ERR, "filesys: can not mount %s\n", bdev->name);
+			}
+			break;
+		}
+	}
+	if (cur_fs == NULL) {
+		printk(LOG_WARN, "filesys: no filesystem found\n");
+	}
+	free_kernel_pages(sb, 1);
+	console_put_str("filesys_init done\n");
+}
+
+/**
+ * 解析绝对路径,打开最后一级所在的目录并返回,最后一级的名字存入name.
+ * 路径为"/"时name为空串.路径不合法或中间某级目录不存在时返回NULL
+*/
+static inode* path_parent(const char* pathname, char* name) {
+	if (pathname[0] != '/' || strlen(pathname) >= MAX_PATH_LEN) {
+		return NULL;
+	}
+	inode* dir = inode_open(cur_fs->sb.root_inode_no);
+	const char* p = pathname;
+	while (dir != NULL) {
+		while (*p == '/') ++p;
+		const char* end = p;
+		while (*end != 0 && *end != '/') ++end;
+		uint32_t len = end - p;
+		if (len >= FS_NAME_LEN) break;
+		memcpy(name, p, len);
+		name[len] = 0;
+		while (*end == '/') ++end;
+		if (*end == 0) {
+			return dir;
+		}
+
+		fs_dirent de;
+		mutex_lock(&dir->lock);
+		bool found = dir_lookup(dir, name, &de);
+		mutex_unlock(&dir->lock);
+		inode_close(dir);
+		if (!found || de.f_type != FT_DIRECTORY) {
+			return NULL;
+		}
+		dir = inode_open(de.i_no);
+		p = end;
+	}
+	if (dir != NULL) {
+		inode_close(dir);
+	}
+	return NULL;
+}
+
+/* 打开或创建普通文件,成功后返回文件描述符,否则返回-1 */
+int32_t sys_open(const char* pathname, uint8_t flags) {
+	if (cur_fs == NULL || !user_str_ok(pathname, MAX_PATH_LEN)) return -1;
+	char name[FS_NAME_LEN];
+	inode* parent = path_parent(pathname, name);
+	if (parent == NULL) return -1;
+
+	inode* ino = NULL;
+	fs_dirent de;
+	mutex_lock(&parent->lock);
+	if (name[0] == 0) {
+		/* 路径是"/",不能当普通文件打开 */
+	} else if (dir_lookup(parent, name, &de)) {
+		if (de.f_type == FT_REGULAR) {
+			ino = inode_open(de.i_no);
+		}
+	} else if (flags & O_CREAT) {
+		ino = inode_create(FT_REGULAR);
+		if (ino != NULL && !dir_add(parent, name, ino->i_no, FT_REGULAR)) {
+			printk(LOG_ERR, "sys_open: can not add %s to directory\n", name);
+			/* 新文件没有数据块,只需归还inode */
+			lock_acquire(&cur_fs->lock);
+			bitmap_set(&cur_fs->inode_bitmap, ino->i_no, 0);
+			bitmap_sync(ino->i_no, 1, INODE_BITMAP);
+			lock_release(&cur_fs->lock);
+			inode_close(ino);
+			ino = NULL;
+		}
+	}
+	mutex_unlock(&parent->lock);
+	inode_close(parent);
+	if (ino == NULL) return -1;
+
+	int32_t global_fd = get_free_slot_in_global(ino, flags & ~O_CREAT);
+	if (global_fd == -1) {
+		inode_close(ino);
+		return -1;
+	}
+	int32_t fd = pcb_fd_install(global_fd);
+	if (fd == -1) {
+		file_slot_release(global_fd);
+		inode_close(ino);
+	}
+	return fd;
+}
+
+/* 将任务pthread的文件描述符转化为文件表中的文件,fd不是已打开的普通文件时返回NULL */
+static file* fd2file(task_struct* pthread, int32_t fd) {
+	if (fd <= stderr_no || fd >= MAX_FILES_OPEN_PER_PROC) {
+		return NULL;
+	}
+	int32_t global_fd = pthread->fd_table[fd];
+	return global_fd == -1 ? NULL : &file_table[global_fd];
+}
+
+/**
+ * 取得任务pthread的文件描述符fd指向的文件并增加其引用,用完后须调用file_put.
+ * 引用未释放前,即使pthread关闭了fd,文件表中的这一项和inode也不会被回收
+*/
+static file* fd_get(task_struct* pthread, int32_t fd) {
+	intr_status old_status = intr_disable();
+	file* f = fd2file(pthread, fd);
+	if (f != NULL) {
+		++f->fd_ref;
+	}
+	intr_set_status(old_status);
+	return f;
+}
+
+/* 关闭文件描述符fd指向的文件,成功返回0,否则返回-1.uring的worker可能正在写此文件,由它释放最后的引用 */
+int32_t sys_close(int32_t fd) {
+	task_struct* cur = running_thread();
+	intr_status old_status = intr_disable();
+	file* f = fd2file(cur, fd);
+	if (f != NULL) {
+		cur->fd_table[fd] = -1;
+	}
+	intr_set_status(old_status);
+	if (f == NULL) return -1;
+	file_put(f);
+	return 0;
+}
+
+/* 从文件描述符fd指向的文件中读取count个字节到buf,返回读出的字节数,出错或buf不是可写的用户内存时返回-1 */
+int32_t sys_read(int32_t fd, void* buf, uint32_t count) {
+	if (!user_range_ok(buf, count, true)) return -1;
+	if (fd == stdin_no) {
+		mutex_lock(&stdin_lock);
+		uint32_t cnt = ioq_read(&kbd_buf, buf, count);
+		mutex_unlock(&stdin_lock);
+		return cnt;
+	}
+	file* f = fd2file(running_thread(), fd);
+	if (f == NULL || (f->fd_flag & 3) == O_WRONLY) {
+		return -1;
+	}
+	return file_read(f, buf, count);
+}
+
+/**
+ * 以任务pthread的身份把buf中的count个字节写到它的文件描述符fd,标准输出和标准错误都输出到终端.
+ * uring的worker代替进程执行写操作时pthread不是当前任务,pthread可能同时关闭fd,故写期间持有文件的引用
+*/
+int32_t fd_write(task_struct* pthread, int32_t fd, const void* buf, uint32_t count) {
+	if (fd == stdout_no || fd == stderr_no) {
+		console_write(buf, count);
+		return count;
+	}
+	file* f = fd_get(pthread, fd);
+	if (f == NULL) return -1;
+	int32_t ret = (f->fd_flag & 3) == O_RDONLY ? -1 : file_write(f, buf, count);
+	file_put(f);
+	return ret;
+}
+
+/* 把buf中的count个字节写到文件描述符fd,buf不是可读的用户内存时返回-1.fd_write不再检查,uring的worker事先已检查过 */
+int32_t sys_write(int32_t fd, const void* buf, uint32_t count) {
+	if (!user_range_ok(buf, count, false)) return -1;
+	return fd_write(running_thread(), fd, buf, count);
+}
+
+/* 重置文件的读写位置,新位置须在[0, 文件大小]之内,成功时返回新位置,否则返回-1 */
+int32_t sys_lseek(int32_t fd, int32_t offset, uint8_t whence) {
+	file* f = fd2file(running_thread(), fd);
+	if (f == NULL) return -1;
+	inode* ino = f->fd_inode;
+	mutex_lock(&ino->lock);
+	int32_t new_pos;
+	switch (whence) {
+		case SEEK_SET:
+			new_pos = offset;
+			break;
+		case SEEK_CUR:
+			new_pos = (int32_t)f->fd_pos + offset;
+			break;
+		case SEEK_END:
+			new_pos = (int32_t)ino->i_size + offset;
+			break;
+		default:
+			new_pos = -1;
+	}
+	if (new_pos < 0 || (uint32_t)new_pos > ino->i_size) {
+		new_pos = -1;
+	} else {
+		f->fd_pos = new_pos;
+	}
+	mutex_unlock(&ino->lock);
+	return new_pos;
+}
+
+/* 任务退出时关闭它打开的所有文件 */
+void fs_release_fds(void) {
+	int32_t fd;
+	for (fd = stderr_no + 1; fd < MAX_FILES_OPEN_PER_PROC; ++fd) {
+		sys_close(fd);
+	}
+}
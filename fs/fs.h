@@ -0,0 +1,60 @@
+#ifndef __FS_FS_H
+#define __FS_FS_H
+
+#include "stdint.h"
+#include "global.h"
+#include "list.h"
+#include "bitmap.h"
+#include "sync.h"
+#include "block.h"
+#include "fs_disk.h"
+#include "thread.h"
+
+#define MAX_PATH_LEN 512			// 路径最大长度
+
+/* 打开文件的选项 */
+enum oflags {
+	O_RDONLY,				// 只读
+	O_WRONLY,				// 只写
+	O_RDWR,					// 读写
+	O_CREAT = 4			// 创建
+};
+
+/* 文件读写位置偏移量 */
+enum whence {
+	SEEK_SET = 1,
+	SEEK_CUR,
+	SEEK_END
+};
+
+/* 位图类型 */
+enum bitmap_type {
+	INODE_BITMAP,
+	BLOCK_BITMAP
+};
+
+/* 已挂载的文件系统 */
+typedef struct {
+	block_device* bdev;						// 文件系统所在的分区
+	fs_super_block sb;						// 超级块
+	bitmap block_bitmap;					// 块位图
+	bitmap inode_bitmap;					// inode位图
+	list open_inodes;							// 本分区打开的inode
+	lock lock;										// 保护位图和open_inodes
+} filesys;
+
+extern filesys* cur_fs;
+
+void filesys_init(void);
+uint32_t block_alloc(uint32_t goal, uint32_t want, uint32_t* got);
+void block_free(uint32_t lba, uint32_t cnt);
+void bitmap_sync(uint32_t bit_idx, uint32_t cnt, uint8_t btmp_type);
+int32_t sys_open(const char* pathname, uint8_t flags);
+int32_t sys_close(int32_t fd);
+int32_t sys_read(int32_t fd, void* buf, uint32_t count);
+int32_t fd_write(task_struct* pthread, int32_t fd, const void* buf, uint32_t count);
+int32_t sys_write(int32_t fd, const void* buf, uint32_t count);
+int32_t sys_lseek(int32_t fd, int32_t offset, uint8_t whence);
+void fs_release_fds(void);
+
+#endif
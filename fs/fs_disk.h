@@ -0,0 +1,91 @@
+#ifndef __FS_FS_DISK_H
+#define __FS_FS_DISK_H
+
+#include "stdint.h"
+
+/**
+ * 文件系统在磁盘上的格式,内核和主机端的tools/mkfs.c共用,因此只依赖stdint.h.
+ * 以扇区为块,分区内依次是:
+ *   引导扇区 | 超级块 | 块位图 | inode位图 | inode表 | 数据区
+ * 文件的数据由若干extent(物理上连续的一段块)按序拼成;目录是一张哈希表,
+ * 前dir_buckets(见超级块)块是各桶的首块,桶满后在目录末尾追加溢出块并链在桶后.
+ * 以下扇区号都相对于分区起始
+*/
+#define FS_MAGIC 0x4b545845						// "EXTK"
+#define FS_BLOCK_SIZE 512
+#define FS_SUPER_LBA 1								// 超级块所在扇区,0号扇区留给引导程序
+#define FS_ROOT_INO 0									// 根目录的inode编号
+#define FS_NAME_LEN 24								// 文件名最长23个字符,含结尾的0共24字节
+#define FS_INODE_EXTENTS 12						// inode中直接存放的extent数
+#define FS_INDIRECT_EXTENTS (FS_BLOCK_SIZE / sizeof(fs_extent))	// 间接块中存放的extent数
+#define FS_MAX_EXTENTS (FS_INODE_EXTENTS + FS_INDIRECT_EXTENTS)
+#define FS_INODES_PER_BLOCK (FS_BLOCK_SIZE / sizeof(fs_inode))
+#define FS_DIR_MIN_BUCKETS 4					// 目录哈希桶数的下限,实际桶数由mkfs按inode数定出并记在超级块中
+#define FS_DIRENTS_PER_BLOCK (FS_BLOCK_SIZE / sizeof(fs_dirent) - 1)	// 每块第一个目录项的位置用作块头
+#define FS_BITS_PER_BLOCK (FS_BLOCK_SIZE * 8)
+
+/* 文件类型 */
+enum file_types {
+	FT_UNKNOWN,			// 不支持的文件类型,目录项中表示空闲
+	FT_REGULAR,			// 普通文件
+	FT_DIRECTORY		// 目录
+};
+
+/* 超级块 */
+typedef struct {
+	uint32_t magic;								// 用来标识文件系统类型
+	uint32_t sec_cnt;							// 本分区总共的扇区数
+	uint32_t inode_cnt;						// 本分区中inode数量
+	uint32_t block_bitmap_lba;		// 块位图的起始扇区,每一位对应分区中的一个扇区
+	uint32_t block_bitmap_sects;	// 块位图占用的扇区数
+	uint32_t inode_bitmap_lba;		// inode位图的起始扇区
+	uint32_t inode_bitmap_sects;	// inode位图占用的扇区数
+	uint32_t inode_table_lba;			// inode表的起始扇区
+	uint32_t inode_table_sects;		// inode表占用的扇区数
+	uint32_t data_start_lba;			// 数据区开始的第一个扇区号
+	uint32_t root_inode_no;				// 根目录所在的inode号
+	uint32_t dir_buckets;					// 目录的哈希桶数,即目录开头的桶首块数
+	uint8_t pad[464];							// 凑够512字节1扇区大小
+} __attribute__((packed)) fs_super_block;
+
+/* 一段物理上连续的块 */
+typedef struct {
+	uint32_t lba;									// 起始块号
+	uint32_t len;									// 块数
+} fs_extent;
+
+/* 磁盘上的inode,文件的第0块起依次由extents[0]、extents[1]...覆盖 */
+typedef struct {
+	uint32_t i_size;							// 文件的字节数,目录为其占用的块数乘以块大小
+	uint16_t i_type;							// enum file_types
+	uint16_t pad0;
+	uint32_t extent_cnt;					// extent总数
+	uint32_t indirect_lba;				// 存放第FS_INODE_EXTENTS个之后的extent的块,0表示没有
+	fs_extent extents[FS_INODE_EXTENTS];
+	uint8_t pad[16];							// 凑够128字节,每扇区4个inode
+} fs_inode;
+
+/* 目录项 */
+typedef struct {
+	char name[FS_NAME_LEN];
+	uint32_t i_no;
+	uint32_t f_type;							// enum file_types,为FT_UNKNOWN表示空闲
+} fs_dirent;
+
+/* 目录块的块头,占用块中第一个目录项的位置 */
+typedef struct {
+	uint32_t next;								// 桶的溢出链上下一块的文件内块号,0表示没有
+	uint32_t used;								// 本块中已用的目录项数
+	uint8_t pad[sizeof(fs_dirent) - 8];
+} fs_dir_head;
+
+/* 文件名的哈希值(FNV-1a),决定目录项落在哪个桶 */
+static inline uint32_t fs_name_hash(const char* name) {
+	uint32_t hash = 2166136261u;
+	while (*name) {
+		hash = (hash ^ (uint8_t)*name++) * 16777619u;
+	}
+	return hash;
+}
+
+#endif
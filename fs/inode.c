@@ -0,0 +1,230 @@
+#include "inode.h"
+#include "fs.h"
+#include "global.h"
+#include "stdint.h"
+#include "list.h"
+#include "sync.h"
+#include "bcache.h"
+#include "memory.h"
+#include "string.h"
+#include "debug.h"
+#include "printk.h"
+
+#define MAX_OPEN_INODES 32				// 同时打开的inode数上限
+
+static inode* inode_pool;					// i_open_cnt为0的是空闲项
+
+/* 分配存放已打开inode的内存 */
+void inode_cache_init(void) {
+	inode_pool = get_kernel_pages(DIV_ROUND_UP(sizeof(inode) * MAX_OPEN_INODES, PG_SIZE));
+	if (inode_pool == NULL) {
+		PANIC("inode_cache_init: no memory");
+	}
+}
+
+/* 算出i_no号inode在inode表中的扇区和扇区内的偏移 */
+static void inode_locate(uint32_t i_no, uint32_t* lba, uint32_t* offset) {
+	ASSERT(i_no < cur_fs->sb.inode_cnt);
+	*lba = cur_fs->sb.inode_table_lba + i_no / FS_INODES_PER_BLOCK;
+	*offset = (i_no % FS_INODES_PER_BLOCK) * sizeof(fs_inode);
+}
+
+/* list_traversal的回调函数,查找编号为i_no的inode */
+static bool inode_match(list_elem* pelem, int i_no) {
+	inode* ino = elem2entry(inode, inode_tag, pelem);
+	return ino->i_no == (uint32_t)i_no;
+}
+
+/* 从inode_pool中取一项空闲的,清零后打开计数置1并加入open_inodes.调用者须持有cur_fs->lock */
+static inode* inode_slot(uint32_t i_no) {
+	uint32_t i;
+	for (i = 0; i < MAX_OPEN_INODES; ++i) {
+		inode* ino = &inode_pool[i];
+		if (ino->i_open_cnt == 0) {
+			memset(ino, 0, sizeof(inode));
+			ino->i_no = i_no;
+			ino->i_open_cnt = 1;
+			mutex_init(&ino->lock);
+			list_append(&cur_fs->open_inodes, &ino->inode_tag);
+			return ino;
+		}
+	}
+	return NULL;
+}
+
+/* 从inode表中读入ino的内容,调用者须持有ino->lock */
+static bool inode_load(inode* ino) {
+	uint32_t lba, offset, i;
+	inode_locate(ino->i_no, &lba, &offset);
+	buf_head* bh = bcache_read(cur_fs->bdev, lba);
+	if (bh == NULL) return false;
+	fs_inode* di = (fs_inode*)(bh->data + offset);
+	ino->i_size = di->i_size;
+	ino->i_type = di->i_type;
+	ino->extent_cnt = di->extent_cnt;
+	ino->indirect_lba = di->indirect_lba;
+	memcpy(ino->extents, di->extents, sizeof(di->extents));
+	bcache_release(bh);
+
+	if (ino->extent_cnt > FS_MAX_EXTENTS) return false;
+	if (ino->extent_cnt > FS_INODE_EXTENTS) {
+		bh = bcache_read(cur_fs->bdev, ino->indirect_lba);
+		if (bh == NULL) return false;
+		memcpy(&ino->extents[FS_INODE_EXTENTS], bh->data, (ino->extent_cnt - FS_INODE_EXTENTS) * sizeof(fs_extent));
+		bcache_release(bh);
+	}
+	for (i = 0; i < ino->extent_cnt; ++i) {
+		ino->blk_cnt += ino->extents[i].len;
+	}
+	return true;
+}
+
+/* 打开i_no号inode,已打开的直接增加打开计数.打开的inode过多或读盘出错时返回NULL */
+inode* inode_open(uint32_t i_no) {
+	lock_acquire(&cur_fs->lock);
+	list_elem* pelem = list_traversal(&cur_fs->open_inodes, inode_match, i_no);
+	if (pelem != NULL) {
+		inode* ino = elem2entry(inode, inode_tag, pelem);
+		++ino->i_open_cnt;
+		lock_release(&cur_fs->lock);
+		/* 可能是别人刚打开、正在读盘的inode,等它读完 */
+		mutex_lock(&ino->lock);
+		mutex_unlock(&ino->lock);
+		return ino;
+	}
+	inode* ino = inode_slot(i_no);
+	if (ino != NULL) {
+		mutex_lock(&ino->lock);
+	}
+	lock_release(&cur_fs->lock);
+	if (ino == NULL) return NULL;
+
+	bool ok = inode_load(ino);
+	mutex_unlock(&ino->lock);
+	if (!ok) {
+		printk(LOG_ERR, "inode_open: can not load inode %d\n", i_no);
+		inode_close(ino);
+		return NULL;
+	}
+	return ino;
+}
+
+/* 新建一个类型为type的空文件,返回打开的inode.inode用尽或打开的inode过多时返回NULL */
+inode* inode_create(uint16_t type) {
+	lock_acquire(&cur_fs->lock);
+	int32_t i_no = bitmap_scan(&cur_fs->inode_bitmap, 1);
+	if (i_no == -1 || (uint32_t)i_no >= cur_fs->sb.inode_cnt) {
+		lock_release(&cur_fs->lock);
+		return NULL;
+	}
+	inode* ino = inode_slot(i_no);
+	if (ino == NULL) {
+		lock_release(&cur_fs->lock);
+		return NULL;
+	}
+	bitmap_set(&cur_fs->inode_bitmap, i_no, 1);
+	bitmap_sync(i_no, 1, INODE_BITMAP);
+	ino->i_type = type;
+	/* 与inode_open一样在放开cur_fs->lock前锁住新inode,别人打开同一inode时等它写完 */
+	mutex_lock(&ino->lock);
+	lock_release(&cur_fs->lock);
+	inode_sync(ino);
+	mutex_unlock(&ino->lock);
+	return ino;
+}
+
+/* 关闭inode,打开计数减为0时从open_inodes中摘下.inode的修改在修改时已写入缓存,这里不必回写 */
+void inode_close(inode* ino) {
+	lock_acquire(&cur_fs->lock);
+	ASSERT(ino->i_open_cnt > 0);
+	if (--ino->i_open_cnt == 0) {
+		list_remove(&ino->inode_tag);
+	}
+	lock_release(&cur_fs->lock);
+}
+
+/* 把ino写入inode表,extent多于FS_INODE_EXTENTS个时其余的写入间接块.调用者须持有ino->lock */
+void inode_sync(inode* ino) {
+	uint32_t lba, offset;
+	inode_locate(ino->i_no, &lba, &offset);
+	buf_head* bh = bcache_read(cur_fs->bdev, lba);
+	if (bh == NULL) {
+		printk(LOG_ERR, "inode_sync: can not write inode %d\n", ino->i_no);
+		return;
+	}
+	fs_inode* di = (fs_inode*)(bh->data + offset);
+	memset(di, 0, sizeof(fs_inode));
+	di->i_size = ino->i_size;
+	di->i_type = ino->i_type;
+	di->extent_cnt = ino->extent_cnt;
+	di->indirect_lba = ino->indirect_lba;
+	uint32_t direct = ino->extent_cnt < FS_INODE_EXTENTS ? ino->extent_cnt : FS_INODE_EXTENTS;
+	memcpy(di->extents, ino->extents, direct * sizeof(fs_extent));
+	bcache_dirty(bh);
+	bcache_release(bh);
+
+	if (ino->extent_cnt > FS_INODE_EXTENTS) {
+		bh = bcache_get(cur_fs->bdev, ino->indirect_lba);
+		memset(bh->data, 0, FS_BLOCK_SIZE);
+		memcpy(bh->data, &ino->extents[FS_INODE_EXTENTS], (ino->extent_cnt - FS_INODE_EXTENTS) * sizeof(fs_extent));
+		bcache_dirty(bh);
+		bcache_release(bh);
+	}
+}
+
+/* 返回文件的第file_blk块所在的扇区号,该块尚未分配时返回0.调用者须持有ino->lock */
+uint32_t inode_map(inode* ino, uint32_t file_blk) {
+	uint32_t i, base = 0;
+	for (i = 0; i < ino->extent_cnt; ++i) {
+		fs_extent* ext = &ino->extents[i];
+		if (file_blk < base + ext->len) {
+			return ext->lba + (file_blk - base);
+		}
+		base += ext->len;
+	}
+	return 0;
+}
+
+/**
+ * 为文件分配块,直到共有blk_cnt块.优先紧接着最后一个extent分配以延长它,否则新增extent.
+ * 新分配的块在缓存中清零,文件中被跳过的部分读出来是0.extent或空间用尽时返回false.
+ * 只修改内存中的inode,调用者须持有ino->lock,并在之后调用inode_sync
+*/
+bool inode_grow(inode* ino, uint32_t blk_cnt) {
+	uint32_t got, i;
+	while (ino->blk_cnt < blk_cnt) {
+		fs_extent* last = ino->extent_cnt == 0 ? NULL : &ino->extents[ino->extent_cnt - 1];
+		uint32_t goal = last == NULL ? cur_fs->sb.data_start_lba : last->lba + last->len;
+		uint32_t lba = block_alloc(goal, blk_cnt - ino->blk_cnt, &got);
+		if (lba == 0) return false;
+
+		if (last != NULL && last->lba + last->len == lba) {
+			last->len += got;
+		} else {
+			if (ino->extent_cnt == FS_MAX_EXTENTS) {
+				block_free(lba, got);
+				return false;
+			}
+			if (ino->extent_cnt == FS_INODE_EXTENTS && ino->indirect_lba == 0) {
+				uint32_t one;
+				ino->indirect_lba = block_alloc(cur_fs->sb.data_start_lba, 1, &one);
+				if (ino->indirect_lba == 0) {
+					block_free(lba, got);
+					return false;
+				}
+			}
+			ino->extents[ino->extent_cnt].lba = lba;
+			ino->extents[ino->extent_cnt].len = got;
+			++ino->extent_cnt;
+		}
+
+		for (i = 0; i < got; ++i) {
+			buf_head* bh = bcache_get(cur_fs->bdev, lba + i);
+			memset(bh->data, 0, FS_BLOCK_SIZE);
+			bcache_dirty(bh);
+			bcache_release(bh);
+		}
+		ino->blk_cnt += got;
+	}
+	return true;
+}
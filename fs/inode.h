@@ -0,0 +1,32 @@
+#ifndef __FS_INODE_H
+#define __FS_INODE_H
+
+#include "stdint.h"
+#include "global.h"
+#include "list.h"
+#include "sync.h"
+#include "fs_disk.h"
+
+/* 内存中的inode,同一文件被打开多次时共用一个 */
+typedef struct {
+	uint32_t i_no;								// inode编号
+	uint32_t i_size;							// 文件的字节数
+	uint16_t i_type;							// enum file_types
+	uint32_t i_open_cnt;					// 此文件被打开的次数
+	uint32_t blk_cnt;							// 已分配的块数,即各extent的长度之和
+	uint32_t extent_cnt;
+	uint32_t indirect_lba;				// 存放第FS_INODE_EXTENTS个之后的extent的块
+	fs_extent extents[FS_MAX_EXTENTS];
+	mutex lock;										// 保护文件内容、大小和extent
+	list_elem inode_tag;					// 挂在cur_fs->open_inodes上
+} inode;
+
+void inode_cache_init(void);
+inode* inode_open(uint32_t i_no);
+inode* inode_create(uint16_t type);
+void inode_close(inode* ino);
+void inode_sync(inode* ino);
+uint32_t inode_map(inode* ino, uint32_t file_blk);
+bool inode_grow(inode* ino, uint32_t blk_cnt);
+
+#endif
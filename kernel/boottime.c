@@ -0,0 +1,134 @@
+#include "boottime.h"
+#include "stdint.h"
+#include "global.h"
+#include "io.h"
+#include "interrupt.h"
+#include "printk.h"
+
+#define BOOT_EVENTS_MAX 48				// 时间线最多记录的阶段数
+
+/* PIT通道2,门控和输出状态在0x61端口,不产生中断,适合关中断时轮询 */
+#define PIT_CH2_PORT 0x42
+#define PIT_CONTROL_PORT 0x43
+#define PIT_GATE_PORT 0x61				// 位0为通道2的门控,位1为扬声器,位5为通道2的输出
+#define PIT_INPUT_FREQUENCY 1193180
+#define CALIBRATE_MS 10						// 用于校准tsc的时长
+#define CALIBRATE_MAX_LOOPS 10000000	// 轮询次数上限,PIT不存在时放弃校准
+
+/* 时间线上的一个阶段 */
+typedef struct {
+	const char* name;
+	uint64_t start;
+	uint64_t end;									// 为0表示尚未结束
+} boot_event;
+
+static boot_event boot_events[BOOT_EVENTS_MAX];
+static uint32_t boot_event_cnt;
+
+uint32_t tsc_mhz;
+
+static const char* loader_phase_name[BOOT_TSC_NR - 1] = {
+	"mbr: load loader",
+	"loader: memory probe, read kernel",
+	"loader: lz4 unpack",
+	"loader: page tables, copy kernel",
+	"loader: enter kernel"
+};
+
+/* 记录一个阶段的开始,返回其下标供boottime_end使用.表已满时不记录 */
+uint32_t boottime_begin(const char* name) {
+	if (boot_event_cnt == BOOT_EVENTS_MAX) return BOOT_EVENTS_MAX;
+	boot_event* ev = &boot_events[boot_event_cnt];
+	ev->name = name;
+	ev->end = 0;
+	ev->start = rdtsc();
+	return boot_event_cnt++;
+}
+
+/* 记录第idx个阶段的结束 */
+void boottime_end(uint32_t idx) {
+	if (idx < BOOT_EVENTS_MAX) {
+		boot_events[idx].end = rdtsc();
+	}
+}
+
+/**
+ * 用PIT通道2测出tsc每微秒的周期数,失败时返回0.
+ * 通道2以方式0倒数CALIBRATE_MS毫秒,计数到0时输出变高,期间tsc走过的周期数除以时长即为频率
+*/
+static uint32_t tsc_cycles_per_us(void) {
+	uint32_t latch = PIT_INPUT_FREQUENCY / (1000 / CALIBRATE_MS);
+	intr_status old_status = intr_disable();
+	outb(PIT_GATE_PORT, (inb(PIT_GATE_PORT) & ~0x02) | 0x01);	// 打开门控,关闭扬声器
+	outb(PIT_CONTROL_PORT, 0xb0);							// 通道2,先写低字节后写高字节,方式0,二进制
+	outb(PIT_CH2_PORT, (uint8_t)latch);
+	outb(PIT_CH2_PORT, (uint8_t)(latch >> 8));
+
+	uint64_t start = rdtsc();
+	uint32_t loops = 0;
+	while ((inb(PIT_GATE_PORT) & 0x20) == 0 && loops < CALIBRATE_MAX_LOOPS) {
+		++loops;
+	}
+	uint64_t end = rdtsc();
+	intr_set_status(old_status);
+	if (loops == CALIBRATE_MAX_LOOPS) return 0;
+	return div64_32(end - start, CALIBRATE_MS * 1000);
+}
+
+/* 把loader留下的时间戳转成时间线上的阶段,mbr未记录时间戳(如由其它引导程序启动)时跳过 */
+static void import_loader_stamps(void) {
+	uint64_t* stamps = (uint64_t*)BOOT_TSC_ADDR;
+	if (stamps[BOOT_TSC_MBR] == 0 || stamps[BOOT_TSC_MAIN] < stamps[BOOT_TSC_MBR]) return;
+	uint32_t i;
+	for (i = 0; i < BOOT_TSC_NR - 1 && boot_event_cnt < BOOT_EVENTS_MAX; ++i) {
+		boot_event* ev = &boot_events[boot_event_cnt++];
+		ev->name = loader_phase_name[i];
+		ev->start = stamps[i];
+		ev->end = stamps[i + 1];
+	}
+}
+
+/* 把周期数换算成微秒,未能校准时直接给出以1024个周期为单位的数值 */
+static uint32_t cycles_to_us(uint64_t cycles, uint32_t cycles_per_us) {
+	return cycles_per_us == 0 ? (uint32_t)(cycles >> 10) : div64_32(cycles, cycles_per_us);
+}
+
+/**
+ * 按开始时间排序后打印启动时间线,每行是一个阶段距时间线起点的开始时刻和耗时.
+ * printk经终端输出,串口初始化后终端的输出都镜像到COM1,主机端可直接从串口日志中取得
+*/
+void boottime_report(void) {
+	uint32_t cycles_per_us = tsc_cycles_per_us();
+	tsc_mhz = cycles_per_us;
+	import_loader_stamps();
+	if (boot_event_cnt == 0) return;
+
+	/* 阶段数很少,插入排序即可 */
+	uint32_t i, j;
+	for (i = 1; i < boot_event_cnt; ++i) {
+		boot_event ev = boot_events[i];
+		for (j = i; j > 0 && boot_events[j - 1].start > ev.start; --j) {
+			boot_events[j] = boot_events[j - 1];
+		}
+		boot_events[j] = ev;
+	}
+
+	uint64_t origin = boot_events[0].start;
+	const char* unit = cycles_per_us == 0 ? "Kcyc" : "us";
+	printk(LOG_INFO, "boottime: tsc %u MHz, %u stages\n", cycles_per_us, boot_event_cnt);
+	uint32_t kernel_sects = *(uint32_t*)BOOT_KERNEL_SECTS_ADDR;
+	if (kernel_sects != 0) {
+		printk(LOG_INFO, "boottime: loader read %u sectors of %s\n", kernel_sects,
+			*(uint32_t*)BOOT_KERNEL_FORMAT_ADDR == 1 ? "lz4 image" : "kernel.bin");
+	}
+	printk(LOG_INFO, "boottime: %10s %10s  stage (%s)\n", "start", "duration", unit);
+	for (i = 0; i < boot_event_cnt; ++i) {
+		boot_event* ev = &boot_events[i];
+		uint32_t start = cycles_to_us(ev->start - origin, cycles_per_us);
+		if (ev->end == 0) {
+			printk(LOG_INFO, "boottime: %10u %10s  %s\n", start, "-", ev->name);
+		} else {
+			printk(LOG_INFO, "boottime: %10u %10u  %s\n", start, cycles_to_us(ev->end - ev->start, cycles_per_us), ev->name);
+		}
+	}
+}
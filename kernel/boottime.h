@@ -0,0 +1,44 @@
+#ifndef __KERNEL_BOOTTIME_H
+#define __KERNEL_BOOTTIME_H
+
+#include "stdint.h"
+#include "tsc.h"
+
+/* mbr和loader把各阶段的时间戳存放在物理地址0x500起,见boot.inc中的BOOT_TSC_ADDR.低端1MB映射在0xc0000000 */
+#define BOOT_TSC_ADDR 0xc0000500
+
+/* loader读入的内核映像的扇区数和格式,见boot.inc中的BOOT_KERNEL_SECTS_ADDR */
+#define BOOT_KERNEL_SECTS_ADDR 0xc0000540
+#define BOOT_KERNEL_FORMAT_ADDR 0xc0000544
+
+/* 启动各阶段时间戳的下标,前五项须与boot.inc一致 */
+enum boot_stamp {
+	BOOT_TSC_MBR,						// mbr开始执行
+	BOOT_TSC_LOADER,				// loader开始执行
+	BOOT_TSC_KERNEL_READ,		// 内核映像已读入内存
+	BOOT_TSC_KERNEL_UNPACK,	// 压缩映像已解压为kernel.bin
+	BOOT_TSC_KERNEL_COPY,		// 内核各段已复制到位,即将进入内核
+	BOOT_TSC_MAIN,					// 进入main
+	BOOT_TSC_NR
+};
+
+/* 记录第idx项启动时间戳 */
+static inline void boot_stamp(enum boot_stamp idx) {
+	((uint64_t*)BOOT_TSC_ADDR)[idx] = rdtsc();
+}
+
+/* boottime_report中校准出的tsc频率,单位MHz,未能校准时为0 */
+extern uint32_t tsc_mhz;
+
+uint32_t boottime_begin(const char* name);
+void boottime_end(uint32_t idx);
+void boottime_report(void);
+
+/* 执行初始化函数调用call,并把它的起止时间记入启动时间线,名称即调用的源码文本 */
+#define BOOT_STAGE(call) do {											\
+	uint32_t __boot_idx = boottime_begin(#call);		\
+	call;																						\
+	boottime_end(__boot_idx);												\
+} while (0)
+
+#endif
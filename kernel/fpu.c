@@ -0,0 +1,137 @@
+#include "fpu.h"
+#include "global.h"
+#include "stdint.h"
+#include "interrupt.h"
+#include "thread.h"
+#include "print.h"
+
+/* cr0中与fpu有关的位 */
+#define CR0_MP (1 << 1)						// 监控协处理器,配合TS位使wait/fwait指令也能触发#NM
+#define CR0_EM (1 << 2)						// 为1时所有fpu指令都触发#NM,即用软件模拟fpu,必须清0
+#define CR0_TS (1 << 3)						// 任务切换位,为1时首条fpu/sse指令触发#NM
+#define CR0_NE (1 << 5)						// fpu错误以#MF异常形式报告,而不是走外部中断IRQ13
+
+/* cr4中与sse有关的位 */
+#define CR4_OSFXSR (1 << 9)				// 操作系统支持fxsave/fxrstor,开启后才能使用sse指令
+#define CR4_OSXMMEXCPT (1 << 10)	// 操作系统能处理#XF(SIMD浮点异常)
+
+/* cpuid 1号功能返回的edx中的特性位 */
+#define CPUID_FXSR (1 << 24)
+#define CPUID_SSE (1 << 25)
+
+#define MXCSR_DEFAULT 0x1f80			// mxcsr的复位值,屏蔽所有sse浮点异常
+
+/**
+ * 惰性切换: fpu寄存器中始终是fpu_owner的上下文.
+ * 任务切换时只置cr0.TS,不保存也不恢复fpu,
+ * 直到新任务真正执行fpu/sse指令触发#NM时,才把fpu_owner的上下文存回它的pcb,
+ * 再装入当前任务的上下文.从不使用fpu的任务不会有任何额外开销
+*/
+static task_struct* fpu_owner;		// 当前fpu寄存器中保存的是哪个任务的上下文
+static bool has_fxsr;							// cpu是否支持fxsave/fxrstor
+static bool has_sse;							// cpu是否支持sse
+
+static inline uint32_t read_cr0(void) {
+	uint32_t cr0;
+	asm volatile ("movl %%cr0, %0" : "=r" (cr0));
+	return cr0;
+}
+
+static inline void write_cr0(uint32_t cr0) {
+	asm volatile ("movl %0, %%cr0" : : "r" (cr0));
+}
+
+/* 清除cr0.TS,之后的fpu指令不再触发#NM */
+static inline void clts(void) {
+	asm volatile ("clts");
+}
+
+/* 置cr0.TS,之后的首条fpu指令将触发#NM */
+static inline void stts(void) {
+	write_cr0(read_cr0() | CR0_TS);
+}
+
+/* 将fpu/sse上下文保存到pthread的pcb中 */
+static void fpu_save(task_struct* pthread) {
+	if (has_fxsr) {
+		asm volatile ("fxsave (%0)" : : "r" (pthread->fpu_state) : "memory");
+	} else {
+		asm volatile ("fnsave (%0)" : : "r" (pthread->fpu_state) : "memory");
+	}
+}
+
+/* 从pthread的pcb中恢复fpu/sse上下文 */
+static void fpu_restore(task_struct* pthread) {
+	if (has_fxsr) {
+		asm volatile ("fxrstor (%0)" : : "r" (pthread->fpu_state) : "memory");
+	} else {
+		asm volatile ("frstor (%0)" : : "r" (pthread->fpu_state) : "memory");
+	}
+}
+
+/* 为首次使用fpu的任务准备一个干净的fpu/sse环境 */
+static void fpu_reset(void) {
+	asm volatile ("fninit");
+	if (has_sse) {
+		uint32_t mxcsr = MXCSR_DEFAULT;
+		asm volatile ("ldmxcsr %0" : : "m" (mxcsr));
+	}
+}
+
+/* #NM(Device Not Available)异常处理程序,在这里完成fpu上下文的惰性切换 */
+static void intr_nm_handler(void) {
+	task_struct* cur = running_thread();
+	clts();
+	if (fpu_owner == cur) return;
+
+	if (fpu_owner != NULL) {
+		fpu_save(fpu_owner);
+	}
+
+	if (cur->fpu_used) {
+		fpu_restore(cur);
+	} else {
+		fpu_reset();
+		cur->fpu_used = true;
+	}
+	fpu_owner = cur;
+}
+
+/* 任务切换时调用:若next的上下文已在fpu中就不必再触发#NM,否则置TS */
+void fpu_switch(task_struct* next) {
+	if (next == fpu_owner) {
+		clts();
+	} else {
+		stts();
+	}
+}
+
+/* 任务退出时调用,fpu中若是它的上下文就作废,以免下次#NM时往已释放的pcb中保存 */
+void fpu_release(task_struct* pthread) {
+	if (fpu_owner == pthread) {
+		fpu_owner = NULL;
+	}
+}
+
+/* 初始化fpu/sse */
+void fpu_init(void) {
+	put_str("fpu_init start\n");
+	uint32_t eax = 1, ebx, ecx, edx;
+	asm volatile ("cpuid" : "+a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx));
+	has_fxsr = (edx & CPUID_FXSR) != 0;
+	has_sse = has_fxsr && (edx & CPUID_SSE) != 0;
+
+	write_cr0((read_cr0() & ~CR0_EM) | CR0_MP | CR0_NE);
+	if (has_sse) {
+		uint32_t cr4;
+		asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+		cr4 |= CR4_OSFXSR | CR4_OSXMMEXCPT;
+		asm volatile ("movl %0, %%cr4" : : "r" (cr4));
+	}
+	fpu_reset();
+
+	fpu_owner = NULL;
+	register_handler(0x07, intr_nm_handler);
+	stts();							// 此后谁先用fpu,谁就在#NM中得到它
+	put_str("fpu_init done\n");
+}
@@ -0,0 +1,10 @@
+#ifndef __KERNEL_FPU_H
+#define __KERNEL_FPU_H
+
+#include "thread.h"
+
+void fpu_init(void);
+void fpu_switch(task_struct* next);
+void fpu_release(task_struct* pthread);
+
+#endif
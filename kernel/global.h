@@ -8,6 +8,7 @@ typedef int bool;
 #define false 0
 #define PG_SIZE 4096
 #define DIV_ROUND_UP(X, STEP) ((X + STEP - 1) / (STEP))
+#define UNUSED __attribute__ ((unused))
 
 /*-------------- GDT描述符属性 ------------*/
 #define DESC_G_4K 1
@@ -43,11 +44,18 @@ typedef int bool;
 #define SELECTOR_K_DATA ((2 << 3) + (TI_GDT << 2) + RPL0)
 #define SELECTOR_K_STACK SELECTOR_K_DATA
 #define SELECTOR_K_GS ((3 << 3) + (TI_GDT << 2) + RPL0)	// 第3个段描述符是显存,第4个是tss
-#define SELECTOR_U_CODE ((5 << 3) + (TI_GDT << 2) + RPL3)
-#define SELECTOR_U_DATA ((6 << 3) + (TI_GDT << 2) + RPL3)
+/**
+ * sysenter/sysexit要求四个描述符依次为0级代码段、0级栈段、3级代码段、3级栈段,
+ * 第1、2个描述符之后是显存和tss,因此在第5、6个位置另放一份0级代码段和数据段,用户段紧随其后
+*/
+#define SELECTOR_K_CODE_SYSENTER ((5 << 3) + (TI_GDT << 2) + RPL0)
+#define SELECTOR_U_CODE ((7 << 3) + (TI_GDT << 2) + RPL3)
+#define SELECTOR_U_DATA ((8 << 3) + (TI_GDT << 2) + RPL3)
 #define SELECTOR_U_STACK SELECTOR_U_DATA
 
 #define GDT_ATTR_HIGH ((DESC_G_4K << 7) + (DESC_D_32 << 6) + (DESC_L << 5) + (DESC_AVL << 4))
+#define GDT_CODE_ATTR_LOW_DPL0 ((DESC_P << 7) + (DESC_DPL_0 << 5) + (DESC_S_CODE << 4) + DESC_TYPE_CODE)
+#define GDT_DATA_ATTR_LOW_DPL0 ((DESC_P << 7) + (DESC_DPL_0 << 5) + (DESC_S_DATA << 4) + DESC_TYPE_DATA)
 #define GDT_CODE_ATTR_LOW_DPL3 ((DESC_P << 7) + (DESC_DPL_3 << 5) + (DESC_S_CODE << 4) + DESC_TYPE_CODE)
 #define GDT_DATA_ATTR_LOW_DPL3 ((DESC_P << 7) + (DESC_DPL_3 << 5) + (DESC_S_DATA << 4) + DESC_TYPE_DATA)
 
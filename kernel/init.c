@@ -8,16 +8,47 @@
 #include "keyboard.h"
 #include "tss.h"
 #include "syscall-init.h"
+#include "fpu.h"
+#include "futex.h"
+#include "serial.h"
+#include "printk.h"
+#include "softirq.h"
+#include "block.h"
+#include "pci.h"
+#include "ide.h"
+#include "virtio_blk.h"
+#include "bcache.h"
+#include "fs.h"
+#include "uring.h"
+#include "boottime.h"
 
-/*负责初始化所有模块*/
+/**
+ * 负责初始化所有模块.
+ * 每个阶段都经BOOT_STAGE记入启动时间线,最后连同mbr和loader的各阶段一起打印
+*/
 void init_all(void) {
+	uint32_t all_idx = boottime_begin("init_all");
 	put_str("init_all\n");
-	idt_init();										// 初始化中断
-	mem_init();	  								// 初始化内存管理系统
-	thread_init();								// 初始化线程相关结构
-	timer_init();									// 初始化PIT
-	console_init();								// 控制台初始化最好放在开中断之前
-	keyboard_init(); 							// 键盘初始化
-	tss_init();       						// tss初始化
-	syscall_init();   // 初始化系统调用
-}
\ No newline at end of file
+	BOOT_STAGE(idt_init());						// 初始化中断
+	BOOT_STAGE(mem_init());						// 初始化内存管理系统
+	BOOT_STAGE(thread_init());				// 初始化线程相关结构
+	BOOT_STAGE(fpu_init());						// 初始化fpu/sse,开启惰性切换
+	BOOT_STAGE(futex_init());					// 初始化futex哈希表
+	BOOT_STAGE(softirq_init());				// 初始化软中断和tasklet,启动ksoftirqd
+	BOOT_STAGE(timer_init());					// 初始化PIT
+	BOOT_STAGE(keyboard_init());			// 键盘初始化
+	BOOT_STAGE(tss_init());						// tss初始化
+	BOOT_STAGE(syscall_init());				// 初始化系统调用
+	BOOT_STAGE(uring_init());					// 初始化异步系统调用环,启动worker
+	BOOT_STAGE(block_init());					// 初始化块设备层
+	BOOT_STAGE(pci_init());						// 枚举pci设备,之后的驱动从登记表中查找设备
+	BOOT_STAGE(ide_init());						// 探测ide硬盘并注册为块设备
+	BOOT_STAGE(virtio_blk_init());		// 初始化virtio-blk设备并注册为块设备
+	BOOT_STAGE(bcache_init());				// 初始化缓冲区缓存,启动回写线程
+	BOOT_STAGE(serial_init());				// 串口初始化,之后终端的输出都会镜像到COM1
+	BOOT_STAGE(console_init());				// 接管之前直接写显存的输出,此后不能再用put_str
+	BOOT_STAGE(printk_init());				// 启动klogd,此后printk的日志异步输出到终端
+	BOOT_STAGE(filesys_init());				// 扫描分区并挂载文件系统,需等待磁盘中断,放在最后
+	boottime_end(all_idx);
+	boottime_report();								// 打印启动时间线
+}
@@ -52,9 +52,9 @@ static void pic_init(void) {
 	// outb(PIC_M_DATA, 0xfe);
 	// outb(PIC_S_DATA, 0xff);
 
-	// 测试键盘,只打开键盘中断,其他全部关闭
-	outb(PIC_M_DATA, 0xfc);
-	outb(PIC_S_DATA, 0xff);
+	// 打开主片上的时钟、键盘、级联从片(IR2)和串口1(IR4)中断,以及从片上两个ide通道(IRQ14、IRQ15)的中断,其他全部关闭
+	outb(PIC_M_DATA, 0xe8);
+	outb(PIC_S_DATA, 0x3f);
 
 	put_str("    pic_init done\n");
 }
@@ -148,14 +148,14 @@ static void exception_init(void) {
 /*开中断并返回开中断前的状态*/
 intr_status intr_enable(void) {
 	if (intr_get_status() == INTR_ON) return INTR_ON;
-	asm volatile("sti");				// 开中断,sti指令将IF位置1
+	asm volatile("sti" : : : "memory");				// 开中断,sti指令将IF位置1. memory使编译器不把临界区内的访存移到开关中断之外
 	return INTR_OFF;
 }
 
 /*关中断,并且返回关中断前的状态*/
 intr_status intr_disable(void) {
 	if (intr_get_status() == INTR_OFF) return INTR_OFF;
-	asm volatile("cli");				// 关中断,cli指令将IF位置0
+	asm volatile("cli" : : : "memory");				// 关中断,cli指令将IF位置0
 	return INTR_ON;
 }
 
@@ -171,6 +171,18 @@ intr_status intr_get_status(void) {
 	return (EFLAGS_IF & eflags) ? INTR_ON : INTR_OFF;
 }
 
+/* 打开8259A上IRQ irq_no的屏蔽位,供pic_init之后才知道IRQ号的设备(如PCI设备)使用 */
+void pic_irq_unmask(uint8_t irq_no) {
+	intr_status old_status = intr_disable();
+	if (irq_no < 8) {
+		outb(PIC_M_DATA, inb(PIC_M_DATA) & ~(1 << irq_no));
+	} else {
+		outb(PIC_S_DATA, inb(PIC_S_DATA) & ~(1 << (irq_no - 8)));
+		outb(PIC_M_DATA, inb(PIC_M_DATA) & ~(1 << 2));	// 从片接在主片的IR2上
+	}
+	intr_set_status(old_status);
+}
+
 /* 在中断处理程序数组第vector_no个元素中注册安装中断处理程序function */
 void register_handler(uint8_t vector_no, intr_handler function) {
 	idt_table[vector_no] = function;
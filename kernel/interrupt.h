@@ -21,4 +21,5 @@ intr_status intr_set_status(intr_status);
 intr_status intr_enable(void);
 intr_status intr_disable(void);
 void register_handler(uint8_t vector_no, intr_handler function);
+void pic_irq_unmask(uint8_t irq_no);
 #endif
\ No newline at end of file
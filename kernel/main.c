@@ -6,19 +6,47 @@
 #include "process.h"
 #include "syscall-init.h"
 #include "syscall.h"
+#include "boottime.h"
+#include "printk.h"
+#include "string.h"
+#include "wait_exit.h"
+#include "stdio.h"
+#include "uring.h"
+#include "sync.h"
+#include "timer.h"
+#include "block.h"
+#include "memory.h"
+#include "ioqueue.h"
 
 void k_thread_a(void*);
 void k_thread_b(void*);
 void u_prog_a(void);
 void u_prog_b(void);
+void u_uring_bench(void);
+static void bench_format(char* buf, uint32_t size, const char* name, uint32_t ops, uint64_t cycles);
+static void bench_report(const char* name, uint32_t ops, uint64_t cycles);
+static void u_bench_report(const char* name, uint32_t ops, uint64_t cycles);
+static void console_bench(void);
+static void format_bench(void);
+static void pi_test(void);
+static void sched_bench(void);
+static void ioq_bench(void);
+static void sync_bench(void);
+static void block_bench(void);
+static void bench_run(void);
 int prog_a_pid = 0, prog_b_pid = 0;
 
 int main(void) {
+   boot_stamp(BOOT_TSC_MAIN);
    put_str("I am kernel\n");
    init_all();
+   console_bench();
+   pi_test();
+   bench_run();
 
    process_execute(u_prog_a, "user_prog_a");
    process_execute(u_prog_b, "user_prog_b");
+   process_execute(u_uring_bench, "uring_bench");
 
    intr_enable();
    console_put_str(" main_pid:0x");
@@ -26,7 +54,11 @@ int main(void) {
    console_put_char('\n');
    thread_start("k_thread_a", 31, k_thread_a, "argA ");
    thread_start("k_thread_b", 31, k_thread_b, "argB ");
-   while(1);
+
+   /* main_thread充当init: 回收结束的内核线程和过继来的孤儿进程,没有可回收的就在sys_wait中阻塞 */
+   while(1) {
+      sys_wait(NULL);
+   }
    return 0;
 }
 
@@ -54,9 +86,22 @@ void k_thread_b(void* arg) {
    while(1);
 }
 
-/* 测试用户进程 */
+#define GETPID_BENCH_OPS 10000
+
+/* 测试用户进程,先比较经sysenter和经int 0x80调用getpid的开销 */
 void u_prog_a(void) {
    prog_a_pid = getpid();
+   uint32_t i;
+   uint64_t start = rdtsc();
+   for (i = 0; i < GETPID_BENCH_OPS; ++i) {
+      getpid();
+   }
+   u_bench_report(sysenter_enabled ? "getpid sysenter" : "getpid (no sysenter)", GETPID_BENCH_OPS, rdtsc() - start);
+   start = rdtsc();
+   for (i = 0; i < GETPID_BENCH_OPS; ++i) {
+      getpid_int80();
+   }
+   u_bench_report("getpid int 0x80", GETPID_BENCH_OPS, rdtsc() - start);
    while(1);
 }
 
@@ -65,3 +110,501 @@ void u_prog_b(void) {
    prog_b_pid = getpid();
    while(1);
 }
+
+/* 格式化一项测量结果: 总次数、平均每次的周期数,tsc已校准时再换算成每秒的次数 */
+static void bench_format(char* buf, uint32_t size, const char* name, uint32_t ops, uint64_t cycles) {
+   uint32_t per_op = ops == 0 ? 0 : div64_32(cycles, ops);
+   if (tsc_mhz == 0 || cycles == 0) {
+      snprintf(buf, size, "bench: %s: %u ops, %u cycles/op\n", name, ops, per_op);
+      return;
+   }
+   /* 每秒次数 = ops * 每秒周期数 / cycles,周期数超过32位时先一起缩小 */
+   uint32_t scaled_ops = ops;
+   while (cycles >> 32) {
+      cycles >>= 1;
+      scaled_ops >>= 1;
+   }
+   uint32_t per_sec = div64_32((uint64_t)scaled_ops * tsc_mhz * 1000000, (uint32_t)cycles);
+   snprintf(buf, size, "bench: %s: %u ops, %u cycles/op, %u ops/s\n", name, ops, per_op, per_sec);
+}
+
+/* 在内核中打印一项测量结果 */
+static void bench_report(const char* name, uint32_t ops, uint64_t cycles) {
+   char buf[96];
+   bench_format(buf, sizeof(buf), name, ops, cycles);
+   printk(LOG_INFO, "%s", buf);
+}
+
+/* 在用户进程中打印一项测量结果,tsc_mhz所在的内核页对用户进程可见 */
+static void u_bench_report(const char* name, uint32_t ops, uint64_t cycles) {
+   char buf[96];
+   bench_format(buf, sizeof(buf), name, ops, cycles);
+   printf("%s", buf);
+}
+
+#define CON_BENCH_LINES 100
+
+/**
+ * 终端输出吞吐量: 连续输出CON_BENCH_LINES行,每行80个字符,每行都会滚屏.
+ * 经console_write测量,即真实的输出路径;此时尚未开中断,串口放不下的字节直接丢弃,
+ * 测得的主要是写shadow和刷新显存的开销
+*/
+static void console_bench(void) {
+   char line[80];
+   memset(line, '.', sizeof(line) - 1);
+   line[sizeof(line) - 1] = '\n';
+   uint32_t i;
+   uint64_t start = rdtsc();
+   for (i = 0; i < CON_BENCH_LINES; ++i) {
+      console_write(line, sizeof(line));
+   }
+   bench_report("console chars", CON_BENCH_LINES * sizeof(line), rdtsc() - start);
+}
+
+#define FORMAT_BENCH_OPS 10000
+
+static void null_sink(void* ctx UNUSED, const char* buf UNUSED, uint32_t len UNUSED) {
+}
+
+/* 只格式化不输出,测的是vformat本身 */
+static uint32_t null_format(const char* format, ...) {
+   va_list args;
+   va_start(args, format);
+   uint32_t len = vformat(null_sink, NULL, format, args);
+   va_end(args);
+   return len;
+}
+
+/**
+ * 格式化的吞吐量: 同一行含字符串、十进制、十六进制、宽度和精度的格式,
+ * 分别经snprintf写入缓冲区和经vformat交给丢弃输出的sink,测每次调用的周期数.
+ * 两者之差即缓冲区sink的拷贝开销
+*/
+static void format_bench(void) {
+   char buf[96];
+   uint32_t i;
+   uint64_t start = rdtsc();
+   for (i = 0; i < FORMAT_BENCH_OPS; ++i) {
+      snprintf(buf, sizeof(buf), "bench: %s: %u ops, %8x %-6d|%.3s\n", "format", i, i * 2654435761u, -(int32_t)i, "abcdef");
+   }
+   bench_report("snprintf", FORMAT_BENCH_OPS, rdtsc() - start);
+
+   start = rdtsc();
+   for (i = 0; i < FORMAT_BENCH_OPS; ++i) {
+      null_format("bench: %s: %u ops, %8x %-6d|%.3s\n", "format", i, i * 2654435761u, -(int32_t)i, "abcdef");
+   }
+   bench_report("vformat, null sink", FORMAT_BENCH_OPS, rdtsc() - start);
+}
+
+#define PI_PRIO_LOW 40
+#define PI_PRIO_MEDIUM 50
+#define PI_PRIO_HIGH 60					// 优先级决定时间片的长短,以及就绪时能否抢占正在运行的线程
+#define PI_HOLD_TICKS 5					// 低优先级线程在临界区内需要自身运行的嘀嗒数
+#define PI_SPIN_TICKS 100				// 中优先级线程空转的嘀嗒数
+
+static lock pi_lock;
+static mutex pi_mutex;
+static bool pi_inherit;					// true时用带优先级继承的lock,false时用不继承的mutex作对照
+static uint32_t pi_wait_ticks;		// 高优先级线程等锁的嘀嗒数
+static semaphore pi_done;				// 高、中优先级线程结束时各up一次
+
+static void pi_acquire(void) {
+   if (pi_inherit) lock_acquire(&pi_lock); else mutex_lock(&pi_mutex);
+}
+
+static void pi_release(void) {
+   if (pi_inherit) lock_release(&pi_lock); else mutex_unlock(&pi_mutex);
+}
+
+/* 高优先级线程: 等低优先级线程持有的锁 */
+static void pi_high(void* arg UNUSED) {
+   uint32_t start = ticks;
+   pi_acquire();
+   pi_wait_ticks = ticks - start;
+   pi_release();
+   sema_up(&pi_done);
+}
+
+/* 中优先级线程: 与锁无关,只空转PI_SPIN_TICKS个嘀嗒 */
+static void pi_medium(void* arg UNUSED) {
+   uint32_t start = ticks;
+   while (ticks - start < PI_SPIN_TICKS) {
+      asm volatile ("" : : : "memory");
+   }
+   sema_up(&pi_done);
+}
+
+/**
+ * 低优先级线程: 持锁后先让高优先级线程来等锁,再启动中优先级线程,然后做完临界区内的工作.
+ * 有继承时它已被提升到PI_PRIO_HIGH,中优先级线程抢不走cpu;
+ * 没有继承时中优先级线程排在就绪队列末尾与它轮转,至多多占一个时间片,不会把它饿死
+*/
+static void pi_low(void* arg UNUSED) {
+   pi_acquire();
+   thread_start("pi_high", PI_PRIO_HIGH, pi_high, NULL);
+   thread_yield();					// 就绪队列先进先出,让出一轮,保证高优先级线程已在等锁
+   thread_start("pi_medium", PI_PRIO_MEDIUM, pi_medium, NULL);
+   thread_preempt();
+   task_struct* cur = running_thread();
+   uint32_t start = cur->elapsed_ticks;
+   while (cur->elapsed_ticks - start < PI_HOLD_TICKS) {
+      asm volatile ("" : : : "memory");
+   }
+   pi_release();
+}
+
+/* 跑一轮优先级反转的场景,返回高优先级线程等锁的嘀嗒数 */
+static uint32_t pi_round(bool inherit) {
+   pi_inherit = inherit;
+   thread_start("pi_low", PI_PRIO_LOW, pi_low, NULL);
+   sema_down(&pi_done);
+   sema_down(&pi_done);
+   printk(LOG_INFO, "pi: %s: high waited %u ticks (holder needs %u, medium spins %u)\n",
+      inherit ? "lock with inheritance" : "mutex without inheritance", pi_wait_ticks, PI_HOLD_TICKS, PI_SPIN_TICKS);
+   return pi_wait_ticks;
+}
+
+/**
+ * 优先级反转的复现: 低优先级线程持锁,高优先级线程等锁,中优先级线程空转.
+ * 就绪队列先进先出,不继承时中优先级线程至多把高优先级线程的等待拉长一个时间片(PI_PRIO_MEDIUM个嘀嗒);
+ * 继承时只等低优先级线程做完临界区,与中优先级线程无关
+*/
+static void pi_test(void) {
+   lock_init(&pi_lock, "pi_test");
+   mutex_init(&pi_mutex);
+   sema_init(&pi_done, 0);
+   pi_round(false);
+   if (pi_round(true) < PI_PRIO_MEDIUM) {
+      printk(LOG_INFO, "pi: inversion bounded by the holder's critical section\n");
+   } else {
+      printk(LOG_WARN, "pi: inversion not bounded\n");
+   }
+}
+
+#define BENCH_PRIO 40							// 时间片比klogd等优先级31的后台线程长,测量中少受轮转打断
+
+static void bench_thread(void* arg UNUSED) {
+   format_bench();
+   sched_bench();
+   ioq_bench();
+   sync_bench();
+   block_bench();
+   /* 回收测量中启动的线程,它们此时都已退出 */
+   while (sys_wait(NULL) != -1);
+}
+
+/* 在优先级为BENCH_PRIO的线程中运行内核中的各项测量,等它退出再返回,途中一并回收pi_test留下的线程 */
+static void bench_run(void) {
+   pid_t pid = thread_start("bench", BENCH_PRIO, bench_thread, NULL)->pid;
+   while (sys_wait(NULL) != pid);
+}
+
+#define SCHED_BENCH_YIELDS 10000		// 每个让出线程调用thread_yield的次数
+#define SCHED_BENCH_SPAWNS 200			// 启动并回收的空线程数
+
+/* 与另一个同优先级的线程轮流上cpu,每次thread_yield都切换到对方 */
+static void sched_bench_yielder(void* arg UNUSED) {
+   uint32_t i;
+   for (i = 0; i < SCHED_BENCH_YIELDS; ++i) {
+      thread_yield();
+   }
+}
+
+static void sched_bench_empty(void* arg UNUSED) {
+}
+
+/**
+ * 调度器的吞吐量: 两个优先级为BENCH_PRIO的线程互相thread_yield,测每次切换的周期数;
+ * 再测启动一个空线程到它退出并被sys_wait回收的周期数,含pcb和pid的分配与释放.
+ * ASSERT所在的schedule、thread_start、thread_unblock都在路径上,release与默认构建的差别在此体现
+*/
+static void sched_bench(void) {
+   uint64_t start = rdtsc();
+   thread_start("yield_a", BENCH_PRIO, sched_bench_yielder, NULL);
+   thread_start("yield_b", BENCH_PRIO, sched_bench_yielder, NULL);
+   sys_wait(NULL);
+   sys_wait(NULL);
+   bench_report("thread_yield switch", 2 * SCHED_BENCH_YIELDS, rdtsc() - start);
+
+   uint32_t i;
+   start = rdtsc();
+   for (i = 0; i < SCHED_BENCH_SPAWNS; ++i) {
+      thread_start("spawn", BENCH_PRIO, sched_bench_empty, NULL);
+      sys_wait(NULL);
+   }
+   bench_report("thread start/exit/wait", SCHED_BENCH_SPAWNS, rdtsc() - start);
+}
+
+#define IOQ_BENCH_BYTES (256 * 1024)	// 批量收发的字节数
+#define IOQ_BENCH_SIZE 4096					// 批量收发时的环大小
+#define IOQ_BENCH_BATCH 512					// 生产者每次ioq_write的字节数
+#define IOQ_BENCH_CHAR_BYTES (16 * 1024)	// 逐字节收发的字节数,慢得多,故少一些
+#define IOQ_BENCH_CHAR_SIZE 64				// 逐字节收发时的环大小,即原先固定的缓冲区大小
+
+static ioqueue ioq_bench_q;
+static char ioq_bench_ring[IOQ_BENCH_SIZE];
+static char ioq_bench_data[IOQ_BENCH_BATCH];	// 生产者写出和消费者读入都用它,内容无关紧要
+static bool ioq_bench_bulk;
+
+/* 生产者线程: 批量时每次写IOQ_BENCH_BATCH字节,否则像原先的调用者那样关中断逐字节ioq_putchar */
+static void ioq_bench_producer(void* arg UNUSED) {
+   uint32_t sent;
+   if (ioq_bench_bulk) {
+      for (sent = 0; sent < IOQ_BENCH_BYTES; sent += IOQ_BENCH_BATCH) {
+         ioq_write(&ioq_bench_q, ioq_bench_data, IOQ_BENCH_BATCH);
+      }
+      return;
+   }
+   for (sent = 0; sent < IOQ_BENCH_CHAR_BYTES; ++sent) {
+      intr_status old_status = intr_disable();
+      ioq_putchar(&ioq_bench_q, 'x');
+      intr_set_status(old_status);
+   }
+}
+
+/* 启动生产者,由当前线程作消费者收完全部字节,返回所用周期数 */
+static uint64_t ioq_bench_run(bool bulk) {
+   ioq_bench_bulk = bulk;
+   uint32_t total = bulk ? IOQ_BENCH_BYTES : IOQ_BENCH_CHAR_BYTES;
+   ioqueue_init(&ioq_bench_q, ioq_bench_ring, bulk ? IOQ_BENCH_SIZE : IOQ_BENCH_CHAR_SIZE);
+   uint32_t received = 0;
+   uint64_t start = rdtsc();
+   thread_start("ioq_producer", BENCH_PRIO, ioq_bench_producer, NULL);
+   while (received < total) {
+      if (bulk) {
+         received += ioq_read(&ioq_bench_q, ioq_bench_data, IOQ_BENCH_BATCH);
+      } else {
+         intr_status old_status = intr_disable();
+         ioq_getchar(&ioq_bench_q);
+         intr_set_status(old_status);
+         ++received;
+      }
+   }
+   uint64_t cycles = rdtsc() - start;
+   sys_wait(NULL);
+   return cycles;
+}
+
+/**
+ * ioqueue在两个内核线程间的吞吐量,结果中的ops即字节数,ops/s即字节每秒.
+ * 逐字节一项按原先的用法: 64字节的环,每个字节调用一次ioq_putchar/ioq_getchar,调用前后关开中断;
+ * 批量一项用4KB的环和每次512字节的ioq_write/ioq_read
+*/
+static void ioq_bench(void) {
+   bench_report("ioq bytes, per-char 64B ring", IOQ_BENCH_CHAR_BYTES, ioq_bench_run(false));
+   bench_report("ioq bytes, bulk 512B 4KB ring", IOQ_BENCH_BYTES, ioq_bench_run(true));
+}
+
+#define SYNC_BENCH_OPS 10000
+#define RW_BENCH_MAX_READERS 4
+#define RW_BENCH_ROUNDS 5
+#define RW_BENCH_HOLD_MS 50				// 每次在临界区内睡眠的毫秒数,模拟持锁期间的阻塞
+
+static lock bench_lock;
+static mutex bench_mutex;
+static rwlock bench_rwlock;
+static bool rw_bench_shared;				// true时读者取读锁,false时取写锁作对照
+static semaphore rw_bench_done;			// 每个读者线程结束时up一次
+
+/* 读者线程: RW_BENCH_ROUNDS次进入临界区,每次在其中睡眠RW_BENCH_HOLD_MS毫秒 */
+static void rw_bench_reader(void* arg UNUSED) {
+   uint32_t i;
+   for (i = 0; i < RW_BENCH_ROUNDS; ++i) {
+      if (rw_bench_shared) read_lock(&bench_rwlock); else write_lock(&bench_rwlock);
+      mtime_sleep(RW_BENCH_HOLD_MS);
+      if (rw_bench_shared) read_unlock(&bench_rwlock); else write_unlock(&bench_rwlock);
+   }
+   sema_up(&rw_bench_done);
+}
+
+/* 启动readers个读者线程并等它们都结束,返回所用的周期数 */
+static uint64_t rw_bench_run(uint32_t readers, bool shared) {
+   rw_bench_shared = shared;
+   uint32_t i;
+   uint64_t start = rdtsc();
+   for (i = 0; i < readers; ++i) {
+      thread_start("rw_bench", BENCH_PRIO, rw_bench_reader, NULL);
+   }
+   for (i = 0; i < readers; ++i) {
+      sema_down(&rw_bench_done);
+   }
+   return rdtsc() - start;
+}
+
+/**
+ * 同步原语的开销: 先测未竞争时lock、mutex、读锁和写锁各一对加解锁的周期数;
+ * 再测读者的可扩展性: 1、2、4个读者同时在临界区内睡眠,
+ * 读锁下它们并行,每秒完成的临界区数随读者数增长;写锁下它们串行,吞吐量不变
+*/
+static void sync_bench(void) {
+   lock_init(&bench_lock, "bench");
+   mutex_init(&bench_mutex);
+   rwlock_init(&bench_rwlock);
+   sema_init(&rw_bench_done, 0);
+
+   uint32_t i;
+   uint64_t start = rdtsc();
+   for (i = 0; i < SYNC_BENCH_OPS; ++i) {
+      lock_acquire(&bench_lock);
+      lock_release(&bench_lock);
+   }
+   bench_report("lock acquire/release", SYNC_BENCH_OPS, rdtsc() - start);
+
+   start = rdtsc();
+   for (i = 0; i < SYNC_BENCH_OPS; ++i) {
+      mutex_lock(&bench_mutex);
+      mutex_unlock(&bench_mutex);
+   }
+   bench_report("mutex lock/unlock", SYNC_BENCH_OPS, rdtsc() - start);
+
+   start = rdtsc();
+   for (i = 0; i < SYNC_BENCH_OPS; ++i) {
+      read_lock(&bench_rwlock);
+      read_unlock(&bench_rwlock);
+   }
+   bench_report("read_lock/unlock", SYNC_BENCH_OPS, rdtsc() - start);
+
+   start = rdtsc();
+   for (i = 0; i < SYNC_BENCH_OPS; ++i) {
+      write_lock(&bench_rwlock);
+      write_unlock(&bench_rwlock);
+   }
+   bench_report("write_lock/unlock", SYNC_BENCH_OPS, rdtsc() - start);
+
+   uint32_t readers;
+   char name[32];
+   for (readers = 1; readers <= RW_BENCH_MAX_READERS; readers <<= 1) {
+      snprintf(name, sizeof(name), "%u readers, read_lock", readers);
+      bench_report(name, readers * RW_BENCH_ROUNDS, rw_bench_run(readers, true));
+      snprintf(name, sizeof(name), "%u readers, write_lock", readers);
+      bench_report(name, readers * RW_BENCH_ROUNDS, rw_bench_run(readers, false));
+   }
+}
+
+#define BLOCK_BENCH_SECTORS 4096		// 每项测量读或写2MB
+#define BLOCK_BENCH_CHUNK 128				// 最大的一次读写64KB,即缓冲区大小
+#define BLOCK_BENCH_SMALL 8					// 最小的一次读写4KB
+
+/* 打印一项块设备测量的结果: 传输的KB数和MB/s,tsc未校准时只给出周期数 */
+static void block_bench_report(const char* name, uint32_t sectors, uint64_t cycles) {
+   uint32_t kb = sectors * BLOCK_SECTOR_SIZE / 1024;
+   if (tsc_mhz == 0 || cycles == 0) {
+      printk(LOG_INFO, "bench: %s: %u KB, %u cycles\n", name, kb, (uint32_t)cycles);
+      return;
+   }
+   uint32_t scaled_kb = kb;
+   while (cycles >> 32) {
+      cycles >>= 1;
+      scaled_kb >>= 1;
+   }
+   uint32_t kb_per_sec = div64_32((uint64_t)scaled_kb * tsc_mhz * 1000000, (uint32_t)cycles);
+   printk(LOG_INFO, "bench: %s: %u KB, %u.%02u MB/s\n", name, kb, kb_per_sec / 1024, kb_per_sec % 1024 * 100 / 1024);
+}
+
+/**
+ * 在bdev上从region起的BLOCK_BENCH_SECTORS个扇区内,每次读或写chunk个扇区,共BLOCK_BENCH_SECTORS个.
+ * random为true时每次的位置按线性同余序列在区内以chunk对齐随机选取,否则顺序前进.返回所用周期数,出错时返回0
+*/
+static uint64_t block_bench_run(block_device* bdev, uint32_t region, void* buf, uint32_t chunk, bool write, bool random) {
+   uint32_t cnt = BLOCK_BENCH_SECTORS / chunk;
+   uint32_t seed = 12345, i;
+   uint64_t start = rdtsc();
+   for (i = 0; i < cnt; ++i) {
+      uint32_t idx = i;
+      if (random) {
+         seed = seed * 1103515245 + 12345;
+         idx = (seed >> 16) % cnt;
+      }
+      uint32_t lba = region + idx * chunk;
+      if (!(write ? block_write(bdev, lba, buf, chunk) : block_read(bdev, lba, buf, chunk))) {
+         return 0;
+      }
+   }
+   return rdtsc() - start;
+}
+
+/**
+ * 块设备的读写吞吐量: 经block_read/block_write直接调用驱动,不经缓冲区缓存,比较ide硬盘sda与virtio-blk设备vda.
+ * 每个设备以4KB和64KB为单位各测顺序读、顺序写、随机读、随机写.
+ * 只在没有分区的硬盘上写,暂存区是硬盘的最后BLOCK_BENCH_SECTORS个扇区,要求硬盘至少有其两倍大,
+ * 从而不会碰到开头的mbr、loader和内核映像;有分区的硬盘只在开头读
+*/
+static void block_bench(void) {
+   const char* names[] = {"sda", "vda"};
+   const uint32_t chunks[] = {BLOCK_BENCH_SMALL, BLOCK_BENCH_CHUNK};
+   uint32_t pg_cnt = BLOCK_BENCH_CHUNK * BLOCK_SECTOR_SIZE / PG_SIZE;
+   void* buf = get_kernel_pages(pg_cnt);
+   if (buf == NULL) return;
+   uint32_t i, c, pattern;
+   for (i = 0; i < sizeof(names) / sizeof(names[0]); ++i) {
+      block_device* bdev = block_find(names[i]);
+      if (bdev == NULL || bdev->sectors < BLOCK_BENCH_SECTORS) {
+         printk(LOG_INFO, "bench: %s not present\n", names[i]);
+         continue;
+      }
+      bool scratch = !block_has_partitions(bdev) && bdev->sectors >= 2 * BLOCK_BENCH_SECTORS;
+      uint32_t region = scratch ? bdev->sectors - BLOCK_BENCH_SECTORS : 0;
+      if (!scratch) {
+         printk(LOG_INFO, "bench: %s has partitions or is too small, write runs skipped\n", names[i]);
+      }
+      for (c = 0; c < sizeof(chunks) / sizeof(chunks[0]); ++c) {
+         /* pattern的第0位为1表示写,第1位为1表示随机 */
+         for (pattern = 0; pattern < 4; ++pattern) {
+            bool write = pattern & 1, random = pattern & 2;
+            if (write && !scratch) continue;
+            uint64_t cycles = block_bench_run(bdev, region, buf, chunks[c], write, random);
+            char name[40];
+            snprintf(name, sizeof(name), "%s %s %s %uKB", names[i], random ? "random" : "sequential",
+                     write ? "write" : "read", chunks[c] * BLOCK_SECTOR_SIZE / 1024);
+            if (cycles == 0) {
+               printk(LOG_WARN, "bench: %s failed\n", name);
+               continue;
+            }
+            block_bench_report(name, BLOCK_BENCH_SECTORS, cycles);
+         }
+      }
+   }
+   free_kernel_pages(buf, pg_cnt);
+}
+
+#define URING_BENCH_OPS 1024
+
+/**
+ * 异步系统调用环与同步系统调用的吞吐量对比: 各执行URING_BENCH_OPS次向标准输出写0字节,
+ * 只测调用路径本身.同步的每次都陷入内核;经uring的尽量填满提交队列后才调用一次uring_enter
+*/
+void u_uring_bench(void) {
+   uint32_t i;
+   uint64_t start = rdtsc();
+   for (i = 0; i < URING_BENCH_OPS; ++i) {
+      write(stdout_no, "", 0);
+   }
+   u_bench_report("sync write", URING_BENCH_OPS, rdtsc() - start);
+
+   uring_ring* ring = uring_setup();
+   if (ring == NULL) {
+      printf("bench: uring_setup failed\n");
+      exit(-1);
+   }
+   uint32_t submitted = 0, reaped = 0;
+   start = rdtsc();
+   while (reaped < URING_BENCH_OPS) {
+      while (submitted < URING_BENCH_OPS && ring->sq_tail - ring->sq_head < URING_SQ_ENTRIES) {
+         uring_sqe* sqe = &ring->sqes[ring->sq_tail & (URING_SQ_ENTRIES - 1)];
+         sqe->opcode = URING_OP_WRITE;
+         sqe->fd = stdout_no;
+         sqe->addr = (uint32_t)"";
+         sqe->len = 0;
+         sqe->user_data = submitted++;
+         asm volatile ("" : : : "memory");         // 先填好提交项再推进sq_tail
+         ++ring->sq_tail;
+      }
+      uring_enter(1);
+      while (ring->cq_head != ring->cq_tail) {
+         ++ring->cq_head;
+         ++reaped;
+      }
+   }
+   u_bench_report("uring write", URING_BENCH_OPS, rdtsc() - start);
+   exit(0);
+}
@@ -7,6 +7,7 @@
 #include "string.h"
 #include "sync.h"
 #include "interrupt.h"
+#include "multiboot.h"
 
 #define PDE_INDEX(addr) ((addr & 0xffc00000) >> 22)
 #define PTE_INDEX(addr) ((addr & 0x003ff000) >> 12)
@@ -218,12 +219,67 @@ void *get_a_page(pool_flags pf, uint32_t vaddr) {
 	return (void*)vaddr;
 }
 
+/**
+ * 把内核页kvaddr起的pg_cnt页同时映射到当前进程的用户空间,返回用户虚拟地址,失败返回NULL.
+ * 物理页仍属于内核物理内存池,进程退出前须用unmap_from_user撤销映射,
+ * 否则release_prog_resource会把它们当作用户页回收
+*/
+void* map_to_user(void* kvaddr, uint32_t pg_cnt) {
+	ASSERT(running_thread()->pgdir != NULL);
+	lock_acquire(&user_pool.lock);
+	void* uvaddr = vaddr_get(PF_USER, pg_cnt);
+	if (uvaddr != NULL) {
+		uint32_t i;
+		for (i = 0; i < pg_cnt; ++i) {
+			page_table_add((void*)((uint32_t)uvaddr + i * PG_SIZE), (void*)addr_v2p((uint32_t)kvaddr + i * PG_SIZE));
+		}
+	}
+	lock_release(&user_pool.lock);
+	return uvaddr;
+}
+
 /* 得到虚拟地址映射到的物理地址 */ 
 uint32_t addr_v2p(uint32_t vaddr) {
 	uint32_t *pte = pte_ptr(vaddr);
 	return ((*pte & 0xfffff000) + (vaddr & 0x00000fff));
 }
 
+/**
+ * [uaddr, uaddr+len)是否全部落在当前页表中已映射的用户页上,write为true时还须可写.
+ * 系统调用写入或读取用户缓冲区前据此检查,不合法时返回错误,而不是在内核中触发page fault.
+ * 内核页的US位也是1,故须先排除0xc0000000以上的地址
+*/
+bool user_range_ok(const void* uaddr, uint32_t len, bool write) {
+	uint32_t start = (uint32_t)uaddr;
+	if (len == 0) return true;
+	if (start >= 0xc0000000 || len > 0xc0000000 - start) return false;
+	uint32_t need = PG_P_1 | PG_US_U | (write ? PG_RW_W : 0);
+	uint32_t vaddr = start & 0xfffff000;
+	while (vaddr < start + len) {
+		/* 页目录项不存在时不能访问pte_ptr */
+		if ((*pde_ptr(vaddr) & need) != need || (*pte_ptr(vaddr) & need) != need) {
+			return false;
+		}
+		vaddr += PG_SIZE;
+	}
+	return true;
+}
+
+/* 用户空间的字符串ustr是否在max_len字节内以0结尾,且经过的字节都在已映射的用户页上.按页检查,不会越过结尾的0去访问下一页 */
+bool user_str_ok(const char* ustr, uint32_t max_len) {
+	uint32_t i = 0;
+	while (i < max_len) {
+		uint32_t vaddr = (uint32_t)ustr + i;
+		uint32_t chunk = PG_SIZE - (vaddr & 0xfff);
+		if (chunk > max_len - i) chunk = max_len - i;
+		if (!user_range_ok((void*)vaddr, chunk, false)) return false;
+		while (chunk-- > 0) {
+			if (ustr[i++] == 0) return true;
+		}
+	}
+	return false;
+}
+
 /* 返回 arena中第idx个内存块的地址 */
 static mem_block *arena2block(arena* a, uint32_t idx) {
 	return (mem_block*)((uint32_t)(a) + idx * a->desc->block_size + sizeof(arena));
@@ -307,7 +363,7 @@ void* sys_malloc(uint32_t size) {
 		/* 开始将arena拆分成内存块,并添加到内存块描述符的free_list中 */
 		for (block_idx = 0; block_idx < descs[desc_idx].blocks_per_arena; ++block_idx) {
 			b = arena2block(a, block_idx);
-			ASSERT(!elem_find(&a->desc->free_list, &b->free_elem));
+			ASSERT(!elem_in_list(&a->desc->free_list, &b->free_elem));
 			list_append(&a->desc->free_list, &b->free_elem);
 		}
 		intr_set_status(old_status);
@@ -334,7 +390,10 @@ void pfree(uint32_t pg_phy_addr) {
 		mem_pool = &kernel_pool;
 		bit_idx = (pg_phy_addr - kernel_pool.phy_addr_start) / PG_SIZE;
 	}
+	/* 锁可重入,经由sys_free等已持有该池锁的路径调用时不会死锁 */
+	lock_acquire(&mem_pool->lock);
 	bitmap_set(&mem_pool->pool_bitmap, bit_idx, 0); // 将位图中该位清 0
+	lock_release(&mem_pool->lock);
 }
 
 /* 去掉页表中虚拟地址vaddr的映射,只去掉vaddr对应的pte */
@@ -406,6 +465,24 @@ void mfree_page(pool_flags pf, void* _vaddr, uint32_t pg_cnt) {
 	}
 }
 
+/* 释放以虚拟地址vaddr起始的pg_cnt个内核页,与get_kernel_pages相对 */
+void free_kernel_pages(void* vaddr, uint32_t pg_cnt) {
+	lock_acquire(&kernel_pool.lock);
+	mfree_page(PF_KERNEL, vaddr, pg_cnt);
+	lock_release(&kernel_pool.lock);
+}
+
+/* 撤销map_to_user建立的映射,只去掉页表项和用户虚拟地址,不回收物理页 */
+void unmap_from_user(void* uvaddr, uint32_t pg_cnt) {
+	uint32_t i;
+	lock_acquire(&user_pool.lock);
+	for (i = 0; i < pg_cnt; ++i) {
+		page_table_pte_remove((uint32_t)uvaddr + i * PG_SIZE);
+	}
+	vaddr_remove(PF_USER, uvaddr, pg_cnt);
+	lock_release(&user_pool.lock);
+}
+
 /* 回收内存ptr */
 void sys_free(void* ptr) {
 	ASSERT(ptr != NULL);
@@ -438,7 +515,7 @@ void sys_free(void* ptr) {
 			uint32_t block_idx;
 			for (block_idx = 0; block_idx < a->desc->blocks_per_arena; ++block_idx) {
 				mem_block *b = arena2block(a, block_idx);
-				ASSERT(elem_find(&a->desc->free_list, &b->free_elem));
+				ASSERT(elem_in_list(&a->desc->free_list, &b->free_elem));
 				list_remove(&b->free_elem);
 			}
 			mfree_page(PF, a, 1);
@@ -502,8 +579,8 @@ static void mem_pool_init(uint32_t all_mem) {
 	bitmap_init(&kernel_pool.pool_bitmap);
 	bitmap_init(&user_pool.pool_bitmap);
 
-	lock_init(&kernel_pool.lock);
-	lock_init(&user_pool.lock);
+	lock_init(&kernel_pool.lock, "kernel_pool");
+	lock_init(&user_pool.lock, "user_pool");
 
 
 	/* 下面初始化内核虚拟地址的位图,按实际物理内存大小生成数组。*/
@@ -532,10 +609,44 @@ void block_desc_init(mem_block_desc* desc_array) {
 	}
 }
 
+/**
+ * 从multiboot信息中得到物理内存总量,即4GB以下可用内存区域的最高结束地址.
+ * 没有内存布局时用mem_upper,不是经multiboot引导程序启动的返回0
+*/
+static uint32_t multiboot_mem_bytes(void) {
+	if (multiboot_magic != MULTIBOOT_BOOTLOADER_MAGIC) return 0;
+	uint32_t mem_bytes = 0;
+	if (multiboot_boot_info.flags & MULTIBOOT_INFO_MEM_MAP) {
+		uint32_t off = 0;
+		while (off + sizeof(multiboot_mmap_entry) <= multiboot_mmap_length) {
+			multiboot_mmap_entry* entry = (multiboot_mmap_entry*)(multiboot_mmap + off);
+			off += entry->size + sizeof(entry->size);
+			if (off > multiboot_mmap_length) break;		// 最后一项没有完整保存下来
+			if (entry->type != MULTIBOOT_MEMORY_AVAILABLE || entry->addr >= 0x100000000ULL) continue;
+			uint64_t end = entry->addr + entry->len;
+			if (end > 0xfffff000ULL) end = 0xfffff000ULL;
+			if (end > mem_bytes) mem_bytes = (uint32_t)end;
+		}
+	}
+	if (mem_bytes == 0 && (multiboot_boot_info.flags & MULTIBOOT_INFO_MEMORY)) {
+		mem_bytes = (multiboot_boot_info.mem_upper + 1024) * 1024;
+	}
+	return mem_bytes;
+}
+
+/**
+ * loader把物理内存总量total_mem_bytes存放在0xb00,此符号由链接时的--defsym定义为该地址.
+ * 若直接解引用小于一页的常量地址,gcc在-O2下会把它当作空指针附近的越界访问而告警
+*/
+extern uint32_t loader_mem_bytes;
+
 /* 内存管理部分初始化入口 */
 void mem_init(void) {
 	put_str("mem_init start\n");
-	uint32_t mem_bytes_total = (*(uint32_t*)(0xb00));		// 0xb00中存有total_mem_bytes,是物理内存总量
+	uint32_t mem_bytes_total = multiboot_mem_bytes();		// 经multiboot启动时取引导程序给出的内存布局
+	if (mem_bytes_total == 0) {
+		mem_bytes_total = loader_mem_bytes;									// 否则取loader得到的total_mem_bytes,是物理内存总量
+	}
 	mem_pool_init(mem_bytes_total);											// 初始化内存池
 	block_desc_init(k_block_descs);											// 初始化 mem_block_desc 数组 descs，为 malloc 做准备
 	put_str("mem_init done\n");
@@ -28,6 +28,7 @@ typedef struct {
 // extern pool kernel_pool, user_pool;
 void mem_init(void);
 void* get_kernel_pages(uint32_t pg_cnt);
+void free_kernel_pages(void* vaddr, uint32_t pg_cnt);
 void* malloc_page(pool_flags pf, uint32_t pg_cnt);
 // void malloc_init(void);
 uint32_t* pte_ptr(uint32_t vaddr);
@@ -35,6 +36,10 @@ uint32_t* pde_ptr(uint32_t vaddr);
 void* get_a_page(pool_flags pf, uint32_t vaddr);
 void* get_user_pages(uint32_t pg_cnt);
 uint32_t addr_v2p(uint32_t vaddr);
+bool user_range_ok(const void* uaddr, uint32_t len, bool write);
+bool user_str_ok(const char* ustr, uint32_t max_len);
+void* map_to_user(void* kvaddr, uint32_t pg_cnt);
+void unmap_from_user(void* uvaddr, uint32_t pg_cnt);
 
 /* 内存块 */
 typedef struct
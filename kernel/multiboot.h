@@ -0,0 +1,39 @@
+#ifndef __KERNEL_MULTIBOOT_H
+#define __KERNEL_MULTIBOOT_H
+#include "stdint.h"
+
+#define MULTIBOOT_BOOTLOADER_MAGIC 0x2badb002	// 经multiboot引导程序启动时multiboot_magic的值
+#define MULTIBOOT_INFO_MEMORY (1 << 0)				// mem_lower和mem_upper有效
+#define MULTIBOOT_INFO_MEM_MAP (1 << 6)				// mmap_length和mmap_addr有效
+#define MULTIBOOT_MEMORY_AVAILABLE 1					// 内存布局中可用内存的类型
+#define MULTIBOOT_MMAP_MAX 512								// 最多保存的内存布局字节数,与multiboot.S一致
+
+/* multiboot信息,只保存到mmap_addr为止,multiboot.S按此大小复制 */
+typedef struct {
+	uint32_t flags;
+	uint32_t mem_lower;								// 低端内存的KB数
+	uint32_t mem_upper;								// 1MB以上连续内存的KB数
+	uint32_t boot_device;
+	uint32_t cmdline;
+	uint32_t mods_count;
+	uint32_t mods_addr;
+	uint32_t syms[4];
+	uint32_t mmap_length;							// 内存布局的字节数
+	uint32_t mmap_addr;								// 内存布局的物理地址,内核使用的是multiboot_mmap中的副本
+} multiboot_info;
+
+/* 内存布局中的一项,与e820的ards相同,前面多了本项的大小 */
+typedef struct {
+	uint32_t size;										// 本项除size外的字节数
+	uint64_t addr;
+	uint64_t len;
+	uint32_t type;
+} __attribute__((packed)) multiboot_mmap_entry;
+
+/* 由multiboot.S的入口代码在进入main之前填写,经loader启动时均为0 */
+extern uint32_t multiboot_magic;
+extern multiboot_info multiboot_boot_info;
+extern uint32_t multiboot_mmap_length;
+extern uint8_t multiboot_mmap[MULTIBOOT_MMAP_MAX];
+
+#endif
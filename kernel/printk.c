@@ -0,0 +1,165 @@
+#include "printk.h"
+#include "stdint.h"
+#include "global.h"
+#include "stdio.h"
+#include "string.h"
+#include "atomic.h"
+#include "tsc.h"
+#include "thread.h"
+#include "wait_queue.h"
+#include "interrupt.h"
+#include "console.h"
+#include "print.h"
+
+#define LOG_SLOT_CNT 256						// 日志槽个数,须为2的幂,共保留最近32KB日志
+#define LOG_SLOT_MASK (LOG_SLOT_CNT - 1)
+#define LOG_TEXT_MAX 112						// 每条日志正文的最大长度,超出部分截断
+
+/* 每条日志占一个定长槽,槽大小128字节 */
+typedef struct {
+	volatile uint32_t seq;						// 槽中日志的序号,写完后才置为本条的序号
+	uint8_t level;
+	uint8_t len;											// 正文长度
+	uint16_t reserved;
+	uint64_t tsc;											// 写日志时的时间戳
+	char text[LOG_TEXT_MAX];
+} log_record;
+
+/**
+ * 内核日志环形缓冲区.
+ * 写者用xadd原子地领取一个序号,序号对应的槽就归它独占,填好后最后写入seq表示提交.
+ * 领取序号不需要锁也不需要关中断,任何上下文(包括中断处理程序)都能写,
+ * 中断处理程序打断了正在写日志的线程也没关系,两者领到的是不同的槽.
+ * klogd线程按序号顺序读出日志送往终端;读者落后超过一圈时,被覆盖的日志计入log_dropped
+*/
+static log_record log_ring[LOG_SLOT_CNT];
+static volatile uint32_t log_next;		// 下一个待领取的序号
+static uint32_t log_read;							// klogd下一个要读的序号
+static uint32_t log_dropped;					// 因读者落后而被覆盖的日志条数
+static wait_queue klogd_wq;						// klogd在此等待新日志
+static bool klogd_started;
+
+static const char* level_name[] = {"EMERG", "ERR", "WARN", "INFO", "DEBUG"};
+
+#define barrier() asm volatile ("" : : : "memory")
+
+/* 格式化并写入一条日志,可在任意上下文中调用,正文超过LOG_TEXT_MAX-1个字符的部分被截断 */
+void printk(log_level level, const char* format, ...) {
+	uint32_t seq = atomic_xadd(&log_next, 1);
+	log_record* rec = &log_ring[seq & LOG_SLOT_MASK];
+	rec->seq = seq - 1;									// 标记为未提交,读者见到比自己序号小的值就等待
+	barrier();
+	rec->level = level;
+	rec->tsc = rdtsc();
+
+	/* 直接格式化到槽中,不经过中间缓冲区 */
+	va_list args;
+	va_start(args, format);
+	uint32_t len = vsnprintf(rec->text, LOG_TEXT_MAX, format, args);
+	va_end(args);
+	rec->len = len < LOG_TEXT_MAX ? len : LOG_TEXT_MAX - 1;
+	barrier();
+	rec->seq = seq;											// 提交
+
+	if (klogd_started && !wq_empty(&klogd_wq)) wq_wake_one(&klogd_wq);
+}
+
+/**
+ * 取出序号为log_read的日志复制到out,成功返回true.
+ * 该槽尚未提交时返回false;已被后来的日志覆盖时跳到仍保留着的最旧一条
+*/
+static bool log_fetch(log_record* out) {
+	while (log_read != log_next) {
+		if (log_next - log_read > LOG_SLOT_CNT) {
+			log_dropped += log_next - LOG_SLOT_CNT - log_read;
+			log_read = log_next - LOG_SLOT_CNT;
+		}
+		log_record* rec = &log_ring[log_read & LOG_SLOT_MASK];
+		uint32_t seq = rec->seq;
+		if ((int32_t)(seq - log_read) < 0) return false;	// 写者还没写完
+		barrier();
+		*out = *rec;
+		barrier();
+		if (seq == log_read && rec->seq == seq) {
+			++log_read;
+			return true;
+		}
+		/* 复制期间或之前已被覆盖,丢掉这条继续 */
+		++log_dropped;
+		++log_read;
+	}
+	return false;
+}
+
+/* 将64位数v以十六进制写到buf,不输出前导0,返回写入的字符数 */
+static uint32_t format_hex64(char* buf, uint64_t v) {
+	char digits[16];
+	int32_t pos = 16;
+	do {
+		digits[--pos] = "0123456789abcdef"[v & 0xf];
+		v >>= 4;
+	} while (v != 0);
+	memcpy(buf, digits + pos, 16 - pos);
+	return 16 - pos;
+}
+
+/* 把一条日志格式化为"[tsc] 级别: 正文",返回长度 */
+static uint32_t log_format(char* line, log_record* rec) {
+	char* p = line;
+	*p++ = '[';
+	p += format_hex64(p, rec->tsc);
+	p += sprintf(p, "] %s: ", level_name[rec->level]);
+	memcpy(p, rec->text, rec->len);
+	p += rec->len;
+	return p - line;
+}
+
+/* klogd的等待条件:有待读的日志 */
+static bool log_pending(void* arg UNUSED) {
+	return log_read != log_next && (int32_t)(log_ring[log_read & LOG_SLOT_MASK].seq - log_read) >= 0;
+}
+
+/* 日志线程,把日志异步地写往终端(显存和串口) */
+static void klogd(void* arg UNUSED) {
+	char line[LOG_TEXT_MAX + 32];
+	log_record rec;
+	while (1) {
+		wq_wait_until(&klogd_wq, log_pending, NULL, true);
+		while (log_fetch(&rec)) {
+			console_write(line, log_format(line, &rec));
+		}
+		if (log_dropped != 0) {
+			uint32_t len = sprintf(line, "klogd: %d messages dropped\n", log_dropped);
+			log_dropped = 0;
+			console_write(line, len);
+		}
+	}
+}
+
+/* 启动klogd,此前的日志都留在缓冲区中,由klogd启动后补打 */
+void printk_init(void) {
+	console_put_str("printk_init start\n");
+	wq_init(&klogd_wq);
+	thread_start("klogd", 31, klogd, NULL);
+	klogd_started = true;
+	console_put_str("printk_init done\n");
+}
+
+/**
+ * 内核崩溃时调用,绕过klogd和终端锁,用put_str直接把缓冲区中仍保留的日志打到屏幕上.
+ * 从最新一条往前至多LOG_SLOT_CNT条,与klogd读到哪里无关,已经输出过的日志也再打一遍,
+ * 崩溃前的上下文才完整.未提交或已被覆盖的槽跳过.调用者须已关中断
+*/
+void printk_panic_dump(void) {
+	char line[LOG_TEXT_MAX + 32];
+	uint32_t next = log_next;
+	uint32_t cnt = next < LOG_SLOT_CNT ? next : LOG_SLOT_CNT;
+	uint32_t seq;
+	put_str("---- kernel log ----\n");
+	for (seq = next - cnt; seq != next; ++seq) {
+		log_record* rec = &log_ring[seq & LOG_SLOT_MASK];
+		if (rec->seq != seq) continue;
+		line[log_format(line, rec)] = '\0';
+		put_str(line);
+	}
+}
@@ -0,0 +1,19 @@
+#ifndef __KERNEL_PRINTK_H
+#define __KERNEL_PRINTK_H
+
+#include "stdint.h"
+
+/* 日志级别,数值越小越紧急 */
+typedef enum {
+	LOG_EMERG,						// 系统不可用
+	LOG_ERR,							// 错误
+	LOG_WARN,							// 警告
+	LOG_INFO,							// 一般信息
+	LOG_DEBUG							// 调试信息
+} log_level;
+
+void printk(log_level level, const char* format, ...);
+void printk_init(void);
+void printk_panic_dump(void);
+
+#endif
@@ -0,0 +1,161 @@
+#include "softirq.h"
+#include "global.h"
+#include "stdint.h"
+#include "list.h"
+#include "interrupt.h"
+#include "thread.h"
+#include "wait_queue.h"
+#include "trace.h"
+#include "tsc.h"
+#include "debug.h"
+#include "print.h"
+
+#define IRQ_VEC_FIRST 0x20						// 8259A的IRQ0~IRQ15对应的中断向量
+#define IRQ_VEC_LAST 0x2f
+#define SOFTIRQ_MAX_RESTART 10				// 中断退出时最多处理多少轮新挂起的软中断
+#define SOFTIRQ_BUDGET_CYCLES 2000000	// 中断退出时处理软中断的时间预算(时钟周期),约为1ms,超出后交给ksoftirqd
+
+/**
+ * 下半部机制.
+ * 中断处理程序只做必须在关中断下完成的事(读端口、应答设备),其余工作通过raise_softirq或
+ * tasklet_schedule挂起,在中断退出时开中断执行,这样硬中断处理程序的关中断时间只有几微秒.
+ * 若软中断在预算内没有处理完(如中断风暴),剩余的交给ksoftirqd线程,和普通任务一起参与调度
+*/
+static softirq_action* softirq_vec[NR_SOFTIRQS];
+static volatile uint32_t softirq_pending;			// 挂起的软中断位图,第nr位对应软中断nr
+static bool softirq_running;									// 是否正在执行软中断,软中断不可嵌套
+static uint32_t hardirq_depth;								// 正在处理的硬中断层数
+static list tasklet_list;											// 待执行的tasklet
+static wait_queue ksoftirqd_wq;
+static bool ksoftirqd_started;
+
+/* 唤醒ksoftirqd处理剩余的软中断,调用者须已关中断 */
+static void wake_ksoftirqd(void) {
+	if (ksoftirqd_started && !wq_empty(&ksoftirqd_wq)) wq_wake_one(&ksoftirqd_wq);
+}
+
+/**
+ * 执行挂起的软中断,每轮先取走全部挂起位再开中断执行,执行期间新挂起的留到下一轮.
+ * 轮数或时间超出预算时停止,返回是否还有挂起的软中断.调用者须已关中断,返回时仍关中断
+*/
+static bool __do_softirq(void) {
+	ASSERT(intr_get_status() == INTR_OFF && !softirq_running);
+	uint64_t start = rdtsc();
+	uint32_t restart = SOFTIRQ_MAX_RESTART;
+	uint32_t pending;
+	softirq_running = true;
+	while ((pending = softirq_pending) != 0) {
+		softirq_pending = 0;
+		intr_enable();
+		while (pending != 0) {
+			uint32_t nr = __builtin_ctz(pending);
+			pending &= pending - 1;
+			if (softirq_vec[nr] != NULL) softirq_vec[nr]();
+		}
+		intr_disable();
+		if (--restart == 0 || rdtsc() - start > SOFTIRQ_BUDGET_CYCLES) break;
+	}
+	softirq_running = false;
+	return softirq_pending != 0;
+}
+
+/* 注册软中断nr的处理函数 */
+void open_softirq(softirq_nr nr, softirq_action* action) {
+	softirq_vec[nr] = action;
+}
+
+/* 挂起软中断nr.在中断处理程序中调用时由中断退出路径执行,否则唤醒ksoftirqd执行 */
+void raise_softirq(softirq_nr nr) {
+	intr_status old_status = intr_disable();
+	softirq_pending |= 1 << nr;
+	if (hardirq_depth == 0 && !softirq_running) wake_ksoftirqd();
+	intr_set_status(old_status);
+}
+
+void tasklet_init(tasklet* t, tasklet_func* func, uint32_t data) {
+	t->func = func;
+	t->data = data;
+	t->scheduled = false;
+}
+
+/* 调度tasklet,若它已在待执行链表中则什么也不做 */
+void tasklet_schedule(tasklet* t) {
+	intr_status old_status = intr_disable();
+	if (!t->scheduled) {
+		t->scheduled = true;
+		list_append(&tasklet_list, &t->tag);
+		raise_softirq(SOFTIRQ_TASKLET);
+	}
+	intr_set_status(old_status);
+}
+
+/**
+ * SOFTIRQ_TASKLET的处理函数.
+ * 只执行进入时已在链表中的tasklet,执行期间重新调度的留给下一轮,避免自我调度的tasklet霸占本轮
+*/
+static void tasklet_action(void) {
+	intr_disable();
+	uint32_t cnt = list_len(&tasklet_list);
+	while (cnt-- > 0) {
+		tasklet* t = elem2entry(tasklet, tag, list_pop(&tasklet_list));
+		t->scheduled = false;
+		intr_enable();
+		t->func(t->data);
+		intr_disable();
+	}
+	intr_enable();
+}
+
+/* 由kernel.S在调用中断处理程序前调用 */
+void irq_enter(uint32_t vec_nr) {
+	++hardirq_depth;
+	trace_irq_enter(vec_nr);
+}
+
+/**
+ * 由kernel.S在中断处理程序返回后调用,此时仍关中断.
+ * 只有硬件中断发生时被打断的上下文一定是开中断的,所以只在硬件中断的退出路径上开中断执行软中断;
+ * 执行完软中断再检查need_resched,时间片用完或唤醒了更高优先级的任务时在这里调度
+*/
+void irq_exit(uint32_t vec_nr) {
+	--hardirq_depth;
+	if (hardirq_depth == 0 && !softirq_running) {
+		if (vec_nr >= IRQ_VEC_FIRST && vec_nr <= IRQ_VEC_LAST) {
+			if (softirq_pending != 0 && __do_softirq()) {
+				wake_ksoftirqd();
+			}
+			if (need_resched) {
+				schedule();
+			}
+		} else if (softirq_pending != 0) {
+			wake_ksoftirqd();
+		}
+	}
+	trace_irq_exit(vec_nr);			// 中断处理中可能发生了调度,此时记录的是本任务重新上cpu后的退出时刻
+}
+
+/* ksoftirqd的等待条件:有挂起的软中断 */
+static bool softirq_has_pending(void* arg UNUSED) {
+	return softirq_pending != 0;
+}
+
+/* 软中断线程,处理中断退出路径上超出预算的软中断,每处理一轮就让出一次cpu */
+static void ksoftirqd(void* arg UNUSED) {
+	while (1) {
+		wq_wait_until(&ksoftirqd_wq, softirq_has_pending, NULL, true);
+		intr_status old_status = intr_disable();
+		__do_softirq();
+		intr_set_status(old_status);
+		thread_yield();
+	}
+}
+
+void softirq_init(void) {
+	put_str("softirq_init start\n");
+	list_init(&tasklet_list);
+	wq_init(&ksoftirqd_wq);
+	open_softirq(SOFTIRQ_TASKLET, tasklet_action);
+	thread_start("ksoftirqd", 31, ksoftirqd, NULL);
+	ksoftirqd_started = true;
+	put_str("softirq_init done\n");
+}
@@ -0,0 +1,36 @@
+#ifndef __KERNEL_SOFTIRQ_H
+#define __KERNEL_SOFTIRQ_H
+
+#include "stdint.h"
+#include "global.h"
+#include "list.h"
+
+/* 软中断号,数值越小越先执行 */
+typedef enum {
+	SOFTIRQ_TASKLET,
+	NR_SOFTIRQS
+} softirq_nr;
+
+typedef void softirq_action(void);
+typedef void tasklet_func(uint32_t data);
+
+/**
+ * tasklet: 由中断处理程序调度、在软中断中执行的一次性工作.
+ * 同一tasklet在执行前被多次调度只执行一次;执行时已开中断,但不能阻塞
+*/
+typedef struct {
+	list_elem tag;							// 挂在待执行的tasklet链表上
+	tasklet_func* func;
+	uint32_t data;							// 传给func的参数
+	bool scheduled;							// 是否已在待执行链表中
+} tasklet;
+
+void softirq_init(void);
+void open_softirq(softirq_nr nr, softirq_action* action);
+void raise_softirq(softirq_nr nr);
+void tasklet_init(tasklet* t, tasklet_func* func, uint32_t data);
+void tasklet_schedule(tasklet* t);
+void irq_enter(uint32_t vec_nr);
+void irq_exit(uint32_t vec_nr);
+
+#endif
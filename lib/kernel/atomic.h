@@ -0,0 +1,30 @@
+#ifndef __LIB_KERNEL_ATOMIC_H
+#define __LIB_KERNEL_ATOMIC_H
+#include "stdint.h"
+
+/**
+ * 原子操作.
+ * 单条带lock前缀的读改写指令不会被中断打断,多核下也是原子的,
+ * 因此不必关中断就能完成"检查并修改".内联汇编都带"memory"约束,同时充当编译器屏障
+*/
+
+/* 将*ptr置为val,返回*ptr原来的值.xchg访问内存时自带lock语义 */
+static inline uint32_t atomic_xchg(volatile uint32_t* ptr, uint32_t val) {
+	asm volatile ("xchgl %0, %1" : "+r" (val), "+m" (*ptr) : : "memory");
+	return val;
+}
+
+/* 若*ptr等于old则将其置为new,返回*ptr原来的值,与old相等即表示成功 */
+static inline uint32_t atomic_cmpxchg(volatile uint32_t* ptr, uint32_t old, uint32_t new) {
+	uint32_t prev;
+	asm volatile ("lock cmpxchgl %2, %1" : "=a" (prev), "+m" (*ptr) : "r" (new), "0" (old) : "memory");
+	return prev;
+}
+
+/* 将*ptr加上val,返回*ptr原来的值 */
+static inline uint32_t atomic_xadd(volatile uint32_t* ptr, uint32_t val) {
+	asm volatile ("lock xaddl %0, %1" : "+r" (val), "+m" (*ptr) : : "memory");
+	return val;
+}
+
+#endif
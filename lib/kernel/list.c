@@ -7,6 +7,9 @@ void list_init(list *list) {
 	list->head.next = &list->tail;
 	list->tail.prev = &list->head;
 	list->tail.next = NULL;
+#ifndef NDEBUG
+	list->head.owner = list->tail.owner = list;
+#endif
 }
 
 /* 把链表元素 elem 插入在元素 before 之前 */
@@ -17,6 +20,9 @@ void list_insert_before(list_elem *before, list_elem *elem) {
 	elem->prev = before->prev;
 	elem->prev->next = elem;
 	before->prev = elem;
+#ifndef NDEBUG
+	elem->owner = before->owner;
+#endif
 
 	intr_set_status(old_status);
 }
@@ -37,6 +43,9 @@ void list_remove(list_elem *pelem) {
 
 	pelem->prev->next = pelem->next;
 	pelem->next->prev = pelem->prev;
+#ifndef NDEBUG
+	pelem->owner = NULL;
+#endif
 
 	intr_set_status(old_status);
 }
@@ -80,7 +89,7 @@ list_elem *list_traversal(list *plist, function func, int arg) {
 	return NULL;
 }
 
-/* 从链表中查找元素obj_elem,成功时返回true,失败时返回false */
+/* 从链表中查找元素obj_elem,成功时返回true,失败时返回false. 需遍历整个链表,热路径中请勿使用 */
 bool elem_find(list *plist, list_elem *obj_elem) {
 	list_elem *elem = plist->head.next;
 	while (elem != &plist->tail) {
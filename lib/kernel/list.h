@@ -12,13 +12,24 @@
 typedef struct list_elem {
 	struct list_elem *prev;
 	struct list_elem *next;
+#ifndef NDEBUG
+	struct list *owner;					// 结点当前所在的链表,仅调试版维护,供ASSERT以O(1)判断成员关系
+#endif
 } list_elem;
 
-typedef struct {
+typedef struct list {
 	list_elem head;
 	list_elem tail;
 } list;
 
+/**
+ * 判断elem是否在链表plist中,只在调试版中可用且只应出现在ASSERT里.
+ * 发行版定义了NDEBUG,ASSERT被编译掉,owner字段也不存在
+*/
+#ifndef NDEBUG
+#define elem_in_list(plist, elem) ((elem)->owner == (plist))
+#endif
+
 /* 自定义函数类型function,用于在list_traversal中做回调函数 */
 typedef bool (function)(list_elem *, int arg);
 
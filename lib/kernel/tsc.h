@@ -0,0 +1,21 @@
+#ifndef __LIB_KERNEL_TSC_H
+#define __LIB_KERNEL_TSC_H
+#include "stdint.h"
+
+/* 读时间戳计数器,返回cpu上电以来的时钟周期数 */
+static inline uint64_t rdtsc(void) {
+	uint32_t low, high;
+	asm volatile ("rdtsc" : "=a" (low), "=d" (high));
+	return ((uint64_t)high << 32) | low;
+}
+
+/* 64位被除数除以32位除数,商须能用32位表示,否则返回0xffffffff.内核不链接libgcc,没有__udivdi3 */
+static inline uint32_t div64_32(uint64_t n, uint32_t d) {
+	uint32_t high = (uint32_t)(n >> 32), low = (uint32_t)n;
+	if (high >= d) return 0xffffffff;
+	uint32_t quot, rem;
+	asm ("divl %4" : "=a" (quot), "=d" (rem) : "a" (low), "d" (high), "rm" (d));
+	return quot;
+}
+
+#endif
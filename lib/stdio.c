@@ -5,70 +5,224 @@
 #include "syscall.h"
 #include "print.h"
 
-#define va_start(ap, v) ap = (va_list)&v					// 把ap指向第一个固定参数v
-#define va_arg(ap, t) *((t*)(ap += 4))						// ap指向下一个参数并返回其值
-#define va_end(ap) ap = NULL											// 清除ap
+#define FMT_LEFT 1											// '-' 左对齐
+#define FMT_ZERO 2											// '0' 用0填充
+#define FMT_UPPER 4											// 十六进制用大写字母
+#define FMT_PREC 8											// 指定了精度
 
+#define PRINTF_BUF_SIZE 128							// printf攒够这么多字符才调用一次write
 
-/* 将整型转换成字符（integer to ascii） */
-static void itoa(uint32_t value, char** buf_ptr_addr, uint8_t base) {
-	uint32_t m = value % base;								// 求模,最先掉下来的是最低位
-	uint32_t i = value / base;								// 取整
-	if (i) {
-		itoa(i, buf_ptr_addr, base);
+static const char digits_lower[] = "0123456789abcdef";
+static const char digits_upper[] = "0123456789ABCDEF";
+
+/* 把一段连续的字符交给sink */
+static inline void emit(fmt_sink sink, void* ctx, const char* buf, uint32_t len) {
+	if (len > 0) sink(ctx, buf, len);
+}
+
+/* 向sink输出cnt个填充字符c */
+static void emit_pad(fmt_sink sink, void* ctx, char c, int32_t cnt) {
+	char pad[16];
+	uint32_t i;
+	for (i = 0; i < sizeof(pad); ++i) pad[i] = c;
+	while (cnt > 0) {
+		uint32_t n = cnt > (int32_t)sizeof(pad) ? sizeof(pad) : (uint32_t)cnt;
+		sink(ctx, pad, n);
+		cnt -= n;
 	}
+}
 
-	if (m < 10) {			// 如果余数是0～9
-		*((*buf_ptr_addr)++) = '0' + m;					//将数字0～9转换为字符'0'～'9'
-	} else {					// 否则余数是A～F
-		*((*buf_ptr_addr)++) = 'A' + m - 10;		//将数字A～F转换为字符'A'～'F'
+/**
+ * 将无符号整数value按base进制转换为字符,从buf_end往前写,返回首字符的位置.
+ * 用循环代替递归,十六进制用移位和掩码代替除法
+*/
+static char* utoa(uint32_t value, char* buf_end, uint32_t base, const char* digits) {
+	char* p = buf_end;
+	if (base == 16) {
+		do {
+			*--p = digits[value & 0xf];
+			value >>= 4;
+		} while (value != 0);
+	} else {
+		do {
+			*--p = digits[value % base];
+			value /= base;
+		} while (value != 0);
 	}
+	return p;
 }
 
-/* 将参数ap按照格式format输出到字符串str,并返回替换后str长度 */
-uint32_t vsprintf(char* str, const char* format, va_list ap) {
-	char* buf_ptr = str;
-	const char *index_ptr = format;
-	char index_char = *index_ptr;
-	int32_t arg_int;
-	char* arg_str;
-	while (index_char) {
-		if (index_char != '%') {
-			*(buf_ptr++) = index_char;
-			index_char = *(++index_ptr);
-			continue;
+/* 按宽度、精度和标志输出一个数字,prefix为符号或"0x"等前缀 */
+static uint32_t emit_number(fmt_sink sink, void* ctx, uint32_t value, uint32_t base, const char* prefix,
+                            int32_t width, int32_t prec, uint32_t flags) {
+	char buf[12];
+	char* start = utoa(value, buf + sizeof(buf), base, (flags & FMT_UPPER) ? digits_upper : digits_lower);
+	int32_t len = buf + sizeof(buf) - start;
+	if ((flags & FMT_PREC) && prec == 0 && value == 0) len = 0;	// 精度为0时数字0不输出
+
+	int32_t prefix_len = strlen(prefix);
+	int32_t zeros = (flags & FMT_PREC) && prec > len ? prec - len : 0;
+	int32_t pad = width - prefix_len - zeros - len;
+	if (pad < 0) pad = 0;
+
+	/* 有精度时忽略'0'标志 */
+	if ((flags & FMT_ZERO) && !(flags & (FMT_LEFT | FMT_PREC))) {
+		zeros += pad;
+		pad = 0;
+	}
+	if (!(flags & FMT_LEFT)) emit_pad(sink, ctx, ' ', pad);
+	emit(sink, ctx, prefix, prefix_len);
+	emit_pad(sink, ctx, '0', zeros);
+	emit(sink, ctx, buf + sizeof(buf) - len, len);
+	if (flags & FMT_LEFT) emit_pad(sink, ctx, ' ', pad);
+	return pad + prefix_len + zeros + len;
+}
+
+/**
+ * 格式化的核心,把format按ap展开后分段交给sink(ctx, 字符串, 长度),返回输出的总字符数.
+ * 支持%d %i %u %x %X %p %s %c %%,标志'-'和'0',宽度和精度(可用'*'从参数中取),
+ * 长度修饰符'l'因int和long同为32位而被忽略.
+ * 普通字符按整段直接交给sink,不逐个复制
+*/
+uint32_t vformat(fmt_sink sink, void* ctx, const char* format, va_list ap) {
+	uint32_t total = 0;
+	const char* p = format;
+	while (*p) {
+		const char* run = p;
+		while (*p && *p != '%') ++p;
+		emit(sink, ctx, run, p - run);
+		total += p - run;
+		if (*p == '\0') break;
+
+		++p;																	// 跳过'%'
+		uint32_t flags = 0;
+		int32_t width = 0, prec = 0;
+		for (;; ++p) {
+			if (*p == '-') flags |= FMT_LEFT;
+			else if (*p == '0') flags |= FMT_ZERO;
+			else break;
 		}
+		if (*p == '*') {
+			width = va_arg(ap, int32_t);
+			if (width < 0) {
+				flags |= FMT_LEFT;
+				width = -width;
+			}
+			++p;
+		} else {
+			while (*p >= '0' && *p <= '9') width = width * 10 + (*p++ - '0');
+		}
+		if (*p == '.') {
+			flags |= FMT_PREC;
+			++p;
+			if (*p == '*') {
+				prec = va_arg(ap, int32_t);
+				if (prec < 0) flags &= ~FMT_PREC;
+				++p;
+			} else {
+				while (*p >= '0' && *p <= '9') prec = prec * 10 + (*p++ - '0');
+			}
+		}
+		while (*p == 'l') ++p;
 
-		index_char = *(++index_ptr);				// 得到%后面的字符
-		switch(index_char) {
+		int32_t arg_int;
+		const char* arg_str;
+		char ch;
+		int32_t len, pad;
+		switch (*p) {
+			case 'd':
+			case 'i':
+				arg_int = va_arg(ap, int32_t);
+				total += emit_number(sink, ctx, arg_int < 0 ? 0 - (uint32_t)arg_int : (uint32_t)arg_int, 10,
+				                     arg_int < 0 ? "-" : "", width, prec, flags);
+				break;
+			case 'u':
+				total += emit_number(sink, ctx, va_arg(ap, uint32_t), 10, "", width, prec, flags);
+				break;
+			case 'X':
+				flags |= FMT_UPPER;
+				/* fall through */
+			case 'x':
+				total += emit_number(sink, ctx, va_arg(ap, uint32_t), 16, "", width, prec, flags);
+				break;
+			case 'p':
+				total += emit_number(sink, ctx, va_arg(ap, uint32_t), 16, "0x", width, 8, flags | FMT_PREC);
+				break;
 			case 's':
-				arg_str = va_arg(ap, char*);
-				strcpy(buf_ptr, arg_str);
-				buf_ptr += strlen(arg_str);
-				index_char = *(++index_ptr);
+				arg_str = va_arg(ap, const char*);
+				if (arg_str == NULL) arg_str = "(null)";
+				len = 0;
+				while (arg_str[len] && (!(flags & FMT_PREC) || len < prec)) ++len;
+				pad = width > len ? width - len : 0;
+				if (!(flags & FMT_LEFT)) emit_pad(sink, ctx, ' ', pad);
+				emit(sink, ctx, arg_str, len);
+				if (flags & FMT_LEFT) emit_pad(sink, ctx, ' ', pad);
+				total += len + pad;
 				break;
 			case 'c':
-				*(buf_ptr++) = va_arg(ap, char);
-				index_char = *(++index_ptr);
+				ch = (char)va_arg(ap, int32_t);			// char经可变参数传递时被提升为int
+				pad = width > 1 ? width - 1 : 0;
+				if (!(flags & FMT_LEFT)) emit_pad(sink, ctx, ' ', pad);
+				sink(ctx, &ch, 1);
+				if (flags & FMT_LEFT) emit_pad(sink, ctx, ' ', pad);
+				total += 1 + pad;
 				break;
-			case 'd':
-				arg_int = va_arg(ap, int);
-				if (arg_int < 0) {
-					arg_int = 0 - arg_int;
-					*buf_ptr++ = '-';
-				}
-				itoa(arg_int, &buf_ptr, 10);
-				index_char = *(++index_ptr);
-				break;	
-			case 'x':
-				arg_int = va_arg(ap, int);
-				itoa(arg_int, &buf_ptr, 16);
-				index_char = *(++index_ptr);		// 跳过格式字符并更新index_char
+			case '%':
+				sink(ctx, "%", 1);
+				++total;
+				break;
+			case '\0':													// 格式串以单个'%'结尾
+				return total;
+			default:														// 不认识的转换说明原样输出
+				sink(ctx, p - 1, 2);
+				total += 2;
 				break;
 		}
+		++p;
 	}
+	return total;
+}
+
+/* vsnprintf的sink,写入定长缓冲区,超出部分丢弃 */
+typedef struct {
+	char* buf;
+	uint32_t size;											// 缓冲区大小,含结尾的'\0'
+	uint32_t pos;												// 已写入的字符数
+} buf_sink_ctx;
+
+static void buf_sink(void* ctx, const char* s, uint32_t len) {
+	buf_sink_ctx* b = ctx;
+	if (b->pos + 1 < b->size) {
+		uint32_t room = b->size - 1 - b->pos;
+		memcpy(b->buf + b->pos, s, len < room ? len : room);
+	}
+	b->pos += len;
+}
+
+/**
+ * 将参数ap按照格式format输出到长为size的str中,至多写size-1个字符并总以'\0'结尾.
+ * 返回完整输出所需的长度(不含'\0'),大于等于size即表示被截断
+*/
+uint32_t vsnprintf(char* str, uint32_t size, const char* format, va_list ap) {
+	buf_sink_ctx b = {str, size, 0};
+	vformat(buf_sink, &b, format, ap);
+	if (size > 0) str[b.pos < size ? b.pos : size - 1] = '\0';
+	return b.pos;
+}
+
+/* 同vsnprintf,参数为可变参数 */
+uint32_t snprintf(char* buf, uint32_t size, const char* format, ...) {
+	va_list args;
+	uint32_t retval;
+	va_start(args, format);
+	retval = vsnprintf(buf, size, format, args);
+	va_end(args);
+	return retval;
+}
 
-	return strlen(str);
+/* 将参数ap按照格式format输出到字符串str,并返回替换后str长度.不检查边界,新代码应使用vsnprintf */
+uint32_t vsprintf(char* str, const char* format, va_list ap) {
+	return vsnprintf(str, 0xffffffff, format, ap);
 }
 
 /* 同 printf 不同的地方就是字符串不是写到终端，而是写到 buf 中 */
@@ -81,13 +235,36 @@ uint32_t sprintf(char* buf, const char* format, ...) {
 	return retval;
 }
 
+/* printf的sink,攒满缓冲区才调用一次write */
+typedef struct {
+	char buf[PRINTF_BUF_SIZE];
+	uint32_t len;
+} printf_ctx;
 
-/* 格式化输出字符串 format */
+static void printf_sink(void* ctx, const char* s, uint32_t len) {
+	printf_ctx* pc = ctx;
+	while (len > 0) {
+		uint32_t n = PRINTF_BUF_SIZE - pc->len;
+		if (n > len) n = len;
+		memcpy(pc->buf + pc->len, s, n);
+		pc->len += n;
+		s += n;
+		len -= n;
+		if (pc->len == PRINTF_BUF_SIZE) {
+			write(stdout_no, pc->buf, pc->len);
+			pc->len = 0;
+		}
+	}
+}
+
+/* 格式化输出字符串 format,输出长度不受缓冲区大小限制 */
 uint32_t printf(const char* format, ...) {
 	va_list args;
-	va_start(args, format);						// 使args指向 format
-	char buf[1024] = {0};							// 用于存储拼接后的字符串
-	vsprintf(buf, format, args);
+	printf_ctx pc;
+	pc.len = 0;
+	va_start(args, format);
+	uint32_t retval = vformat(printf_sink, &pc, format, args);
 	va_end(args);
-	return write(buf);
-}
\ No newline at end of file
+	if (pc.len > 0) write(stdout_no, pc.buf, pc.len);
+	return retval;
+}
@@ -1,8 +1,23 @@
 #ifndef __LIB_STDIO_H
 #define __LIB_STDIO_H
 #include "stdint.h"
-typedef char* va_list;
+/**
+ * 可变参数用编译器内建的实现.自己按&v推算参数地址依赖于调用约定和栈布局,
+ * 开-O2后可变参数函数被内联到调用者中时,推算出的地址上并没有这些参数
+*/
+typedef __builtin_va_list va_list;
+
+#define va_start(ap, v) __builtin_va_start(ap, v)		// 使ap指向最后一个固定参数v之后的参数
+#define va_arg(ap, t) __builtin_va_arg(ap, t)				// 返回下一个参数的值,t不能是会被提升的char、short
+#define va_end(ap) __builtin_va_end(ap)
+
+/* 格式化输出的去向,vformat每得到一段连续字符就调用一次sink(ctx, 字符串, 长度) */
+typedef void (*fmt_sink)(void* ctx, const char* buf, uint32_t len);
+
+uint32_t vformat(fmt_sink sink, void* ctx, const char* format, va_list ap);
 uint32_t printf(const char* str, ...);
+uint32_t vsnprintf(char* str, uint32_t size, const char* format, va_list ap);
+uint32_t snprintf(char* buf, uint32_t size, const char* format, ...);
 uint32_t vsprintf(char* str, const char* format, va_list ap);
 uint32_t sprintf(char* buf, const char* format, ...);
 #endif
\ No newline at end of file
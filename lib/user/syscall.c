@@ -1,53 +1,64 @@
 #include "syscall.h"
 #include "syscall.h"
 
-/* 无参数的系统调用 */
-#define _syscall0(NUMBER) ({				\
-	int retval;												\
-	asm volatile (										\
-	"int $0x80"												\
-	: "=a" (retval)										\
-	: "a" (NUMBER)										\
-	: "memory"												\
-	);																\
-	retval;														\
+/* 内核在syscall_init中设置好sysenter所需的msr后置为true */
+bool sysenter_enabled;
+
+/**
+ * 是否经sysenter进入内核.
+ * sysexit总是返回3级,而内核线程也会调用这些函数,所以只有在用户态时才走sysenter,否则仍用int 0x80
+*/
+static inline bool use_sysenter(void) {
+	uint32_t cs;
+	asm ("movl %%cs, %0" : "=r" (cs));
+	return sysenter_enabled && (cs & 0x3) == 0x3;
+}
+
+/* 经int 0x80进入内核,参数依次在ebx、ecx、edx中 */
+#define _int80(NUMBER, ARG1, ARG2, ARG3) ({					\
+	int retval;																				\
+	asm volatile (																		\
+		"int $0x80"																			\
+		: "=a" (retval)																	\
+		: "a" (NUMBER), "b" (ARG1), "c" (ARG2), "d" (ARG3)	\
+		: "memory"																			\
+	);																								\
+	retval;																						\
 })
 
-/* 一个参数的系统调用 */
-#define _syscall1(NUMBER, ARG1) ({			       \
-   int retval;					               \
-   asm volatile (					       \
-   "int $0x80"						       \
-   : "=a" (retval)					       \
-   : "a" (NUMBER), "b" (ARG1)				       \
-   : "memory"						       \
-   );							       \
-   retval;						       \
+/**
+ * 经sysenter进入内核.sysenter不保存返回地址和用户栈,
+ * 约定由ecx带上用户栈顶、edx带上返回地址,内核用sysexit返回,因此参数改用ebx、esi、edi
+*/
+#define _sysenter(NUMBER, ARG1, ARG2, ARG3) ({			\
+	int retval;																				\
+	asm volatile (																		\
+		"movl %%esp, %%ecx\n\t"												\
+		"movl $1f, %%edx\n\t"													\
+		"sysenter\n"																		\
+		"1:"																						\
+		: "=a" (retval)																	\
+		: "a" (NUMBER), "b" (ARG1), "S" (ARG2), "D" (ARG3)	\
+		: "ecx", "edx", "memory"												\
+	);																								\
+	retval;																						\
 })
 
+#define _syscall(NUMBER, ARG1, ARG2, ARG3)								\
+	(use_sysenter() ? _sysenter(NUMBER, ARG1, ARG2, ARG3) :	\
+		_int80(NUMBER, ARG1, ARG2, ARG3))
+
+/* 无参数的系统调用 */
+#define _syscall0(NUMBER) _syscall(NUMBER, 0, 0, 0)
+
+/* 一个参数的系统调用 */
+#define _syscall1(NUMBER, ARG1) _syscall(NUMBER, ARG1, 0, 0)
+
 /* 两个参数的系统调用 */
-#define _syscall2(NUMBER, ARG1, ARG2) ({		       \
-   int retval;						       \
-   asm volatile (					       \
-   "int $0x80"						       \
-   : "=a" (retval)					       \
-   : "a" (NUMBER), "b" (ARG1), "c" (ARG2)		       \
-   : "memory"						       \
-   );							       \
-   retval;						       \
-})
+#define _syscall2(NUMBER, ARG1, ARG2) _syscall(NUMBER, ARG1, ARG2, 0)
 
 /* 三个参数的系统调用 */
-#define _syscall3(NUMBER, ARG1, ARG2, ARG3) ({								\
-	int retval;																									\
-	asm volatile(																								\
-		"int $0x80"																								\
-		: "=a" (retval)																						\
-		: "a" (NUMBER), "b" (ARG1), "c" (ARG2), "d" (ARG3)				\
-		: "memory"																								\
-	);																													\
-	retval;																											\
-})
+#define _syscall3(NUMBER, ARG1, ARG2, ARG3) _syscall(NUMBER, ARG1, ARG2, ARG3)
 
 
 /* 返回当前任务pid */
@@ -55,9 +66,14 @@ uint32_t getpid() {
 	return _syscall0(SYS_GETPID);
 }
 
-/* 打印字符串str */
-uint32_t write(char* str) {
-	return _syscall1(SYS_WRITE, str);
+/* 同getpid,但总是经int 0x80进入内核,用于与sysenter比较系统调用的开销 */
+uint32_t getpid_int80(void) {
+	return _int80(SYS_GETPID, 0, 0, 0);
+}
+
+/* 把buf中的count个字节写到文件描述符fd,返回写入的字节数,出错返回-1 */
+int32_t write(int32_t fd, const void* buf, uint32_t count) {
+	return _syscall3(SYS_WRITE, fd, buf, count);
 }
 
 /* 申请 size 字节大小的内存，并返回结果 */
@@ -68,4 +84,69 @@ void* malloc(uint32_t size) {
 /* 释放 ptr 指向的内存 */
 void free(void* ptr) {
 	_syscall1(SYS_FREE, ptr);
-}
\ No newline at end of file
+}
+
+/* 以状态status退出 */
+void exit(int32_t status) {
+	_syscall1(SYS_EXIT, status);
+}
+
+/* 等待子进程,子进程状态存储到status */
+pid_t wait(int32_t* status) {
+	return _syscall1(SYS_WAIT, status);
+}
+
+/* 读取调度事件,buf须能容纳max_cnt条trace_event,返回读到的条数 */
+uint32_t trace_read(void* buf, uint32_t max_cnt) {
+	return _syscall2(SYS_TRACE_READ, buf, max_cnt);
+}
+
+/* 若*uaddr等于expected则睡眠,直到其他任务对uaddr调用futex_wake */
+int32_t futex_wait(uint32_t* uaddr, uint32_t expected) {
+	return _syscall2(SYS_FUTEX_WAIT, uaddr, expected);
+}
+
+/* 唤醒至多nr_wake个在uaddr上睡眠的任务 */
+int32_t futex_wake(uint32_t* uaddr, uint32_t nr_wake) {
+	return _syscall2(SYS_FUTEX_WAKE, uaddr, nr_wake);
+}
+
+/* 读取锁竞争统计,buf须能容纳max_cnt个lock_stat,返回读到的项数,发行版内核恒返回0 */
+uint32_t lockstat_read(void* buf, uint32_t max_cnt) {
+	return _syscall2(SYS_LOCKSTAT_READ, buf, max_cnt);
+}
+
+/* 读取缓冲区缓存的统计,buf须能容纳一个bcache_stat */
+void bcache_stat_read(void* buf) {
+	_syscall1(SYS_BCACHE_STAT, buf);
+}
+
+/* 打开文件pathname,flags为enum oflags,成功返回文件描述符,失败返回-1 */
+int32_t open(const char* pathname, uint8_t flags) {
+	return _syscall2(SYS_OPEN, pathname, flags);
+}
+
+/* 关闭文件描述符fd */
+int32_t close(int32_t fd) {
+	return _syscall1(SYS_CLOSE, fd);
+}
+
+/* 从文件描述符fd读取count个字节到buf */
+int32_t read(int32_t fd, void* buf, uint32_t count) {
+	return _syscall3(SYS_READ, fd, buf, count);
+}
+
+/* 设置文件读写位置,whence为enum whence */
+int32_t lseek(int32_t fd, int32_t offset, uint8_t whence) {
+	return _syscall3(SYS_LSEEK, fd, offset, whence);
+}
+
+/* 建立异步系统调用环,返回与内核共享的uring_ring */
+void* uring_setup(void) {
+	return (void*)_syscall0(SYS_URING_SETUP);
+}
+
+/* 唤醒worker并等待至少min_complete个完成项,返回完成队列中的项数 */
+int32_t uring_enter(uint32_t min_complete) {
+	return _syscall1(SYS_URING_ENTER, min_complete);
+}
@@ -2,17 +2,54 @@
 #define __LIB_USER_SYSCALL_H
 
 #include "stdint.h"
+#include "thread.h"
 
 typedef enum {
 	SYS_GETPID,
 	SYS_WRITE,
 	SYS_MALLOC,
-	SYS_FREE
+	SYS_FREE,
+	SYS_EXIT,
+	SYS_WAIT,
+	SYS_TRACE_READ,
+	SYS_FUTEX_WAIT,
+	SYS_FUTEX_WAKE,
+	SYS_LOCKSTAT_READ,
+	SYS_BCACHE_STAT,
+	SYS_OPEN,
+	SYS_CLOSE,
+	SYS_READ,
+	SYS_LSEEK,
+	SYS_URING_SETUP,
+	SYS_URING_ENTER
 } SYSCALL_NR;
 
+/* 标准输入输出描述符 */
+enum std_fd {
+	stdin_no,					// 0 标准输入
+	stdout_no,				// 1 标准输出
+	stderr_no					// 2 标准错误
+};
+
+
+extern bool sysenter_enabled;
 
 uint32_t getpid(void);
-uint32_t write(char* str);
+uint32_t getpid_int80(void);
+int32_t write(int32_t fd, const void* buf, uint32_t count);
 void* malloc(uint32_t size);
 void free(void* ptr);
+void exit(int32_t status);
+pid_t wait(int32_t* status);
+uint32_t trace_read(void* buf, uint32_t max_cnt);
+int32_t futex_wait(uint32_t* uaddr, uint32_t expected);
+int32_t futex_wake(uint32_t* uaddr, uint32_t nr_wake);
+uint32_t lockstat_read(void* buf, uint32_t max_cnt);
+void bcache_stat_read(void* buf);
+int32_t open(const char* pathname, uint8_t flags);
+int32_t close(int32_t fd);
+int32_t read(int32_t fd, void* buf, uint32_t count);
+int32_t lseek(int32_t fd, int32_t offset, uint8_t whence);
+void* uring_setup(void);
+int32_t uring_enter(uint32_t min_complete);
 #endif
\ No newline at end of file
@@ -0,0 +1,65 @@
+#include "usync.h"
+#include "stdint.h"
+#include "atomic.h"
+#include "syscall.h"
+
+/**
+ * 基于futex的用户态同步原语.
+ * 无竞争时加锁解锁各只需一条原子指令,不陷入内核;
+ * 只有确实要睡眠或确实有等待者要唤醒时才调用futex_wait/futex_wake
+*/
+
+/* 初始化互斥量 */
+void umutex_init(umutex* m) {
+	m->state = 0;
+}
+
+/* 加锁.抢锁失败时把state置为2,表示解锁者须进内核唤醒,然后在state上睡眠 */
+void umutex_lock(umutex* m) {
+	uint32_t c = atomic_cmpxchg(&m->state, 0, 1);
+	if (c == 0) return;
+	if (c != 2) c = atomic_xchg(&m->state, 2);
+	while (c != 0) {
+		futex_wait((uint32_t*)&m->state, 2);
+		c = atomic_xchg(&m->state, 2);
+	}
+}
+
+/* 解锁.state原为1说明没有等待者,直接返回;否则清0并唤醒一个等待者 */
+void umutex_unlock(umutex* m) {
+	if (atomic_xadd(&m->state, (uint32_t)-1) != 1) {
+		m->state = 0;
+		futex_wake((uint32_t*)&m->state, 1);
+	}
+}
+
+/* 初始化条件变量 */
+void ucond_init(ucondvar* c) {
+	c->seq = 0;
+}
+
+/**
+ * 释放m并等待c,返回前重新获得m.
+ * 先记下seq再解锁,若解锁后有人signal,seq已变,futex_wait会立即返回,唤醒不会丢失.
+ * 重新加锁时直接把state置为2,因为可能还有别的等待者被一起唤醒
+*/
+void ucond_wait(ucondvar* c, umutex* m) {
+	uint32_t seq = c->seq;
+	umutex_unlock(m);
+	futex_wait((uint32_t*)&c->seq, seq);
+	while (atomic_xchg(&m->state, 2) != 0) {
+		futex_wait((uint32_t*)&m->state, 2);
+	}
+}
+
+/* 唤醒一个等待c的任务 */
+void ucond_signal(ucondvar* c) {
+	atomic_xadd(&c->seq, 1);
+	futex_wake((uint32_t*)&c->seq, 1);
+}
+
+/* 唤醒所有等待c的任务 */
+void ucond_broadcast(ucondvar* c) {
+	atomic_xadd(&c->seq, 1);
+	futex_wake((uint32_t*)&c->seq, 0xffffffff);
+}
@@ -0,0 +1,24 @@
+#ifndef __LIB_USER_USYNC_H
+#define __LIB_USER_USYNC_H
+
+#include "stdint.h"
+
+/* 用户态互斥量,state取值: 0未加锁, 1已加锁且无等待者, 2已加锁且可能有等待者 */
+typedef struct {
+	volatile uint32_t state;
+} umutex;
+
+/* 用户态条件变量,seq每次signal/broadcast加1,等待者据此判断是否错过了唤醒 */
+typedef struct {
+	volatile uint32_t seq;
+} ucondvar;
+
+void umutex_init(umutex* m);
+void umutex_lock(umutex* m);
+void umutex_unlock(umutex* m);
+void ucond_init(ucondvar* c);
+void ucond_wait(ucondvar* c, umutex* m);
+void ucond_signal(ucondvar* c);
+void ucond_broadcast(ucondvar* c);
+
+#endif
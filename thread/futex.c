@@ -0,0 +1,91 @@
+#include "futex.h"
+#include "global.h"
+#include "stdint.h"
+#include "list.h"
+#include "thread.h"
+#include "interrupt.h"
+#include "memory.h"
+#include "wait_queue.h"
+#include "print.h"
+#include "debug.h"
+
+#define FUTEX_HASH_SIZE 64				// 哈希桶个数,须为2的幂
+
+/**
+ * 快速用户态互斥(futex).
+ * 用户态同步原语在无竞争时只用原子指令,有竞争时才陷入内核在futex字上睡眠.
+ * 等待者以futex字的物理地址为键,共享同一物理页的不同进程也能相互唤醒.
+ * 等待者挂在按键哈希的桶中,一个桶中可能有多个不同键的等待者,唤醒时按futex_key筛选
+*/
+static wait_queue futex_hash[FUTEX_HASH_SIZE];
+
+/* 物理地址的低2位恒为0(futex字4字节对齐),取其上的位做哈希 */
+static inline wait_queue* futex_bucket(uint32_t key) {
+	return &futex_hash[(key >> 2) & (FUTEX_HASH_SIZE - 1)];
+}
+
+/* 检查uaddr是否为当前进程中已映射、4字节对齐的用户地址,是则返回其物理地址,否则返回0 */
+static uint32_t futex_key(uint32_t* uaddr) {
+	uint32_t vaddr = (uint32_t)uaddr;
+	if ((vaddr & 3) != 0 || vaddr >= 0xc0000000 || running_thread()->pgdir == NULL) {
+		return 0;
+	}
+	if (!(*pde_ptr(vaddr) & PG_P_1) || !(*pte_ptr(vaddr) & PG_P_1) || !(*pte_ptr(vaddr) & PG_US_U)) {
+		return 0;
+	}
+	return addr_v2p(vaddr);
+}
+
+/**
+ * 若*uaddr仍等于expected,就在uaddr上睡眠直到被futex_wake唤醒,返回0.
+ * 若*uaddr已不等于expected,说明等待期间值已被别的线程改过,直接返回-1,由用户态重试.
+ * 比较和入队在关中断下完成,唤醒者修改futex字后的唤醒不会丢失
+*/
+int32_t sys_futex_wait(uint32_t* uaddr, uint32_t expected) {
+	intr_status old_status = intr_disable();
+	uint32_t key = futex_key(uaddr);
+	if (key == 0 || *(volatile uint32_t*)uaddr != expected) {
+		intr_set_status(old_status);
+		return -1;
+	}
+	running_thread()->futex_key = key;
+	wq_wait(futex_bucket(key), true);
+	intr_set_status(old_status);
+	return 0;
+}
+
+/* 唤醒至多nr_wake个在uaddr上睡眠的任务,返回唤醒的个数,地址非法时返回-1 */
+int32_t sys_futex_wake(uint32_t* uaddr, uint32_t nr_wake) {
+	intr_status old_status = intr_disable();
+	uint32_t key = futex_key(uaddr);
+	if (key == 0) {
+		intr_set_status(old_status);
+		return -1;
+	}
+
+	int32_t woken = 0;
+	list* plist = &futex_bucket(key)->task_list;
+	list_elem* pelem = plist->head.next;
+	while (pelem != &plist->tail && (uint32_t)woken < nr_wake) {
+		list_elem* next = pelem->next;
+		task_struct* pthread = elem2entry(task_struct, general_tag, pelem);
+		if (pthread->futex_key == key) {
+			list_remove(pelem);
+			thread_unblock(pthread);
+			++woken;
+		}
+		pelem = next;
+	}
+	intr_set_status(old_status);
+	return woken;
+}
+
+/* 初始化futex哈希表 */
+void futex_init(void) {
+	put_str("futex_init start\n");
+	uint32_t i;
+	for (i = 0; i < FUTEX_HASH_SIZE; ++i) {
+		wq_init(&futex_hash[i]);
+	}
+	put_str("futex_init done\n");
+}
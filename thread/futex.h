@@ -0,0 +1,10 @@
+#ifndef __THREAD_FUTEX_H
+#define __THREAD_FUTEX_H
+
+#include "stdint.h"
+
+int32_t sys_futex_wait(uint32_t* uaddr, uint32_t expected);
+int32_t sys_futex_wake(uint32_t* uaddr, uint32_t nr_wake);
+void futex_init(void);
+
+#endif
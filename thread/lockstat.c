@@ -0,0 +1,132 @@
+#include "lockstat.h"
+#include "global.h"
+#include "stdint.h"
+#include "string.h"
+#include "interrupt.h"
+#include "stdio.h"
+#include "console.h"
+#include "debug.h"
+#include "memory.h"
+
+#ifndef NDEBUG
+
+static lock_stat lockstat_table[LOCKSTAT_MAX];
+static uint32_t lockstat_cnt;						// lockstat_table中已用的项数
+
+/**
+ * 在lock_init中调用,返回名为name的统计项,没有则新建.
+ * 统计项用满后新名字的锁都记在最后一项"(other)"中
+*/
+lock_stat* lockstat_register(const char* name) {
+	intr_status old_status = intr_disable();
+	uint32_t i;
+	lock_stat* stat = NULL;
+	for (i = 0; i < lockstat_cnt; ++i) {
+		if (strcmp(lockstat_table[i].name, name) == 0) {
+			stat = &lockstat_table[i];
+			break;
+		}
+	}
+	if (stat == NULL) {
+		if (lockstat_cnt == LOCKSTAT_MAX - 1) {
+			stat = &lockstat_table[LOCKSTAT_MAX - 1];
+			strcpy(stat->name, "(other)");
+		} else {
+			stat = &lockstat_table[lockstat_cnt++];
+			uint32_t len = strlen(name);
+			if (len >= LOCKSTAT_NAME_LEN) len = LOCKSTAT_NAME_LEN - 1;
+			memcpy(stat->name, name, len);
+			stat->name[len] = 0;
+		}
+	}
+	intr_set_status(old_status);
+	return stat;
+}
+
+/* 在lock_acquire获得锁后调用,调用者须已关中断 */
+void lockstat_acquired(lock_stat* stat, bool contended, uint64_t wait) {
+	ASSERT(intr_get_status() == INTR_OFF);
+	++stat->acquired;
+	if (contended) {
+		++stat->contended;
+		stat->wait_total += wait;
+		if (wait > stat->wait_max) stat->wait_max = wait;
+	}
+}
+
+/* 把全部统计项复制到内核缓冲区buf中,最多max_cnt项,返回复制的项数 */
+static uint32_t lockstat_snapshot(lock_stat* buf, uint32_t max_cnt) {
+	intr_status old_status = intr_disable();
+	uint32_t cnt = lockstat_cnt;
+	if (lockstat_table[LOCKSTAT_MAX - 1].name[0] != 0) cnt = LOCKSTAT_MAX;
+	if (cnt > max_cnt) cnt = max_cnt;
+	memcpy(buf, lockstat_table, cnt * sizeof(lock_stat));
+	intr_set_status(old_status);
+	return cnt;
+}
+
+/**
+ * 把全部统计项复制到用户缓冲区buf中,最多max_cnt项,返回复制的项数,buf不是可写的用户内存时返回0.
+ * buf事先已按页表检查过,关中断复制时不会发生page fault
+*/
+uint32_t sys_lockstat_read(lock_stat* buf, uint32_t max_cnt) {
+	if (max_cnt > LOCKSTAT_MAX) max_cnt = LOCKSTAT_MAX;
+	if (!user_range_ok(buf, max_cnt * sizeof(lock_stat), true)) return 0;
+	return lockstat_snapshot(buf, max_cnt);
+}
+
+/* 将64位数v以十六进制格式化到长为size的buf,返回buf */
+static char* format_u64(char* buf, uint32_t size, uint64_t v) {
+	uint32_t high = (uint32_t)(v >> 32);
+	if (high == 0) {
+		snprintf(buf, size, "%x", (uint32_t)v);
+	} else {
+		snprintf(buf, size, "%x%08x", high, (uint32_t)v);
+	}
+	return buf;
+}
+
+/**
+ * 按等待总时长从大到小在终端打印锁统计表,每行一个锁:
+ *   名字 获得次数 竞争次数 等待总时长 最长等待 持有总时长
+ * 次数为十进制,时长为十六进制的tsc周期数
+*/
+void lockstat_dump(void) {
+	static lock_stat snap[LOCKSTAT_MAX];		// 放在栈上太大
+	uint32_t cnt = lockstat_snapshot(snap, LOCKSTAT_MAX);
+
+	/* 项数很少,插入排序即可 */
+	uint32_t i, j;
+	for (i = 1; i < cnt; ++i) {
+		lock_stat tmp = snap[i];
+		for (j = i; j > 0 && snap[j - 1].wait_total < tmp.wait_total; --j) {
+			snap[j] = snap[j - 1];
+		}
+		snap[j] = tmp;
+	}
+
+	char line[128];
+	char wait_total[17], wait_max[17], hold_total[17];
+	console_put_str("name             acquired   contended  wait_total       wait_max         hold_total\n");
+	for (i = 0; i < cnt; ++i) {
+		snprintf(line, sizeof(line), "%-16s %-10u %-10u %-16s %-16s %s\n", snap[i].name,
+			snap[i].acquired, snap[i].contended,
+			format_u64(wait_total, sizeof(wait_total), snap[i].wait_total),
+			format_u64(wait_max, sizeof(wait_max), snap[i].wait_max),
+			format_u64(hold_total, sizeof(hold_total), snap[i].hold_total));
+		console_put_str(line);
+	}
+}
+
+#else
+
+/* 发行版不统计 */
+uint32_t sys_lockstat_read(lock_stat* buf, uint32_t max_cnt) {
+	(void)buf;
+	(void)max_cnt;
+	return 0;
+}
+
+void lockstat_dump(void) {}
+
+#endif
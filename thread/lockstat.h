@@ -0,0 +1,31 @@
+#ifndef __THREAD_LOCKSTAT_H
+#define __THREAD_LOCKSTAT_H
+
+#include "stdint.h"
+#include "global.h"
+
+#define LOCKSTAT_MAX 32							// 最多统计多少个不同名字的锁
+#define LOCKSTAT_NAME_LEN 16
+
+/**
+ * 锁的竞争统计,以lock_init时给出的名字为键,同名的锁共用一项.
+ * 时间单位均为tsc时钟周期.只在调试版中统计,发行版(定义了NDEBUG)中锁里不含统计字段,
+ * 加锁解锁路径上也没有任何统计代码
+*/
+typedef struct {
+	char name[LOCKSTAT_NAME_LEN];
+	uint32_t acquired;								// 获得锁的次数,不含重入
+	uint32_t contended;								// 申请时锁已被他人持有的次数
+	uint64_t wait_total;							// 等待锁的总时长
+	uint64_t wait_max;								// 单次等待锁的最长时长
+	uint64_t hold_total;							// 持有锁的总时长
+} lock_stat;
+
+#ifndef NDEBUG
+lock_stat* lockstat_register(const char* name);
+void lockstat_acquired(lock_stat* stat, bool contended, uint64_t wait);
+#endif
+uint32_t sys_lockstat_read(lock_stat* buf, uint32_t max_cnt);
+void lockstat_dump(void);
+
+#endif
@@ -5,18 +5,28 @@
 #include "thread.h"
 #include "interrupt.h"
 #include "debug.h"
+#include "atomic.h"
+#include "tsc.h"
+
+#define PI_MAX_DEPTH 8					// 优先级捐赠沿锁链传递的最大深度,防止死锁成环时无限循环
 
 /* 初始化信号量 */
 void sema_init(semaphore *psema, uint8_t value) {
 	psema->value = value;
-	list_init(&psema->waiters);
+	wq_init(&psema->waiters);
 }
 
-/* 初始化锁plock */
-void lock_init(lock *plock) {
+/* 初始化锁plock,name用作竞争统计的键 */
+void lock_init(lock *plock, const char *name) {
 	plock->holder = NULL;
 	plock->holder_repeat_nr = 0;
 	sema_init(&plock->semaphore, 1);		// 信号量初值为1
+#ifndef NDEBUG
+	plock->stat = lockstat_register(name);
+	plock->hold_stamp = 0;
+#else
+	(void)name;
+#endif
 }
 
 /* 信号量down操作 */
@@ -24,15 +34,8 @@ void sema_down(semaphore *psema) {
 	/* 关中断来保证原子操作 */
 	intr_status old_status = intr_disable();
 	while (psema->value == 0) {		// 若value为0,表示已经被别人持有
-		ASSERT(!elem_find(&psema->waiters, &running_thread()->general_tag));
-		/* 当前线程不应该已在信号量的waiters队列中 */
-		if (elem_find(&psema->waiters, &running_thread()->general_tag)) {
-			PANIC("sema_down: thread blocked has been in waiters_list\n");
-		}
-
-		/* 若信号量的值等于0,则当前线程把自己加入该锁的等待队列,然后阻塞自己 */
-		list_append(&psema->waiters, &running_thread()->general_tag);
-		thread_block(TASK_BLOCKED);
+		/* 若信号量的值等于0,则当前线程独占地等在信号量的等待队列上,每次up只唤醒一个 */
+		wq_wait(&psema->waiters, true);
 	}
 
 	/* 若value大于0或被唤醒后,会执行下面的代码,也就是获得了锁 */
@@ -40,25 +43,73 @@ void sema_down(semaphore *psema) {
 	intr_set_status(old_status);
 }
 
-/* 信号量up操作 */
+/* 信号量up操作,唤醒等待队列中优先级最高的线程 */
 void sema_up(semaphore *psema) {
 	/* 关中断来保证原子操作 */
 	intr_status old_status = intr_disable();
-	if (psema->value == 0 && !list_empty(&psema->waiters)) {
-		task_struct *thread_blocked = elem2entry(task_struct, general_tag, list_pop(&psema->waiters));
-		thread_unblock(thread_blocked);
-	}
 	++psema->value;
+	wq_wake_one(&psema->waiters);
 	intr_set_status(old_status);
 }
 
+/**
+ * 把当前线程的优先级沿锁链捐赠出去:
+ * 当前线程等待的锁的持有者若优先级更低就提升它,若该持有者也在等锁则继续向下传递.
+ * 被提升的持有者若正在某个锁的等待队列中,要按新优先级重新排队.调用者须已关中断
+*/
+static void priority_donate(task_struct *donor) {
+	uint32_t depth = 0;
+	while (donor->waiting_lock != NULL && depth++ < PI_MAX_DEPTH) {
+		task_struct *holder = donor->waiting_lock->holder;
+		if (holder == NULL || holder->priority >= donor->priority) break;
+
+		thread_set_priority(holder, donor->priority);
+		if (holder->waiting_lock != NULL) {
+			wq_requeue(&holder->waiting_lock->semaphore.waiters, holder);
+		}
+		donor = holder;
+	}
+}
+
+/* 重新计算pthread的有效优先级:原始优先级与所持各锁中最高等待者优先级的较大者.调用者须已关中断 */
+static void priority_restore(task_struct *pthread) {
+	uint8_t prio = pthread->base_priority;
+	list_elem *pelem = pthread->held_locks.head.next;
+	while (pelem != &pthread->held_locks.tail) {
+		lock *plock = elem2entry(lock, holder_tag, pelem);
+		/* 等待队列按优先级排列,队首即最高 */
+		task_struct *waiter = wq_first(&plock->semaphore.waiters);
+		if (waiter != NULL && waiter->priority > prio) prio = waiter->priority;
+		pelem = pelem->next;
+	}
+	thread_set_priority(pthread, prio);
+}
+
 /* 获取锁plock */
 void lock_acquire(lock *plock) {
-	if (plock->holder != running_thread()) {
+	task_struct *cur = running_thread();
+	if (plock->holder != cur) {
+		/* 从检查持有者到登记为新持有者须是原子的,否则捐赠可能落到已经释放锁的线程上 */
+		intr_status old_status = intr_disable();
+#ifndef NDEBUG
+		uint64_t wait_start = rdtsc();
+		bool contended = plock->holder != NULL;
+#endif
+		if (plock->holder != NULL) {
+			cur->waiting_lock = plock;
+			priority_donate(cur);
+		}
 		sema_down(&plock->semaphore);			// 对信号量P操作，原子操作
-		plock->holder = running_thread();
+		cur->waiting_lock = NULL;
+		plock->holder = cur;
 		ASSERT(plock->holder_repeat_nr == 0);
 		plock->holder_repeat_nr = 1;
+		list_append(&cur->held_locks, &plock->holder_tag);
+#ifndef NDEBUG
+		plock->hold_stamp = rdtsc();
+		lockstat_acquired(plock->stat, contended, plock->hold_stamp - wait_start);
+#endif
+		intr_set_status(old_status);
 	} else {
 		++plock->holder_repeat_nr;
 	}
@@ -66,14 +117,165 @@ void lock_acquire(lock *plock) {
 
 /* 释放锁 plock */
 void lock_release(lock *plock) {
-	ASSERT(plock->holder == running_thread());
+	task_struct *cur = running_thread();
+	ASSERT(plock->holder == cur);
 	if (plock->holder_repeat_nr > 1) {
 		--plock->holder_repeat_nr;
 		return;
 	}
 
 	ASSERT(plock->holder_repeat_nr == 1);
+	intr_status old_status = intr_disable();
+#ifndef NDEBUG
+	plock->stat->hold_total += rdtsc() - plock->hold_stamp;
+#endif
+	list_remove(&plock->holder_tag);
 	plock->holder = NULL;								// 把锁的持有者置空放在 V 操作之前
 	plock->holder_repeat_nr = 0;
+	priority_restore(cur);							// 撤销因此锁得到的优先级提升
 	sema_up(&plock->semaphore);					// 信号量的V操作，也是原子操作
-}
\ No newline at end of file
+	intr_set_status(old_status);
+
+	/* 被唤醒的等待者优先级更高时立即让出cpu,中断处理程序中不能让出 */
+	if (old_status == INTR_ON) thread_preempt();
+}
+
+/* 初始化互斥量 */
+void mutex_init(mutex *pmutex) {
+	pmutex->state = MUTEX_UNLOCKED;
+	pmutex->owner = NULL;
+	wq_init(&pmutex->waiters);
+}
+
+/**
+ * 对互斥量加锁.
+ * 快速路径用cmpxchg把state由UNLOCKED改为LOCKED,成功即返回.
+ * 否则关中断进入慢速路径:把state换成CONTENDED,换出的旧值若是UNLOCKED说明锁已被释放,
+ * 直接拿到锁;否则进等待队列阻塞,被唤醒后重试.
+ * 单cpu上持有者不可能与等待者同时在运行,原地自旋等待只会白白耗掉时间片,所以竞争时直接阻塞
+*/
+void mutex_lock(mutex *pmutex) {
+	task_struct *cur = running_thread();
+	ASSERT(pmutex->owner != cur);
+	if (atomic_cmpxchg(&pmutex->state, MUTEX_UNLOCKED, MUTEX_LOCKED) != MUTEX_UNLOCKED) {
+		intr_status old_status = intr_disable();
+		while (atomic_xchg(&pmutex->state, MUTEX_CONTENDED) != MUTEX_UNLOCKED) {
+			wq_wait(&pmutex->waiters, true);
+		}
+		intr_set_status(old_status);
+	}
+	pmutex->owner = cur;
+}
+
+/* 尝试对互斥量加锁,不阻塞,成功返回true */
+bool mutex_trylock(mutex *pmutex) {
+	if (atomic_cmpxchg(&pmutex->state, MUTEX_UNLOCKED, MUTEX_LOCKED) != MUTEX_UNLOCKED) {
+		return false;
+	}
+	pmutex->owner = running_thread();
+	return true;
+}
+
+/**
+ * 对互斥量解锁.
+ * 快速路径用cmpxchg把state由LOCKED改回UNLOCKED;若state为CONTENDED则关中断,
+ * 置为UNLOCKED后唤醒优先级最高的等待者,由它重新竞争
+*/
+void mutex_unlock(mutex *pmutex) {
+	ASSERT(pmutex->owner == running_thread());
+	pmutex->owner = NULL;
+	if (atomic_cmpxchg(&pmutex->state, MUTEX_LOCKED, MUTEX_UNLOCKED) == MUTEX_LOCKED) {
+		return;
+	}
+
+	intr_status old_status = intr_disable();
+	pmutex->state = MUTEX_UNLOCKED;
+	wq_wake_one(&pmutex->waiters);
+	intr_set_status(old_status);
+
+	if (old_status == INTR_ON) thread_preempt();
+}
+
+/* 初始化读写锁 */
+void rwlock_init(rwlock *prw) {
+	prw->readers = 0;
+	prw->writer = NULL;
+	wq_init(&prw->read_waiters);
+	wq_init(&prw->write_waiters);
+}
+
+/* 获取读锁,有写者持有或等待时阻塞 */
+void read_lock(rwlock *prw) {
+	intr_status old_status = intr_disable();
+	ASSERT(prw->writer != running_thread());
+	while (prw->writer != NULL || !wq_empty(&prw->write_waiters)) {
+		wq_wait(&prw->read_waiters, false);
+	}
+	++prw->readers;
+	intr_set_status(old_status);
+}
+
+/* 释放读锁,最后一个读者离开时唤醒一个写者 */
+void read_unlock(rwlock *prw) {
+	intr_status old_status = intr_disable();
+	ASSERT(prw->readers > 0);
+	if (--prw->readers == 0) {
+		wq_wake_one(&prw->write_waiters);
+	}
+	intr_set_status(old_status);
+}
+
+/* 获取写锁,有读者或写者持有时阻塞 */
+void write_lock(rwlock *prw) {
+	intr_status old_status = intr_disable();
+	task_struct *cur = running_thread();
+	ASSERT(prw->writer != cur);
+	while (prw->writer != NULL || prw->readers > 0) {
+		wq_wait(&prw->write_waiters, true);
+	}
+	prw->writer = cur;
+	intr_set_status(old_status);
+}
+
+/* 释放写锁,优先唤醒一个写者,没有写者等待时唤醒全部读者 */
+void write_unlock(rwlock *prw) {
+	intr_status old_status = intr_disable();
+	ASSERT(prw->writer == running_thread());
+	prw->writer = NULL;
+	if (!wq_empty(&prw->write_waiters)) {
+		wq_wake_one(&prw->write_waiters);
+	} else {
+		wq_wake_all(&prw->read_waiters);
+	}
+	intr_set_status(old_status);
+
+	if (old_status == INTR_ON) thread_preempt();
+}
+
+/* 初始化条件变量 */
+void cond_init(condvar *pcond) {
+	wq_init(&pcond->waiters);
+}
+
+/**
+ * 释放pmutex并等待条件变量pcond,被唤醒后重新获得pmutex再返回.
+ * 解锁和入队阻塞在关中断下完成,signal不会落在解锁与阻塞之间而丢失.
+ * 被唤醒不代表条件一定成立,调用者应在循环中重新检查条件
+*/
+void cond_wait(condvar *pcond, mutex *pmutex) {
+	intr_status old_status = intr_disable();
+	mutex_unlock(pmutex);
+	wq_wait(&pcond->waiters, true);
+	intr_set_status(old_status);
+	mutex_lock(pmutex);
+}
+
+/* 唤醒一个等待pcond的线程 */
+void cond_signal(condvar *pcond) {
+	wq_wake_one(&pcond->waiters);
+}
+
+/* 唤醒所有等待pcond的线程 */
+void cond_broadcast(condvar *pcond) {
+	wq_wake_all(&pcond->waiters);
+}
@@ -4,25 +4,81 @@
 #include "list.h"
 #include "stdint.h"
 #include "thread.h"
+#include "wait_queue.h"
+#include "lockstat.h"
 
 /* 信号量结构 */
 typedef struct {
 	uint8_t value;
-	list waiters;
+	wait_queue waiters;
 } semaphore;
 
-/* 锁结构 */
-typedef struct {
+/**
+ * 锁结构.
+ * 锁支持优先级继承:等待者会把持有者的有效优先级提升到自己的优先级,
+ * 持有者又在等别的锁时沿锁链继续传递,释放锁时持有者的优先级恢复
+*/
+typedef struct lock {
 	task_struct *holder;				// 锁的持有者
-	semaphore semaphore;				// 用二元信号量实现锁
+	semaphore semaphore;				// 用二元信号量实现锁,waiters按优先级从高到低排列
 	uint32_t holder_repeat_nr;	// 锁的持有者重复申请锁的次数
+	list_elem holder_tag;				// 用于持有者的held_locks队列中的结点
+#ifndef NDEBUG
+	lock_stat *stat;						// 竞争统计项,见lockstat.h
+	uint64_t hold_stamp;				// 最近一次获得锁的时间戳
+#endif
 } lock;
 
+/**
+ * 互斥量.
+ * 与lock不同,mutex不可重入,未竞争时加锁和解锁只需一条原子指令,不开关中断.
+ * 竞争时才关中断进入等待队列.state只用原子指令修改
+*/
+typedef struct {
+	volatile uint32_t state;		// MUTEX_UNLOCKED/MUTEX_LOCKED/MUTEX_CONTENDED
+	task_struct *owner;					// 持有者,仅用于检查误用
+	wait_queue waiters;					// 等待者,按优先级从高到低排列
+} mutex;
+
+#define MUTEX_UNLOCKED 0				// 未加锁
+#define MUTEX_LOCKED 1					// 已加锁且没有等待者
+#define MUTEX_CONTENDED 2				// 已加锁且可能有等待者,解锁时须走慢速路径唤醒
+
+/**
+ * 读写锁.
+ * 多个读者可同时持有,写者独占.写者优先:有写者等待时新读者也要等待,
+ * 避免读者源源不断时写者饿死
+*/
+typedef struct {
+	uint32_t readers;						// 当前持有读锁的线程数
+	task_struct *writer;				// 当前持有写锁的线程
+	wait_queue read_waiters;		// 等待读锁的线程,非独占等待
+	wait_queue write_waiters;		// 等待写锁的线程,独占等待
+} rwlock;
+
+/* 条件变量,须与mutex配合使用 */
+typedef struct {
+	wait_queue waiters;					// 等待条件成立的线程,按优先级从高到低排列
+} condvar;
+
 void sema_init(semaphore* psema, uint8_t value); 
 void sema_down(semaphore* psema);
 void sema_up(semaphore* psema);
-void lock_init(lock* plock);
+void lock_init(lock* plock, const char* name);
 void lock_acquire(lock* plock);
 void lock_release(lock* plock);
+void mutex_init(mutex* pmutex);
+void mutex_lock(mutex* pmutex);
+bool mutex_trylock(mutex* pmutex);
+void mutex_unlock(mutex* pmutex);
+void rwlock_init(rwlock* prw);
+void read_lock(rwlock* prw);
+void read_unlock(rwlock* prw);
+void write_lock(rwlock* prw);
+void write_unlock(rwlock* prw);
+void cond_init(condvar* pcond);
+void cond_wait(condvar* pcond, mutex* pmutex);
+void cond_signal(condvar* pcond);
+void cond_broadcast(condvar* pcond);
 
 #endif
\ No newline at end of file
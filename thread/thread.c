@@ -9,12 +9,33 @@
 #include "list.h"
 #include "process.h"
 #include "sync.h"
+#include "fpu.h"
+#include "bitmap.h"
+#include "wait_exit.h"
+#include "trace.h"
 
 task_struct *main_thread;			// 主线程PCB
+task_struct *idle_thread;			// idle线程
 list thread_ready_list;				// 就绪队列
+bool need_resched;					// 是否需要在中断退出时重新调度
 list thread_all_list;					// 所有任务队列
 static list_elem *thread_tag;	// 用于保存队列中的线程结点
-lock pid_lock;								// 分配 pid 锁
+
+#define MAX_PID_CNT 1024				// 最多同时存在的任务数
+
+/* pid位图,最大支持1024个pid */
+static uint8_t pid_bitmap_bits[MAX_PID_CNT / 8];
+
+/* 已释放的pid在位图中的下标,后释放的先复用 */
+static uint16_t pid_free_stack[MAX_PID_CNT];
+
+/* pid池 */
+static struct {
+	bitmap pid_bitmap;						// pid位图
+	pid_t pid_start;							// 起始pid
+	uint32_t free_top;						// pid_free_stack中的元素个数
+	lock pid_lock;								// 分配 pid 锁
+} pid_pool;
 
 extern void switch_to(task_struct *cur, task_struct *next);
 
@@ -32,15 +53,46 @@ static void kernel_thread(thread_func *function, void *func_arg) {
 	/* 执行function前要开中断,避免后面的时钟中断被屏蔽,而无法调度其他线程 */
 	intr_enable();
 	function(func_arg);
+	/* 线程函数返回即线程结束,退出后等待父进程回收 */
+	sys_exit(0);
+}
+
+/* 初始化pid池 */
+static void pid_pool_init(void) {
+	pid_pool.pid_start = 1;
+	pid_pool.pid_bitmap.bits = pid_bitmap_bits;
+	pid_pool.pid_bitmap.btmp_bytes_len = MAX_PID_CNT / 8;
+	bitmap_init(&pid_pool.pid_bitmap);
+	pid_pool.free_top = 0;
+	lock_init(&pid_pool.pid_lock, "pid_lock");
 }
 
 /* 分配 pid */
 static pid_t allocate_pid(void) {
-	static pid_t next_pid = 0;
-	lock_acquire(&pid_lock);
-	++next_pid;
-	lock_release(&pid_lock);
-	return next_pid;
+	lock_acquire(&pid_pool.pid_lock);
+	int32_t bit_idx;
+	/* 优先复用已释放的pid,不必扫描位图.栈中的pid必定空闲,因为只有栈空时才扫描位图 */
+	if (pid_pool.free_top > 0) {
+		bit_idx = pid_free_stack[--pid_pool.free_top];
+	} else {
+		bit_idx = bitmap_scan(&pid_pool.pid_bitmap, 1);
+	}
+	if (bit_idx == -1) {
+		PANIC("allocate_pid: no pid left");
+	}
+	bitmap_set(&pid_pool.pid_bitmap, bit_idx, 1);
+	lock_release(&pid_pool.pid_lock);
+	return (bit_idx + pid_pool.pid_start);
+}
+
+/* 释放 pid */
+void release_pid(pid_t pid) {
+	lock_acquire(&pid_pool.pid_lock);
+	int32_t bit_idx = pid - pid_pool.pid_start;
+	ASSERT(bitmap_scan_test(&pid_pool.pid_bitmap, bit_idx));
+	bitmap_set(&pid_pool.pid_bitmap, bit_idx, 0);
+	pid_free_stack[pid_pool.free_top++] = bit_idx;
+	lock_release(&pid_pool.pid_lock);
 }
 
 /* 初始化线程栈thread_stack,将待执行的函数和参数放到thread_stack中相应的位置 */
@@ -61,23 +113,41 @@ void thread_create(task_struct *pthread, thread_func function, void *func_arg) {
 /* 初始化线程基本信息 */
 void init_thread(task_struct *pthread, char *name, int prio) {
 	memset(pthread, 0, sizeof(*pthread));
+	/* 优先级和已持有锁队列须在allocate_pid之前初始化,主线程会以自身身份申请pid_lock */
+	pthread->priority = prio;
+	pthread->base_priority = prio;
+	pthread->waiting_lock = NULL;
+	list_init(&pthread->held_locks);
 	pthread->pid = allocate_pid();
 	strcpy(pthread->name, name);
 
 	if (pthread == main_thread) {
 		/* 由于把main函数也封装成一个线程,并且它一直是运行的,故将其直接设为TASK_RUNNING */
 		pthread->status = TASK_RUNNING;
+		pthread->parent_pid = -1;
 	} else {
 		pthread->status = TASK_READY;
+		pthread->parent_pid = running_thread()->pid;		// 创建者即为父进程
 	}
 
 	/* self_kstack是线程自己在内核态下使用的栈顶地址 */
 	pthread->self_kstack = (uint32_t*)((uint32_t)pthread + PG_SIZE);
-	pthread->priority = prio;
 	pthread->ticks = prio;
 	pthread->elapsed_ticks = 0;
 	pthread->pgdir = NULL;
+
+	/* 预留标准输入输出 */
+	pthread->fd_table[0] = 0;
+	pthread->fd_table[1] = 1;
+	pthread->fd_table[2] = 2;
+	/* 其余的全置为-1 */
+	uint8_t fd_idx = 3;
+	while (fd_idx < MAX_FILES_OPEN_PER_PROC) {
+		pthread->fd_table[fd_idx] = -1;
+		fd_idx++;
+	}
 	pthread->stack_magic = 0x19870916;				// 自定义的魔数
+	trace_task_init(pthread);
 }
 
 /* 创建一优先级为prio的线程,线程名为name,线程所执行的函数是function(func_arg) */
@@ -89,15 +159,17 @@ task_struct* thread_start(char *name, int prio, thread_func function, void *func
 	init_thread(thread, name, prio);
 	thread_create(thread, function, func_arg);
 
+	intr_status old_status = intr_disable();
 	/* 确保之前不在队列中 */
-	ASSERT(!elem_find(&thread_ready_list, &thread->general_tag));
+	ASSERT(!elem_in_list(&thread_ready_list, &thread->general_tag));
 	/* 加入就绪线程队列 */
 	list_append(&thread_ready_list, &thread->general_tag);
 
 	/* 确保之前不在队列中 */
-	ASSERT(!elem_find(&thread_all_list, &thread->all_list_tag));
+	ASSERT(!elem_in_list(&thread_all_list, &thread->all_list_tag));
 	/* 加入全部线程队列 */
 	list_append(&thread_all_list, &thread->all_list_tag);
+	intr_set_status(old_status);
 
 	return thread;
 }
@@ -111,17 +183,26 @@ static void make_main_thread(void) {
 	init_thread(main_thread, "main", 31);
 
 	/* main函数是当前线程,当前线程不在thread_ready_list中,所以只将其加在thread_all_list中 */
-	ASSERT(!elem_find(&thread_all_list, &main_thread->all_list_tag));
+	ASSERT(!elem_in_list(&thread_all_list, &main_thread->all_list_tag));
 	list_append(&thread_all_list, &main_thread->all_list_tag);
 }
 
+/* 系统空闲时运行的线程 */
+static void idle(void* arg UNUSED) {
+	while (1) {
+		thread_block(TASK_BLOCKED);
+		/* 执行hlt时必须要保证目前处在开中断的情况下 */
+		asm volatile ("sti; hlt" : : : "memory");
+	}
+}
+
 /* 实现任务调度 */
 void schedule() {
 	ASSERT(intr_get_status() == INTR_OFF);
 	task_struct* cur = running_thread();
 	if (cur->status == TASK_RUNNING) {
 		// 若此线程只是cpu时间片到了,将其加入到就绪队列尾
-		ASSERT(!elem_find(&thread_ready_list, &cur->general_tag));
+		ASSERT(!elem_in_list(&thread_ready_list, &cur->general_tag));
 		list_append(&thread_ready_list, &cur->general_tag);
 
 		cur->ticks = cur->priority; // 重新将当前线程的ticks再重置为其priority
@@ -130,7 +211,11 @@ void schedule() {
 		/* 若此线程需要某事件发生后才能继续上cpu运行,不需要将其加入队列,因为当前线程不在就绪队列中 */
 	}
 
-	ASSERT(!list_empty(&thread_ready_list));
+	/* 如果就绪队列中没有可运行的任务,就唤醒idle */
+	if (list_empty(&thread_ready_list)) {
+		thread_unblock(idle_thread);
+	}
+	need_resched = false;
 	thread_tag = NULL;				// thread_tag清空
 	/* 将 thread_ready_list 队列中的第一个就绪线程弹出,准备将其调度上cpu */
 	thread_tag = list_pop(&thread_ready_list);
@@ -139,6 +224,8 @@ void schedule() {
 
 	/* 激活任务页表等 */
 	process_activate(next);
+	fpu_switch(next);					// fpu上下文惰性切换,此处只设置cr0.TS
+	trace_switch(cur, next);
 	switch_to(cur, next);
 }
 
@@ -147,19 +234,22 @@ void thread_init(void) {
 	put_str("thread_init start\n");
 	list_init(&thread_ready_list);	
 	list_init(&thread_all_list);
-	lock_init(&pid_lock);
+	pid_pool_init();
 	/* 将当前main函数创建为线程 */
 	make_main_thread();
+	/* 创建idle线程,所有任务都阻塞时(如初始化期间等待磁盘)由它让cpu停机等待中断 */
+	idle_thread = thread_start("idle", 10, idle, NULL);
 	put_str("thread_init done\n");
 }
 
 void thread_block(task_status stat) {
-	/* stat的取值为TASK_BLOCKED,TASK_WAITING,TASK_HANGING,也就是只有这三种状态才不会被调度 */
-	ASSERT(((stat == TASK_BLOCKED)|| (stat == TASK_WAITING) || (stat == TASK_HANGING)));
+	/* stat的取值为TASK_BLOCKED,TASK_WAITING,TASK_HANGING,TASK_DIED,也就是只有这四种状态才不会被调度 */
+	ASSERT(((stat == TASK_BLOCKED)|| (stat == TASK_WAITING) || (stat == TASK_HANGING) || (stat == TASK_DIED)));
 	intr_status old_status = intr_disable();
 
 	task_struct* cur_thread = running_thread();
 	cur_thread->status = stat;			// 置其状态为stat
+	trace_block(cur_thread, stat);
 	schedule();											// 将当前线程换下处理器
 	/* 待当前线程被解除阻塞后才继续运行下面的intr_set_status */
 	intr_set_status(old_status);
@@ -170,12 +260,113 @@ void thread_unblock(task_struct *pthread) {
 	intr_status old_status = intr_disable();
 	ASSERT(((pthread->status == TASK_BLOCKED)|| (pthread->status == TASK_WAITING) || (pthread->status == TASK_HANGING)));
 	if (pthread->status != TASK_READY) {
-		ASSERT(!elem_find(&thread_ready_list, &pthread->general_tag));
-		if (elem_find(&thread_ready_list, &pthread->general_tag)) {
-			PANIC("thread_unblock: blocked thread in ready_list\n");
-		}
+		/* 被阻塞的线程不应该还在就绪队列中 */
+		ASSERT(!elem_in_list(&thread_ready_list, &pthread->general_tag));
 		list_push(&thread_ready_list, &pthread->general_tag);		// 放到队列的最前面，使其尽快得到调度
 		pthread->status = TASK_READY;
+		trace_wakeup(pthread);
+		if (pthread->priority > running_thread()->priority) {
+			need_resched = true;				// 在中断处理程序中唤醒时,由中断退出路径抢占当前任务
+		}
 	}
 	intr_set_status(old_status);
+}
+
+/* 主动让出cpu,当前线程排到就绪队列尾 */
+void thread_yield(void) {
+	task_struct* cur = running_thread();
+	intr_status old_status = intr_disable();
+	ASSERT(!elem_in_list(&thread_ready_list, &cur->general_tag));
+	list_append(&thread_ready_list, &cur->general_tag);
+	cur->status = TASK_READY;
+	schedule();
+	intr_set_status(old_status);
+}
+
+/**
+ * 若就绪队列之首的任务优先级高于当前线程,立即让出cpu.刚唤醒或刚被提升优先级的任务排在队首.
+ * 只能在开中断的线程上下文中调用,中断处理程序中唤醒的高优先级任务由irq_exit检查need_resched后抢占
+*/
+void thread_preempt(void) {
+	ASSERT(intr_get_status() == INTR_ON);
+	intr_status old_status = intr_disable();
+	if (!list_empty(&thread_ready_list)) {
+		task_struct* first = elem2entry(task_struct, general_tag, thread_ready_list.head.next);
+		if (first->priority > running_thread()->priority) {
+			intr_set_status(old_status);
+			thread_yield();
+			return;
+		}
+	}
+	intr_set_status(old_status);
+}
+
+/**
+ * 将pthread按有效优先级插入以general_tag串联的等待队列plist,队列按优先级从高到低排列.
+ * 只用于锁和信号量的等待者,就绪队列仍是先进先出的轮转,不会因优先级饿死低优先级任务.
+ * band_head为true时排在同优先级任务之前,否则排在其后(同优先级内先进先出).
+ * 调用者须已关中断
+*/
+void prio_queue_insert(list* plist, task_struct* pthread, bool band_head) {
+	ASSERT(intr_get_status() == INTR_OFF);
+	list_elem* pelem = plist->head.next;
+	while (pelem != &plist->tail) {
+		task_struct* t = elem2entry(task_struct, general_tag, pelem);
+		if (t->priority < pthread->priority || (band_head && t->priority == pthread->priority)) {
+			break;
+		}
+		pelem = pelem->next;
+	}
+	list_insert_before(pelem, &pthread->general_tag);
+}
+
+/**
+ * 修改pthread的有效优先级.就绪队列不按优先级排序,只在提升时把就绪的pthread移到队首,
+ * 让持锁者尽快运行并释放锁,此后它照常在队尾轮转;降低时不挪动.
+ * 在信号量等待队列中的重新排队由sync.c负责.调用者须已关中断
+*/
+void thread_set_priority(task_struct* pthread, uint8_t prio) {
+	ASSERT(intr_get_status() == INTR_OFF);
+	if (pthread->priority == prio) return;
+	bool raise = prio > pthread->priority;
+	pthread->priority = prio;
+	if (raise && pthread->status == TASK_READY) {
+		ASSERT(elem_in_list(&thread_ready_list, &pthread->general_tag));
+		list_remove(&pthread->general_tag);
+		list_push(&thread_ready_list, &pthread->general_tag);
+	}
+}
+
+/* pid2thread的回调函数,判断pelem对应的任务的pid是否为pid */
+static bool pid_check(list_elem* pelem, int32_t pid) {
+	task_struct* pthread = elem2entry(task_struct, all_list_tag, pelem);
+	return pthread->pid == pid;
+}
+
+/* 根据pid找pcb,若找到则返回该pcb,否则返回NULL */
+task_struct* pid2thread(pid_t pid) {
+	list_elem* pelem = list_traversal(&thread_all_list, pid_check, pid);
+	if (pelem == NULL) return NULL;
+	return elem2entry(task_struct, all_list_tag, pelem);
+}
+
+/**
+ * 回收已退出任务thread_over的pcb、页目录和pid.
+ * 任务不能回收自己(此时还在用pcb所在页做栈),由父进程在sys_wait中调用
+*/
+void thread_exit(task_struct* thread_over) {
+	ASSERT(thread_over != running_thread() && thread_over != main_thread);
+	ASSERT(thread_over->status == TASK_DIED);
+
+	intr_status old_status = intr_disable();
+	list_remove(&thread_over->all_list_tag);
+	fpu_release(thread_over);
+	intr_set_status(old_status);
+
+	/* 用户进程的页目录在其sys_exit时还在使用,只能在此处回收 */
+	if (thread_over->pgdir != NULL) {
+		free_kernel_pages(thread_over->pgdir, 1);
+	}
+	release_pid(thread_over->pid);
+	free_kernel_pages(thread_over, 1);
 }
\ No newline at end of file
@@ -6,6 +6,11 @@
 #include "bitmap.h"
 #include "memory.h"
 
+#define MAX_FILES_OPEN_PER_PROC 8		// 每个任务可打开的文件数
+#define SCHED_HIST_BUCKETS 16			// 调度直方图的桶数,第i个桶统计[4^i, 4^(i+1))个时钟周期
+
+struct lock;
+
 /* 自定义通用数据函数类型,它将在很多线程函数中作为形参类型 */
 typedef void thread_func(void *);
 typedef int16_t pid_t;
@@ -17,7 +22,7 @@ typedef enum {
 	TASK_BLOCKED,
 	TASK_WAITING,
 	TASK_HANGING,
-	TASK_DIED
+	TASK_DIED							// 已退出但尚未被父进程回收,即僵尸状态
 } task_status;
 
 /*********** 中断栈 intr_stack ***********
@@ -79,8 +84,11 @@ typedef struct {
 typedef struct {
 	uint32_t *self_kstack;				// 各内核线程都用自己的内核栈
 	pid_t pid;
+	pid_t parent_pid;							// 父进程pid,为-1时表示没有父进程
+	int32_t exit_status;					// 退出状态,由父进程在wait时取走
 	task_status status;
-	uint8_t priority;							// 线程优先级
+	uint8_t priority;							// 线程的有效优先级,持有锁时可能被等待者临时提升
+	uint8_t base_priority;				// 线程创建时指定的原始优先级
 	char name[16];
 	uint8_t ticks;								// 每次在处理器上执行的时间嘀嗒数
 
@@ -89,15 +97,31 @@ typedef struct {
 	list_elem general_tag;				// 用于线程在一般的队列中的结点
 	list_elem all_list_tag;				// 用于线程队列thread_all_list中的结点
 
+	struct lock* waiting_lock;		// 正在等待的锁,用于沿锁链捐赠优先级
+	list held_locks;							// 已持有的锁,释放锁时据此重新计算有效优先级
+	bool wq_exclusive;						// 在等待队列中是否为独占等待者,见wait_queue.h
+	uint32_t futex_key;						// 在futex上睡眠时,futex字的物理地址
+
 	uint32_t* pgdir;							// 进程自己页表的虚拟地址
 	virtual_addr userprog_vaddr;	// 用户进程的虚拟地址
 	mem_block_desc u_block_desc[DESC_CNT];	// 用户进程内存块描述符
+	int32_t fd_table[MAX_FILES_OPEN_PER_PROC];	// 文件描述符表,存放file_table的下标,-1表示空闲
+
+	uint64_t sched_stamp;					// 最近一次进入就绪队列或开始运行时的时间戳
+	uint32_t wait_hist[SCHED_HIST_BUCKETS];	// 在就绪队列中等待时长的直方图
+	uint32_t run_hist[SCHED_HIST_BUCKETS];	// 每次连续运行时长的直方图
+
+	bool fpu_used;								// 此任务是否用过fpu,没用过的任务首次触发#NM时只需初始化fpu
+	uint8_t fpu_state[512] __attribute__((aligned(16)));	// fxsave/fxrstor保存fpu和sse上下文的区域,必须16字节对齐
 	uint32_t stack_magic;					// 栈的边界标记，用于检测栈的溢出
 } task_struct;
 
 
+extern task_struct *main_thread;
+extern task_struct *idle_thread;
 extern list thread_ready_list;
 extern list thread_all_list;
+extern bool need_resched;
 
 void thread_create(task_struct* pthread, thread_func function, void* func_arg);
 void init_thread(task_struct* pthread, char* name, int prio);
@@ -107,4 +131,11 @@ task_struct *running_thread(void);
 task_struct *thread_start(char *name, int prio, thread_func function, void *func_arg);
 void thread_block(task_status stat);
 void thread_unblock(task_struct *pthread);
+void thread_yield(void);
+void thread_preempt(void);
+void prio_queue_insert(list* plist, task_struct* pthread, bool band_head);
+void thread_set_priority(task_struct* pthread, uint8_t prio);
+void release_pid(pid_t pid);
+task_struct *pid2thread(pid_t pid);
+void thread_exit(task_struct *thread_over);
 #endif
\ No newline at end of file
@@ -0,0 +1,195 @@
+#include "trace.h"
+#include "global.h"
+#include "stdint.h"
+#include "thread.h"
+#include "interrupt.h"
+#include "list.h"
+#include "tsc.h"
+#include "stdio.h"
+#include "console.h"
+#include "memory.h"
+
+#define TRACE_BUF_MASK (TRACE_BUF_SIZE - 1)
+#define TRACE_DUMP_MAX_TASKS 64			// trace_dump一次最多打印多少个任务的直方图
+
+/**
+ * 调度事件环形缓冲区.
+ * 每个cpu一个缓冲区(目前只有一个cpu),所有记录点(schedule、thread_block、
+ * thread_unblock、中断入口和出口)都运行在关中断状态下,同一cpu上的写者不会相互打断,
+ * 因此写入无需加锁:取下标、填记录、下标加1即可,缓冲区写满后覆盖最旧的事件
+*/
+static trace_event trace_buf[TRACE_BUF_SIZE];
+static uint32_t trace_head;						// 下一条事件的写入序号,只增不减
+static uint32_t trace_tail;						// sys_trace_read读到的序号
+
+static const char* trace_type_name[] = {"SW", "WK", "BL", "IE", "IX"};
+
+/* 记录一条事件,调用者须已关中断 */
+static inline trace_event* trace_record(uint8_t type, pid_t pid, pid_t pid2, uint8_t arg, uint64_t now) {
+	trace_event* ev = &trace_buf[trace_head & TRACE_BUF_MASK];
+	ev->tsc = now;
+	ev->type = type;
+	ev->arg = arg;
+	ev->pid = pid;
+	ev->pid2 = pid2;
+	++trace_head;
+	return ev;
+}
+
+/* 将时长delta计入直方图hist,第i个桶统计[4^i, 4^(i+1))个时钟周期的次数 */
+static inline void hist_add(uint32_t* hist, uint64_t delta) {
+	uint32_t bucket = SCHED_HIST_BUCKETS - 1;
+	if ((delta >> 32) == 0) {
+		uint32_t low = (uint32_t)delta;
+		bucket = low == 0 ? 0 : (31 - __builtin_clz(low)) / 2;
+		if (bucket >= SCHED_HIST_BUCKETS) bucket = SCHED_HIST_BUCKETS - 1;
+	}
+	++hist[bucket];
+}
+
+/* 新任务创建时调用,此时它已就绪,从现在开始计算它在就绪队列中的等待时间 */
+void trace_task_init(task_struct* pthread) {
+	pthread->sched_stamp = rdtsc();
+}
+
+/* 在schedule中调用,prev换下cpu,next换上cpu */
+void trace_switch(task_struct* prev, task_struct* next) {
+	uint64_t now = rdtsc();
+	trace_record(TRACE_SWITCH, prev->pid, next->pid, prev->status, now);
+
+	/* prev的运行时长;若它仍就绪,从现在起开始排队 */
+	hist_add(prev->run_hist, now - prev->sched_stamp);
+	prev->sched_stamp = now;
+
+	/* next在就绪队列中的等待时长,从现在起开始运行 */
+	hist_add(next->wait_hist, now - next->sched_stamp);
+	next->sched_stamp = now;
+}
+
+/* 在thread_unblock中调用,pthread被当前任务唤醒 */
+void trace_wakeup(task_struct* pthread) {
+	uint64_t now = rdtsc();
+	trace_record(TRACE_WAKEUP, pthread->pid, running_thread()->pid, 0, now);
+	pthread->sched_stamp = now;
+}
+
+/* 在thread_block中调用,pthread以stat状态阻塞 */
+void trace_block(task_struct* pthread, task_status stat) {
+	trace_record(TRACE_BLOCK, pthread->pid, 0, stat, rdtsc());
+}
+
+/* 由irq_enter在调用中断处理程序前调用 */
+void trace_irq_enter(uint32_t vec_nr) {
+	trace_record(TRACE_IRQ_ENTER, running_thread()->pid, 0, vec_nr, rdtsc());
+}
+
+/* 由irq_exit在中断处理程序返回后调用 */
+void trace_irq_exit(uint32_t vec_nr) {
+	trace_record(TRACE_IRQ_EXIT, running_thread()->pid, 0, vec_nr, rdtsc());
+}
+
+/**
+ * 把上次读取之后的事件复制到用户缓冲区buf中,最多max_cnt条,返回复制的条数,buf不是可写的用户内存时返回0.
+ * 读取期间关中断,写者不会在复制途中覆盖正被复制的事件;buf事先已按页表检查过,关中断复制时不会发生page fault.
+ * 若读者落后超过一整个缓冲区,被覆盖的事件直接丢弃
+*/
+uint32_t sys_trace_read(trace_event* buf, uint32_t max_cnt) {
+	if (max_cnt > TRACE_BUF_SIZE) max_cnt = TRACE_BUF_SIZE;
+	if (!user_range_ok(buf, max_cnt * sizeof(trace_event), true)) return 0;
+	intr_status old_status = intr_disable();
+	uint32_t head = trace_head;
+	if (head - trace_tail > TRACE_BUF_SIZE) {
+		trace_tail = head - TRACE_BUF_SIZE;
+	}
+	uint32_t cnt = 0;
+	while (trace_tail != head && cnt < max_cnt) {
+		buf[cnt++] = trace_buf[trace_tail & TRACE_BUF_MASK];
+		++trace_tail;
+	}
+	intr_set_status(old_status);
+	return cnt;
+}
+
+/* 将直方图hist格式化追加到buf */
+static char* hist_format(char* buf, uint32_t* hist) {
+	uint32_t i;
+	for (i = 0; i < SCHED_HIST_BUCKETS; ++i) {
+		buf += sprintf(buf, " %d", hist[i]);
+	}
+	return buf;
+}
+
+/* trace_dump的回调函数,收集任务的pid */
+static bool collect_pid(list_elem* pelem, int arg) {
+	pid_t* pids = (pid_t*)arg;
+	if (pids[0] == TRACE_DUMP_MAX_TASKS) return true;
+	task_struct* pthread = elem2entry(task_struct, all_list_tag, pelem);
+	pids[++pids[0]] = pthread->pid;
+	return false;
+}
+
+/**
+ * 在终端上打印缓冲区中的全部事件和每个任务的直方图,每行一条记录,供主机端脚本生成时间线:
+ *   E <类型> <tsc高32位> <tsc低32位> <pid> <pid2> <arg>      类型为SW/WK/BL/IE/IX
+ *   H <pid> <name> W <16个桶> R <16个桶>                    W为就绪等待,R为运行时长
+ * 数值除tsc外均为十进制,tsc为十六进制
+*/
+void trace_dump(void) {
+	char line[512];
+	trace_event ev;
+
+	console_put_str("#trace begin\n");
+	/* 缓冲区中保留的是最近cnt条事件,从最旧的一条按序号打印 */
+	uint32_t head = trace_head;
+	uint32_t cnt = head < TRACE_BUF_SIZE ? head : TRACE_BUF_SIZE;
+	uint32_t e;
+	for (e = 0; e < cnt; ++e) {
+		uint32_t idx = head - cnt + e;
+		intr_status old_status = intr_disable();
+		if (trace_head - idx > TRACE_BUF_SIZE) {	// 打印期间已被覆盖
+			intr_set_status(old_status);
+			continue;
+		}
+		ev = trace_buf[idx & TRACE_BUF_MASK];
+		intr_set_status(old_status);
+
+		sprintf(line, "E %s %x %x %d %d %d\n", trace_type_name[ev.type],
+			(uint32_t)(ev.tsc >> 32), (uint32_t)ev.tsc, ev.pid, ev.pid2, ev.arg);
+		console_put_str(line);
+	}
+
+	/* 先收集pid,再逐个在关中断下复制直方图,避免打印时任务被回收 */
+	pid_t pids[TRACE_DUMP_MAX_TASKS + 1];
+	pids[0] = 0;
+	intr_status old_status = intr_disable();
+	list_traversal(&thread_all_list, collect_pid, (int)pids);
+	intr_set_status(old_status);
+
+	uint32_t i;
+	for (i = 1; i <= (uint32_t)pids[0]; ++i) {
+		uint32_t wait_hist[SCHED_HIST_BUCKETS], run_hist[SCHED_HIST_BUCKETS];
+		char name[16];
+		old_status = intr_disable();
+		task_struct* pthread = pid2thread(pids[i]);
+		if (pthread == NULL) {
+			intr_set_status(old_status);
+			continue;
+		}
+		uint32_t b;
+		for (b = 0; b < SCHED_HIST_BUCKETS; ++b) {
+			wait_hist[b] = pthread->wait_hist[b];
+			run_hist[b] = pthread->run_hist[b];
+		}
+		for (b = 0; b < 16; ++b) name[b] = pthread->name[b];
+		intr_set_status(old_status);
+		name[15] = 0;
+
+		char* p = line + sprintf(line, "H %d %s W", pids[i], name);
+		p = hist_format(p, wait_hist);
+		p += sprintf(p, " R");
+		p = hist_format(p, run_hist);
+		sprintf(p, "\n");
+		console_put_str(line);
+	}
+	console_put_str("#trace end\n");
+}
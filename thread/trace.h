@@ -0,0 +1,37 @@
+#ifndef __THREAD_TRACE_H
+#define __THREAD_TRACE_H
+
+#include "stdint.h"
+#include "thread.h"
+
+#define TRACE_BUF_SIZE 1024				// 环形缓冲区能容纳的事件数,必须是2的幂
+
+/* 调度事件类型 */
+typedef enum {
+	TRACE_SWITCH,									// 任务切换, pid换下, pid2换上
+	TRACE_WAKEUP,									// 唤醒, pid被pid2唤醒
+	TRACE_BLOCK,									// 阻塞, pid以arg状态阻塞
+	TRACE_IRQ_ENTER,							// 进入中断, arg为中断向量号, pid为被中断的任务
+	TRACE_IRQ_EXIT								// 退出中断, 同上
+} trace_type;
+
+/* 一条调度事件记录,16字节 */
+typedef struct {
+	uint64_t tsc;									// 事件发生时的时间戳
+	uint8_t type;									// trace_type
+	uint8_t arg;
+	pid_t pid;
+	pid_t pid2;
+	uint16_t reserved;
+} trace_event;
+
+void trace_switch(task_struct* prev, task_struct* next);
+void trace_wakeup(task_struct* pthread);
+void trace_block(task_struct* pthread, task_status stat);
+void trace_irq_enter(uint32_t vec_nr);
+void trace_irq_exit(uint32_t vec_nr);
+void trace_task_init(task_struct* pthread);
+uint32_t sys_trace_read(trace_event* buf, uint32_t max_cnt);
+void trace_dump(void);
+
+#endif
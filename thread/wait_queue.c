@@ -0,0 +1,79 @@
+#include "wait_queue.h"
+#include "global.h"
+#include "stdint.h"
+#include "list.h"
+#include "thread.h"
+#include "interrupt.h"
+#include "debug.h"
+
+/* 初始化等待队列 */
+void wq_init(wait_queue* wq) {
+	list_init(&wq->task_list);
+}
+
+/* 判断等待队列是否为空 */
+bool wq_empty(wait_queue* wq) {
+	return list_empty(&wq->task_list);
+}
+
+/* 返回优先级最高的等待者,队列为空时返回NULL.调用者须已关中断 */
+task_struct* wq_first(wait_queue* wq) {
+	ASSERT(intr_get_status() == INTR_OFF);
+	if (list_empty(&wq->task_list)) return NULL;
+	return elem2entry(task_struct, general_tag, wq->task_list.head.next);
+}
+
+/**
+ * 当前线程在wq上阻塞,直到被wq_wake唤醒.
+ * 调用者须已关中断,并在关中断期间检查过等待条件,
+ * 这样从检查条件到阻塞之间不会插入唤醒操作,唤醒不会丢失.
+ * 返回后条件未必成立,调用者应在循环中重新检查,或直接使用wq_wait_until
+*/
+void wq_wait(wait_queue* wq, bool exclusive) {
+	ASSERT(intr_get_status() == INTR_OFF);
+	task_struct* cur = running_thread();
+	ASSERT(!elem_in_list(&wq->task_list, &cur->general_tag));
+	cur->wq_exclusive = exclusive;
+	prio_queue_insert(&wq->task_list, cur, false);
+	thread_block(TASK_BLOCKED);
+}
+
+/* 在wq上等待,直到pred(arg)为true.谓词在关中断下求值,可在中断处理程序中修改其依赖的状态 */
+void wq_wait_until(wait_queue* wq, wq_pred pred, void* arg, bool exclusive) {
+	intr_status old_status = intr_disable();
+	while (!pred(arg)) {
+		wq_wait(wq, exclusive);
+	}
+	intr_set_status(old_status);
+}
+
+/**
+ * 唤醒wq中全部非独占等待者,以及按优先级排在最前的nr_exclusive个独占等待者,
+ * 返回唤醒的任务数.可在中断处理程序中调用
+*/
+uint32_t wq_wake(wait_queue* wq, uint32_t nr_exclusive) {
+	uint32_t woken = 0;
+	intr_status old_status = intr_disable();
+	list_elem* pelem = wq->task_list.head.next;
+	while (pelem != &wq->task_list.tail) {
+		list_elem* next = pelem->next;
+		task_struct* pthread = elem2entry(task_struct, general_tag, pelem);
+		if (!pthread->wq_exclusive || nr_exclusive > 0) {
+			if (pthread->wq_exclusive) --nr_exclusive;
+			list_remove(pelem);
+			thread_unblock(pthread);
+			++woken;
+		}
+		pelem = next;
+	}
+	intr_set_status(old_status);
+	return woken;
+}
+
+/* pthread的优先级改变后调用,按新优先级在wq中重新排队.调用者须已关中断 */
+void wq_requeue(wait_queue* wq, task_struct* pthread) {
+	ASSERT(intr_get_status() == INTR_OFF);
+	ASSERT(elem_in_list(&wq->task_list, &pthread->general_tag));
+	list_remove(&pthread->general_tag);
+	prio_queue_insert(&wq->task_list, pthread, false);
+}
@@ -0,0 +1,36 @@
+#ifndef __THREAD_WAIT_QUEUE_H
+#define __THREAD_WAIT_QUEUE_H
+
+#include "stdint.h"
+#include "list.h"
+#include "thread.h"
+
+#define WQ_WAKE_ALL 0xffffffff			// wq_wake的nr_exclusive取此值时唤醒全部独占等待者
+
+/**
+ * 等待队列.
+ * 任务通过general_tag挂在task_list上,按优先级从高到低排列.
+ * 等待者分两种:非独占等待者每次唤醒都会全部醒来(如读者),
+ * 独占等待者每次只醒来指定个数(如锁和信号量的等待者),避免一次唤醒大批任务却只有一个能继续
+*/
+typedef struct {
+	list task_list;
+} wait_queue;
+
+/* 谓词函数类型,用于wq_wait_until,返回true表示等待的条件已成立 */
+typedef bool wq_pred(void* arg);
+
+void wq_init(wait_queue* wq);
+bool wq_empty(wait_queue* wq);
+task_struct* wq_first(wait_queue* wq);
+void wq_wait(wait_queue* wq, bool exclusive);
+void wq_wait_until(wait_queue* wq, wq_pred pred, void* arg, bool exclusive);
+uint32_t wq_wake(wait_queue* wq, uint32_t nr_exclusive);
+void wq_requeue(wait_queue* wq, task_struct* pthread);
+
+/* 唤醒全部非独占等待者和一个独占等待者 */
+#define wq_wake_one(wq) wq_wake((wq), 1)
+/* 唤醒全部等待者 */
+#define wq_wake_all(wq) wq_wake((wq), WQ_WAKE_ALL)
+
+#endif
@@ -0,0 +1,921 @@
+/**
+ * 在主机上用KVM启动内核的最小虚拟机,用于测量本仓库各项bench的结果:
+ *   kvmrun [-t 秒数] [-m 内存MB] [-d] [-v virtio盘] [-s 屏幕转储] [-l 串口日志] 盘0 [盘1 [盘2 [盘3]]]
+ * 盘0到盘3依次接在ata0主、ata0从、ata1主、ata1从上,从盘0的mbr启动,即与bochs相同的启动路径.
+ * 模拟的设备: 实模式下的简易BIOS(只实现loader用到的int 0x15内存探测),ATA PIO,
+ * -d时再加上PIIX的总线主控DMA,COM1的16550(输出写到标准输出和-l指定的文件),
+ * VGA光标端口,PCI配置空间,-v时加一个legacy virtio-blk设备.8259A和8254由KVM在内核中提供.
+ * 到时间后停机,把屏幕内容写到-s指定的文件,并打印各盘读写的扇区数.
+ * 宿主机的KVM本身也是软件辅助虚拟化(如PVM)时,特权指令都要陷入,周期数远高于真机,只有比值有意义;
+ * 这类宿主机不能模拟fxsave/fxrstor和部分iret,由本程序代为模拟,
+ * 且ring3执行int 0x80会得到#UD,u_prog_a的int 0x80 getpid测量无法进行
+*/
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/kvm.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+static int vmfd, vcpufd;
+static struct kvm_run* run;
+static uint8_t* mem;
+static uint64_t mem_size;
+static volatile sig_atomic_t timed_out;
+
+static void die(const char* m) { perror(m); exit(1); }
+
+static void irq(int n) {
+	struct kvm_irq_level l = {.irq = n, .level = 1};
+	if (ioctl(vmfd, KVM_IRQ_LINE, &l) < 0) die("KVM_IRQ_LINE");
+	l.level = 0;
+	if (ioctl(vmfd, KVM_IRQ_LINE, &l) < 0) die("KVM_IRQ_LINE");
+}
+
+/* ---------------- ATA ---------------- */
+typedef struct {
+	int fd;
+	uint64_t sectors;
+	int present;
+} drive_t;
+
+typedef struct {
+	int irqn;
+	drive_t drv[2];
+	uint8_t feat, cnt, lbal, lbam, lbah, dev, status, ctl;
+	uint8_t buf[512];
+	int pos, len;           // buf中的读写位置和有效字节数
+	int remaining;          // 当前扇区之后还剩的扇区数
+	uint32_t lba;
+	int writing;
+	uint64_t sect_rd, sect_wr;
+	int dma_pending;        // 0无,1读,2写
+	uint8_t bm_cmd, bm_status;
+	uint32_t bm_prdt;
+} chan_t;
+
+static int ide_dma_enabled;
+static uint32_t piix_bar4 = 0xc040;
+static uint16_t piix_cmd;
+
+static chan_t chans[2];
+
+static drive_t* cur_drive(chan_t* c) { return &c->drv[(c->dev >> 4) & 1]; }
+
+static void ata_raise(chan_t* c) {
+	if (!(c->ctl & 2)) irq(c->irqn);
+}
+
+static void ata_load(chan_t* c) {
+	drive_t* d = cur_drive(c);
+	if (pread(d->fd, c->buf, 512, (off_t)c->lba * 512) != 512) memset(c->buf, 0, 512);
+	c->pos = 0;
+	c->len = 512;
+	c->sect_rd++;
+}
+
+static void put_str_id(uint8_t* id, int word, int words, const char* s) {
+	int i;
+	char tmp[64];
+	memset(tmp, ' ', sizeof(tmp));
+	memcpy(tmp, s, strlen(s));
+	for (i = 0; i < words; ++i) {
+		id[(word + i) * 2] = tmp[i * 2 + 1];
+		id[(word + i) * 2 + 1] = tmp[i * 2];
+	}
+}
+
+static void ata_command(chan_t* c, uint8_t cmd) {
+	drive_t* d = cur_drive(c);
+	if (!d->present) {
+		c->status = 0;
+		return;
+	}
+	uint32_t count = c->cnt == 0 ? 256 : c->cnt;
+	c->lba = c->lbal | (c->lbam << 8) | (c->lbah << 16) | ((uint32_t)(c->dev & 0x0f) << 24);
+	switch (cmd) {
+	case 0xec: {
+		memset(c->buf, 0, 512);
+		uint16_t* w = (uint16_t*)c->buf;
+		w[0] = 0x0040;
+		put_str_id(c->buf, 10, 10, "KVMHARNESS0001");
+		put_str_id(c->buf, 27, 20, "KVM harness ATA disk");
+		w[49] = 1 << 9;  // 支持LBA
+		if (ide_dma_enabled) w[49] |= 1 << 8;
+		w[60] = d->sectors & 0xffff;
+		w[61] = d->sectors >> 16;
+		c->pos = 0;
+		c->len = 512;
+		c->remaining = 0;
+		c->writing = 0;
+		c->lbam = c->lbah = 0;
+		c->status = 0x58;
+		ata_raise(c);
+		break;
+	}
+	case 0x20:
+	case 0x21:
+		c->writing = 0;
+		ata_load(c);
+		c->remaining = count - 1;
+		c->status = 0x58;
+		ata_raise(c);
+		break;
+	case 0x30:
+	case 0x31:
+		c->writing = 1;
+		c->pos = 0;
+		c->len = 512;
+		c->remaining = count - 1;
+		c->status = 0x58;
+		break;
+	case 0xc8:
+	case 0xca:
+		if (!ide_dma_enabled) { c->status = 0x51; ata_raise(c); break; }
+		c->dma_pending = cmd == 0xc8 ? 1 : 2;
+		c->remaining = count;
+		c->status = 0x58;
+		break;
+	case 0xe7:
+	case 0xea:
+		fsync(d->fd);
+		c->status = 0x50;
+		ata_raise(c);
+		break;
+	default:
+		c->status = 0x51;
+		ata_raise(c);
+	}
+}
+
+static void ata_dma_run(chan_t* c) {
+	drive_t* d = cur_drive(c);
+	uint32_t prd = c->bm_prdt;
+	uint64_t off = (uint64_t)c->lba * 512;
+	uint64_t left = (uint64_t)c->remaining * 512;
+	for (;;) {
+		uint32_t* e = (uint32_t*)(mem + prd);
+		uint32_t addr = e[0], cnt = e[1] & 0xffff, eot = e[1] >> 31;
+		if (cnt == 0) cnt = 0x10000;
+		if (cnt > left) cnt = left;
+		if (addr + cnt > mem_size) { c->bm_status |= 2; break; }
+		if (c->dma_pending == 1) {
+			if (pread(d->fd, mem + addr, cnt, off) != (ssize_t)cnt) c->bm_status |= 2;
+			c->sect_rd += cnt / 512;
+		} else {
+			if (pwrite(d->fd, mem + addr, cnt, off) != (ssize_t)cnt) c->bm_status |= 2;
+			c->sect_wr += cnt / 512;
+		}
+		off += cnt;
+		left -= cnt;
+		prd += 8;
+		if (eot || left == 0) break;
+	}
+	c->dma_pending = 0;
+	c->remaining = 0;
+	c->status = 0x50;
+	c->bm_status = (c->bm_status & ~1) | 4;
+	ata_raise(c);
+}
+
+static int bm_io(uint16_t port, int in, uint32_t* val, int size) {
+	if (!ide_dma_enabled || !(piix_cmd & 1) || port < piix_bar4 || port >= piix_bar4 + 16) return 0;
+	chan_t* c = &chans[(port - piix_bar4) / 8];
+	int reg = (port - piix_bar4) & 7;
+	if (in) {
+		if (reg == 0) *val = c->bm_cmd;
+		else if (reg == 2) *val = c->bm_status;
+		else if (reg == 4) *val = size == 4 ? c->bm_prdt : (c->bm_prdt & 0xffff);
+		else *val = 0;
+	} else {
+		if (reg == 0) {
+			uint8_t old = c->bm_cmd;
+			c->bm_cmd = *val & 9;
+			if ((c->bm_cmd & 1) && !(old & 1)) {
+				c->bm_status |= 1;
+				if (c->dma_pending) ata_dma_run(c);
+			} else if (!(c->bm_cmd & 1)) {
+				c->bm_status &= ~1;
+			}
+		} else if (reg == 2) {
+			uint8_t v = *val;
+			c->bm_status = (c->bm_status & ~0x60) | (v & 0x60);
+			c->bm_status &= ~(v & 6);
+		} else if (reg == 4 && size == 4) {
+			c->bm_prdt = *val & ~3u;
+		}
+	}
+	return 1;
+}
+
+static uint32_t ata_data_in(chan_t* c, int size) {
+	uint32_t v = 0;
+	if (c->writing || c->pos >= c->len) return 0xffffffff;
+	memcpy(&v, c->buf + c->pos, size);
+	c->pos += size;
+	if (c->pos >= c->len) {
+		if (c->remaining > 0) {
+			c->remaining--;
+			c->lba++;
+			ata_load(c);
+			c->status = 0x58;
+			ata_raise(c);
+		} else {
+			c->status = 0x50;
+		}
+	}
+	return v;
+}
+
+static void ata_data_out(chan_t* c, uint32_t v, int size) {
+	if (!c->writing || c->pos >= c->len) return;
+	memcpy(c->buf + c->pos, &v, size);
+	c->pos += size;
+	if (c->pos >= 512) {
+		drive_t* d = cur_drive(c);
+		if (pwrite(d->fd, c->buf, 512, (off_t)c->lba * 512) != 512) perror("pwrite");
+		c->sect_wr++;
+		if (c->remaining > 0) {
+			c->remaining--;
+			c->lba++;
+			c->pos = 0;
+			c->status = 0x58;
+		} else {
+			c->writing = 0;
+			c->status = 0x50;
+		}
+		ata_raise(c);
+	}
+}
+
+static int ata_io(uint16_t port, int in, uint32_t* val, int size) {
+	chan_t* c;
+	int reg;
+	if (port >= 0x1f0 && port <= 0x1f7) { c = &chans[0]; reg = port - 0x1f0; }
+	else if (port >= 0x170 && port <= 0x177) { c = &chans[1]; reg = port - 0x170; }
+	else if (port == 0x3f6) { c = &chans[0]; reg = 8; }
+	else if (port == 0x376) { c = &chans[1]; reg = 8; }
+	else return 0;
+	int any = c->drv[0].present || c->drv[1].present;
+	if (!any) {
+		if (in) *val = 0xffffffff;
+		return 1;
+	}
+	if (in) {
+		switch (reg) {
+		case 0: *val = ata_data_in(c, size); break;
+		case 1: *val = 0; break;
+		case 2: *val = c->cnt; break;
+		case 3: *val = c->lbal; break;
+		case 4: *val = c->lbam; break;
+		case 5: *val = c->lbah; break;
+		case 6: *val = c->dev; break;
+		case 7: case 8: *val = cur_drive(c)->present ? c->status : 0; break;
+		}
+	} else {
+		switch (reg) {
+		case 0: ata_data_out(c, *val, size); break;
+		case 1: c->feat = *val; break;
+		case 2: c->cnt = *val; break;
+		case 3: c->lbal = *val; break;
+		case 4: c->lbam = *val; break;
+		case 5: c->lbah = *val; break;
+		case 6: c->dev = *val; break;
+		case 7: ata_command(c, *val); break;
+		case 8: c->ctl = *val; break;
+		}
+	}
+	return 1;
+}
+
+/* ---------------- UART ---------------- */
+static struct {
+	uint8_t ier, lcr, mcr, scr, dll, dlm, thre_pending;
+} uart;
+static FILE* serial_log;
+
+static int uart_io(uint16_t port, int in, uint32_t* val) {
+	if (port < 0x3f8 || port > 0x3ff) return 0;
+	int reg = port - 0x3f8;
+	int dlab = uart.lcr & 0x80;
+	if (in) {
+		switch (reg) {
+		case 0: *val = dlab ? uart.dll : 0; break;
+		case 1: *val = dlab ? uart.dlm : uart.ier; break;
+		case 2:
+			if ((uart.ier & 2) && uart.thre_pending) { uart.thre_pending = 0; *val = 0xc2; }
+			else *val = 0xc1;
+			break;
+		case 3: *val = uart.lcr; break;
+		case 4: *val = uart.mcr; break;
+		case 5: *val = 0x60; break;
+		case 6: *val = 0xb0; break;
+		case 7: *val = uart.scr; break;
+		}
+	} else {
+		uint8_t v = *val;
+		switch (reg) {
+		case 0:
+			if (dlab) { uart.dll = v; break; }
+			if (v != '\r') { fputc(v, stdout); if (serial_log) fputc(v, serial_log); }
+			if ((uart.ier & 2) && !uart.thre_pending) { uart.thre_pending = 1; irq(4); }
+			break;
+		case 1:
+			if (dlab) { uart.dlm = v; break; }
+			if ((v & 2) && !(uart.ier & 2)) { uart.ier = v; uart.thre_pending = 1; irq(4); }
+			uart.ier = v;
+			break;
+		case 3: uart.lcr = v; break;
+		case 4: uart.mcr = v; break;
+		case 7: uart.scr = v; break;
+		}
+	}
+	return 1;
+}
+
+/* ---------------- PCI和legacy virtio-blk ---------------- */
+static uint32_t pci_addr;
+static struct {
+	int present, fd;
+	uint64_t sectors;
+	uint32_t bar0;          // io端口基址
+	uint16_t cmd;
+	uint32_t features_guest;
+	uint32_t pfn;
+	uint16_t qsel, qsize;
+	uint16_t last_avail;
+	uint8_t status, isr;
+	uint64_t reqs, sect_rd;
+} vblk;
+#define VBLK_IO 0xc000
+#define VBLK_QSIZE 128
+#define VBLK_IRQ 11
+
+static uint32_t pci_cfg_read(int off) {
+	uint32_t bus = (pci_addr >> 16) & 0xff, devn = (pci_addr >> 11) & 0x1f, fn = (pci_addr >> 8) & 7;
+	if (ide_dma_enabled && bus == 0 && devn == 1 && fn == 0) {
+		switch (off & ~3) {
+		case 0x00: return 0x7000 << 16 | 0x8086;
+		case 0x08: return 0x06010000;
+		case 0x0c: return 0x00800000;             // 多功能设备
+		default: return 0;
+		}
+	}
+	if (ide_dma_enabled && bus == 0 && devn == 1 && fn == 1) {
+		switch (off & ~3) {
+		case 0x00: return 0x7010 << 16 | 0x8086;
+		case 0x04: return piix_cmd;
+		case 0x08: return 0x01018000;             // IDE控制器,prog-if 0x80表示支持总线主控
+		case 0x20: return piix_bar4 | 1;
+		default: return 0;
+		}
+	}
+	if (!vblk.present || bus != 0 || devn != 3 || fn != 0) return 0xffffffff;
+	switch (off & ~3) {
+	case 0x00: return 0x1001 << 16 | 0x1af4;
+	case 0x04: return vblk.cmd;
+	case 0x08: return 0x01000000;                 // 大容量存储控制器
+	case 0x0c: return 0;
+	case 0x10: return vblk.bar0 | 1;
+	case 0x2c: return 0x0002 << 16 | 0x1af4;      // subsystem id 2即块设备
+	case 0x3c: return 0x0100 | VBLK_IRQ;
+	default: return 0;
+	}
+}
+
+static void pci_cfg_write(int off, uint32_t v) {
+	uint32_t devn = (pci_addr >> 11) & 0x1f, fn = (pci_addr >> 8) & 7;
+	if (ide_dma_enabled && devn == 1 && fn == 1) {
+		if ((off & ~3) == 0x04) piix_cmd = v & 0xffff;
+		if ((off & ~3) == 0x20) piix_bar4 = v == 0xffffffff ? ~(16u - 1) : (v & ~3u);
+		return;
+	}
+	if (!vblk.present || devn != 3) return;
+	if ((off & ~3) == 0x04) vblk.cmd = v & 0xffff;
+	if ((off & ~3) == 0x10) vblk.bar0 = v == 0xffffffff ? ~(0x40u - 1) : (v & ~3u);
+}
+
+static void* gpa(uint64_t a) {
+	if (a >= mem_size) { fprintf(stderr, "bad gpa %llx\n", (unsigned long long)a); exit(1); }
+	return mem + a;
+}
+
+struct vring_desc { uint64_t addr; uint32_t len; uint16_t flags, next; };
+
+static void vblk_notify(void) {
+	if (!vblk.pfn) return;
+	uint8_t* base = gpa((uint64_t)vblk.pfn * 4096);
+	struct vring_desc* desc = (void*)base;
+	uint16_t* avail = (void*)(base + 16 * VBLK_QSIZE);
+	uint32_t used_off = (16 * VBLK_QSIZE + 6 + 2 * VBLK_QSIZE + 4095) & ~4095;
+	uint16_t* used = (void*)(base + used_off);
+	int did = 0;
+	while (vblk.last_avail != avail[1]) {
+		uint16_t head = avail[2 + vblk.last_avail % VBLK_QSIZE];
+		uint16_t i = head;
+		uint32_t type = 0;
+		uint64_t sector = 0;
+		uint32_t written = 0;
+		int n = 0;
+		uint8_t st = 0;
+		for (;;) {
+			struct vring_desc* d = &desc[i];
+			if (n == 0) {
+				uint32_t* h = gpa(d->addr);
+				type = h[0];
+				sector = *(uint64_t*)(h + 2);
+			} else if (!(d->flags & 1)) {
+				*(uint8_t*)gpa(d->addr) = st;
+				written += 1;
+			} else if (d->flags & 2) {  // 设备写入的描述符: 读请求的数据
+				if (type == 0) {
+					if (pread(vblk.fd, gpa(d->addr), d->len, sector * 512) != (ssize_t)d->len) st = 1;
+					vblk.sect_rd += d->len / 512;
+					sector += d->len / 512;
+					written += d->len;
+				} else if (d->len == 1) {
+					*(uint8_t*)gpa(d->addr) = st;
+					written += 1;
+				} else {
+					written += d->len;
+				}
+			} else {   // 设备读出的描述符: 写请求的数据
+				if (type == 1) {
+					if (pwrite(vblk.fd, gpa(d->addr), d->len, sector * 512) != (ssize_t)d->len) st = 1;
+					sector += d->len / 512;
+				}
+			}
+			n++;
+			if (!(d->flags & 1)) break;
+			i = d->next;
+		}
+		uint16_t uidx = used[1];
+		uint32_t* ue = (uint32_t*)(used + 2) + 2 * (uidx % VBLK_QSIZE);
+		ue[0] = head;
+		ue[1] = written;
+		__sync_synchronize();
+		used[1] = uidx + 1;
+		vblk.last_avail++;
+		vblk.reqs++;
+		did = 1;
+	}
+	if (did) {
+		vblk.isr |= 1;
+		irq(VBLK_IRQ);
+	}
+}
+
+static int vblk_io(uint16_t port, int in, uint32_t* val, int size) {
+	if (!vblk.present || !(vblk.cmd & 1) || port < vblk.bar0 || port >= vblk.bar0 + 0x40) return 0;
+	int off = port - vblk.bar0;
+	if (in) {
+		uint32_t v = 0;
+		switch (off) {
+		case 0: v = 0; break;                          // 设备不提供任何特性
+		case 4: v = vblk.features_guest; break;
+		case 8: v = vblk.pfn; break;
+		case 12: v = VBLK_QSIZE; break;
+		case 14: v = vblk.qsel; break;
+		case 16: v = 0; break;
+		case 18: v = vblk.status; break;
+		case 19: v = vblk.isr; vblk.isr = 0; break;
+		default:
+			if (off >= 20) {
+				uint8_t cfg[8];
+				memcpy(cfg, &vblk.sectors, 8);
+				memcpy(&v, cfg + (off - 20), size > 8 - (off - 20) ? 8 - (off - 20) : size);
+			}
+		}
+		*val = v;
+	} else {
+		switch (off) {
+		case 4: vblk.features_guest = *val; break;
+		case 8: vblk.pfn = *val; if (!*val) vblk.last_avail = 0; break;
+		case 14: vblk.qsel = *val; break;
+		case 16: vblk_notify(); break;
+		case 18: vblk.status = *val; if (!*val) { vblk.pfn = 0; vblk.last_avail = 0; } break;
+		}
+	}
+	return 1;
+}
+
+/* ---------------- 其它端口 ---------------- */
+static uint8_t crtc_idx, crtc[32];
+
+static void port_io(uint16_t port, int in, uint32_t* val, int size) {
+	if (ata_io(port, in, val, size)) return;
+	if (bm_io(port, in, val, size)) return;
+	if (uart_io(port, in, val)) return;
+	if (vblk_io(port, in, val, size)) return;
+	if (port == 0xcf8 && size == 4) {
+		if (in) *val = pci_addr; else pci_addr = *val;
+		return;
+	}
+	if (port >= 0xcfc && port <= 0xcff) {
+		int off = (pci_addr & 0xfc) + (port - 0xcfc);
+		if (in) {
+			uint32_t v = pci_cfg_read(off & ~3);
+			*val = v >> (8 * (off & 3));
+		} else {
+			pci_cfg_write(off & ~3, *val);
+		}
+		return;
+	}
+	if (port == 0x3d4) { if (in) *val = crtc_idx; else crtc_idx = *val & 31; return; }
+	if (port == 0x3d5) { if (in) *val = crtc[crtc_idx]; else crtc[crtc_idx] = *val; return; }
+	if (port == 0x64) { if (in) *val = 0; return; }
+	if (port == 0x60) { if (in) *val = 0; return; }
+	if (in) *val = 0xffffffff;
+}
+
+/* ---------------- 简易BIOS: 每个中断向量指向一段"out 0xf1, al; iret",由bios_call处理 ---------------- */
+#define BIOS_SEG 0xf000
+static void bios_setup(int hd_count) {
+	int i;
+	uint8_t* stub = mem + 0xf0000;
+	for (i = 0; i < 256; ++i) {
+		((uint16_t*)mem)[i * 2] = i * 4;
+		((uint16_t*)mem)[i * 2 + 1] = BIOS_SEG;
+		stub[i * 4] = 0xe6;   // out 0xf1, al
+		stub[i * 4 + 1] = 0xf1;
+		stub[i * 4 + 2] = 0xcf; // iret
+		stub[i * 4 + 3] = 0x90;
+	}
+	mem[0x475] = hd_count;
+}
+
+static void set_cf(struct kvm_regs* r, struct kvm_sregs* s, int cf) {
+	uint16_t* fl = (uint16_t*)(mem + s->ss.base + ((r->rsp + 4) & 0xffff));
+	if (cf) *fl |= 1; else *fl &= ~1;
+}
+
+static void bios_call(void) {
+	struct kvm_regs r;
+	struct kvm_sregs s;
+	ioctl(vcpufd, KVM_GET_REGS, &r);
+	ioctl(vcpufd, KVM_GET_SREGS, &s);
+	int vec = (r.rip & 0xffff) / 4;
+	if (vec == 0x15) {
+		uint32_t eax = r.rax;
+		if (eax == 0xe820) {
+			struct { uint64_t base, len; uint32_t type; } __attribute__((packed)) e[2] = {
+				{0, 0x9f000, 1}, {0x100000, mem_size - 0x100000, 1}};
+			int idx = r.rbx;
+			memcpy(mem + s.es.base + (r.rdi & 0xffff), &e[idx], 20);
+			r.rax = 0x534d4150;
+			r.rcx = 20;
+			r.rbx = idx + 1 < 2 ? idx + 1 : 0;
+			set_cf(&r, &s, 0);
+		} else if ((eax & 0xffff) == 0xe801) {
+			r.rax = r.rcx = 15 * 1024;
+			r.rbx = r.rdx = (mem_size - 16 * 1024 * 1024) / 65536;
+			set_cf(&r, &s, 0);
+		} else if ((eax & 0xff00) == 0x8800) {
+			r.rax = (mem_size / 1024 - 1024) > 0xffff ? 0xffff : mem_size / 1024 - 1024;
+			set_cf(&r, &s, 0);
+		} else {
+			set_cf(&r, &s, 1);
+		}
+	}
+	ioctl(vcpufd, KVM_SET_REGS, &r);
+}
+
+
+/* ---------------- 宿主机的指令模拟器不支持的0f ae组指令(fxsave/fxrstor/ldmxcsr/stmxcsr) ---------------- */
+static uint64_t gva2gpa(uint32_t va) {
+	struct kvm_translation t = {.linear_address = va};
+	if (ioctl(vcpufd, KVM_TRANSLATE, &t) < 0 || !t.valid) return ~0ull;
+	return t.physical_address;
+}
+
+static int read_gva(uint32_t va, void* dst, uint32_t n) {
+	uint8_t* d = dst;
+	while (n) {
+		uint32_t chunk = 4096 - (va & 4095);
+		if (chunk > n) chunk = n;
+		uint64_t pa = gva2gpa(va);
+		if (pa == ~0ull || pa + chunk > mem_size) return -1;
+		memcpy(d, mem + pa, chunk);
+		d += chunk; va += chunk; n -= chunk;
+	}
+	return 0;
+}
+
+static int write_gva(uint32_t va, const void* src, uint32_t n) {
+	const uint8_t* s = src;
+	while (n) {
+		uint32_t chunk = 4096 - (va & 4095);
+		if (chunk > n) chunk = n;
+		uint64_t pa = gva2gpa(va);
+		if (pa == ~0ull || pa + chunk > mem_size) return -1;
+		memcpy(mem + pa, s, chunk);
+		s += chunk; va += chunk; n -= chunk;
+	}
+	return 0;
+}
+
+static uint64_t emul_0fae;
+
+static int try_emulate_0fae(void) {
+	struct kvm_regs r;
+	ioctl(vcpufd, KVM_GET_REGS, &r);
+	uint8_t b[16];
+	if (read_gva(r.rip, b, 16) < 0) return 0;
+	if (b[0] != 0x0f || b[1] != 0xae) return 0;
+	uint8_t modrm = b[2];
+	int mod = modrm >> 6, reg = (modrm >> 3) & 7, rm = modrm & 7;
+	if (mod == 3 || reg > 3) return 0;
+	uint32_t gpr[8] = {r.rax, r.rcx, r.rdx, r.rbx, r.rsp, r.rbp, r.rsi, r.rdi};
+	int len = 3;
+	uint32_t ea = 0;
+	if (rm == 4) {
+		uint8_t sib = b[len++];
+		int sc = sib >> 6, idx = (sib >> 3) & 7, base = sib & 7;
+		if (idx != 4) ea += gpr[idx] << sc;
+		if (base == 5 && mod == 0) { ea += *(uint32_t*)(b + len); len += 4; }
+		else ea += gpr[base];
+	} else if (rm == 5 && mod == 0) {
+		ea = *(uint32_t*)(b + len); len += 4;
+	} else {
+		ea = gpr[rm];
+	}
+	if (mod == 1) { ea += (int8_t)b[len]; len += 1; }
+	else if (mod == 2) { ea += *(uint32_t*)(b + len); len += 4; }
+
+	struct kvm_fpu f;
+	ioctl(vcpufd, KVM_GET_FPU, &f);
+	uint8_t img[512];
+	switch (reg) {
+	case 0:  // fxsave
+		memset(img, 0, sizeof(img));
+		*(uint16_t*)(img + 0) = f.fcw;
+		*(uint16_t*)(img + 2) = f.fsw;
+		img[4] = f.ftwx;
+		*(uint16_t*)(img + 6) = f.last_opcode;
+		*(uint32_t*)(img + 8) = f.last_ip;
+		*(uint32_t*)(img + 16) = f.last_dp;
+		*(uint32_t*)(img + 24) = f.mxcsr;
+		*(uint32_t*)(img + 28) = 0xffff;
+		for (int i = 0; i < 8; ++i) memcpy(img + 32 + i * 16, f.fpr[i], 16);
+		for (int i = 0; i < 8; ++i) memcpy(img + 160 + i * 16, f.xmm[i], 16);
+		if (write_gva(ea, img, 512) < 0) return 0;
+		break;
+	case 1:  // fxrstor
+		if (read_gva(ea, img, 512) < 0) return 0;
+		f.fcw = *(uint16_t*)(img + 0);
+		f.fsw = *(uint16_t*)(img + 2);
+		f.ftwx = img[4];
+		f.last_opcode = *(uint16_t*)(img + 6);
+		f.last_ip = *(uint32_t*)(img + 8);
+		f.last_dp = *(uint32_t*)(img + 16);
+		f.mxcsr = *(uint32_t*)(img + 24);
+		for (int i = 0; i < 8; ++i) memcpy(f.fpr[i], img + 32 + i * 16, 16);
+		for (int i = 0; i < 8; ++i) memcpy(f.xmm[i], img + 160 + i * 16, 16);
+		ioctl(vcpufd, KVM_SET_FPU, &f);
+		break;
+	case 2:  // ldmxcsr
+		if (read_gva(ea, &f.mxcsr, 4) < 0) return 0;
+		ioctl(vcpufd, KVM_SET_FPU, &f);
+		break;
+	case 3:  // stmxcsr
+		if (write_gva(ea, &f.mxcsr, 4) < 0) return 0;
+		break;
+	}
+	r.rip += len;
+	ioctl(vcpufd, KVM_SET_REGS, &r);
+	emul_0fae++;
+	return 1;
+}
+
+static uint64_t emul_iret;
+
+/* 从guest的gdt中读出选择子sel对应的段描述符 */
+static int load_seg(struct kvm_sregs* s, uint16_t sel, struct kvm_segment* seg) {
+	uint32_t d[2];
+	if ((sel & ~3) == 0) { memset(seg, 0, sizeof(*seg)); seg->unusable = 1; return 0; }
+	if (read_gva(s->gdt.base + (sel & ~7), d, 8) < 0) return -1;
+	seg->selector = sel;
+	seg->base = (d[0] >> 16) | ((d[1] & 0xff) << 16) | (d[1] & 0xff000000);
+	uint32_t lim = (d[0] & 0xffff) | (d[1] & 0xf0000);
+	seg->g = (d[1] >> 23) & 1;
+	seg->limit = seg->g ? (lim << 12) | 0xfff : lim;
+	seg->type = (d[1] >> 8) & 0xf;
+	seg->s = (d[1] >> 12) & 1;
+	seg->dpl = (d[1] >> 13) & 3;
+	seg->present = (d[1] >> 15) & 1;
+	seg->avl = (d[1] >> 20) & 1;
+	seg->l = 0;
+	seg->db = (d[1] >> 22) & 1;
+	seg->unusable = 0;
+	return 0;
+}
+
+static int try_emulate_iret(void) {
+	struct kvm_regs r;
+	struct kvm_sregs s;
+	uint8_t op;
+	ioctl(vcpufd, KVM_GET_REGS, &r);
+	if (read_gva(r.rip, &op, 1) < 0 || op != 0xcf) return 0;
+	ioctl(vcpufd, KVM_GET_SREGS, &s);
+	uint32_t fr[5];
+	if (read_gva(r.rsp, fr, 20) < 0) return 0;
+	uint16_t cs = fr[1];
+	int cpl = s.cs.selector & 3;
+	r.rip = fr[0];
+	r.rflags = (fr[2] & 0x3f7fd7) | 2;
+	if ((cs & 3) == cpl) {
+		r.rsp += 12;
+		if (cs != s.cs.selector && load_seg(&s, cs, &s.cs) < 0) return 0;
+	} else {
+		if (load_seg(&s, cs, &s.cs) < 0 || load_seg(&s, fr[4], &s.ss) < 0) return 0;
+		r.rsp = fr[3];
+		struct kvm_segment* ds[] = {&s.ds, &s.es, &s.fs, &s.gs};
+		for (int i = 0; i < 4; ++i) {
+			if (!ds[i]->unusable && ds[i]->dpl < (cs & 3) && !((ds[i]->type & 8) && (ds[i]->type & 4))) {
+				memset(ds[i], 0, sizeof(*ds[i]));
+				ds[i]->unusable = 1;
+			}
+		}
+	}
+	ioctl(vcpufd, KVM_SET_SREGS, &s);
+	ioctl(vcpufd, KVM_SET_REGS, &r);
+	emul_iret++;
+	return 1;
+}
+
+/* ---------------- main ---------------- */
+static void on_alarm(int sig) { (void)sig; timed_out = 1; }
+
+static void open_drive(drive_t* d, const char* path) {
+	d->fd = open(path, O_RDWR);
+	if (d->fd < 0) die(path);
+	struct stat st;
+	fstat(d->fd, &st);
+	d->sectors = st.st_size / 512;
+	d->present = 1;
+}
+
+static void dump_screen(const char* path) {
+	FILE* f = fopen(path, "w");
+	if (!f) return;
+	int row, col;
+	for (row = 0; row < 25; ++row) {
+		int end = 80;
+		while (end > 0 && (mem[0xb8000 + (row * 80 + end - 1) * 2] == ' ' || mem[0xb8000 + (row * 80 + end - 1) * 2] == 0)) end--;
+		for (col = 0; col < end; ++col) {
+			uint8_t ch = mem[0xb8000 + (row * 80 + col) * 2];
+			fputc(ch >= 32 && ch < 127 ? ch : '.', f);
+		}
+		fputc('\n', f);
+	}
+	fclose(f);
+}
+
+int main(int argc, char** argv) {
+	int secs = 10, mb = 32, opt;
+	const char* vimg = NULL;
+	const char* screen = NULL;
+	const char* slog = NULL;
+	while ((opt = getopt(argc, argv, "t:m:v:s:l:d")) != -1) {
+		switch (opt) {
+		case 't': secs = atoi(optarg); break;
+		case 'm': mb = atoi(optarg); break;
+		case 'v': vimg = optarg; break;
+		case 's': screen = optarg; break;
+		case 'l': slog = optarg; break;
+		case 'd': ide_dma_enabled = 1; break;
+		default:
+			fprintf(stderr, "usage: kvmrun [-t secs] [-m MB] [-d] [-v virtio.img] [-s screen.txt] [-l serial.log] disk0 [disk1 [disk2 [disk3]]]\n");
+			return 2;
+		}
+	}
+	if (optind >= argc) { fprintf(stderr, "kvmrun: no disk given\n"); return 2; }
+	if (slog) serial_log = fopen(slog, "w");
+	setvbuf(stdout, NULL, _IONBF, 0);
+
+	chans[0].irqn = 14;
+	chans[1].irqn = 15;
+	int ndisk = 0;
+	for (int i = optind; i < argc && ndisk < 4; ++i, ++ndisk) {
+		open_drive(&chans[ndisk / 2].drv[ndisk % 2], argv[i]);
+	}
+	if (vimg) {
+		vblk.fd = open(vimg, O_RDWR);
+		if (vblk.fd < 0) die(vimg);
+		struct stat st;
+		fstat(vblk.fd, &st);
+		vblk.sectors = st.st_size / 512;
+		vblk.present = 1;
+		vblk.bar0 = VBLK_IO;
+	}
+
+	int kvm = open("/dev/kvm", O_RDWR | O_CLOEXEC);
+	if (kvm < 0) die("/dev/kvm");
+	vmfd = ioctl(kvm, KVM_CREATE_VM, 0);
+	if (vmfd < 0) die("KVM_CREATE_VM");
+	if (ioctl(vmfd, KVM_SET_TSS_ADDR, 0xfffbd000) < 0) die("TSS");
+	if (ioctl(vmfd, KVM_CREATE_IRQCHIP, 0) < 0) die("IRQCHIP");
+	struct kvm_pit_config pit = {.flags = KVM_PIT_SPEAKER_DUMMY};
+	if (ioctl(vmfd, KVM_CREATE_PIT2, &pit) < 0) die("PIT2");
+	struct kvm_reinject_control rc = {.pit_reinject = 0};
+	if (ioctl(vmfd, KVM_REINJECT_CONTROL, &rc) < 0) perror("REINJECT_CONTROL");
+
+	mem_size = (uint64_t)mb << 20;
+	mem = mmap(NULL, mem_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (mem == MAP_FAILED) die("mmap");
+	struct kvm_userspace_memory_region region = {.slot = 0, .guest_phys_addr = 0, .memory_size = mem_size, .userspace_addr = (uint64_t)mem};
+	if (ioctl(vmfd, KVM_SET_USER_MEMORY_REGION, &region) < 0) die("MEM");
+
+	vcpufd = ioctl(vmfd, KVM_CREATE_VCPU, 0);
+	if (vcpufd < 0) die("VCPU");
+	int mmap_size = ioctl(kvm, KVM_GET_VCPU_MMAP_SIZE, 0);
+	run = mmap(NULL, mmap_size, PROT_READ | PROT_WRITE, MAP_SHARED, vcpufd, 0);
+
+	struct { struct kvm_cpuid2 c; struct kvm_cpuid_entry2 e[100]; } cpuid = {.c.nent = 100};
+	if (ioctl(kvm, KVM_GET_SUPPORTED_CPUID, &cpuid) < 0) die("GET_CPUID");
+	if (ioctl(vcpufd, KVM_SET_CPUID2, &cpuid) < 0) die("SET_CPUID");
+
+	/* 与BIOS一样,把盘0的mbr读到0x7c00,从实模式开始执行 */
+	uint8_t mbr[512];
+	if (pread(chans[0].drv[0].fd, mbr, 512, 0) != 512) die("mbr");
+	memcpy(mem + 0x7c00, mbr, 512);
+	bios_setup(ndisk);
+
+	struct kvm_sregs sregs;
+	ioctl(vcpufd, KVM_GET_SREGS, &sregs);
+	sregs.cr0 = 0x10;
+	sregs.cs.base = 0; sregs.cs.selector = 0;
+	sregs.ds = sregs.es = sregs.ss = sregs.fs = sregs.gs = sregs.cs;
+	sregs.ds.type = sregs.es.type = sregs.ss.type = sregs.fs.type = sregs.gs.type = 3;
+	ioctl(vcpufd, KVM_SET_SREGS, &sregs);
+	struct kvm_regs regs = {.rip = 0x7c00, .rflags = 2, .rsp = 0x7c00, .rdx = 0x80};
+	ioctl(vcpufd, KVM_SET_REGS, &regs);
+
+	signal(SIGALRM, on_alarm);
+	alarm(secs);
+	struct timespec t0, t1;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (;;) {
+		if (timed_out) break;
+		if (ioctl(vcpufd, KVM_RUN, 0) < 0) {
+			if (errno == EINTR) continue;
+			die("KVM_RUN");
+		}
+		switch (run->exit_reason) {
+		case KVM_EXIT_IO: {
+			uint8_t* p = (uint8_t*)run + run->io.data_offset;
+			uint32_t i;
+			for (i = 0; i < run->io.count; ++i, p += run->io.size) {
+				uint32_t v = 0;
+				if (run->io.direction == KVM_EXIT_IO_OUT) {
+					memcpy(&v, p, run->io.size);
+					if (run->io.port == 0xf1) { bios_call(); continue; }
+					port_io(run->io.port, 0, &v, run->io.size);
+				} else {
+					port_io(run->io.port, 1, &v, run->io.size);
+					memcpy(p, &v, run->io.size);
+				}
+			}
+			break;
+		}
+		case KVM_EXIT_HLT:
+			fprintf(stderr, "\n[kvmrun] guest halted\n");
+			goto out;
+		case KVM_EXIT_SHUTDOWN:
+			fprintf(stderr, "\n[kvmrun] guest shutdown (triple fault)\n");
+			goto out;
+		case KVM_EXIT_INTR:
+			break;
+		case KVM_EXIT_MMIO:
+			break;
+		case KVM_EXIT_INTERNAL_ERROR:
+			if (run->internal.suberror == KVM_INTERNAL_ERROR_EMULATION && (try_emulate_0fae() || try_emulate_iret())) break;
+			fprintf(stderr, "\n[kvmrun] internal error suberror %u ndata %u", run->internal.suberror, run->internal.ndata);
+			for (uint32_t k = 0; k < run->internal.ndata && k < 16; ++k) fprintf(stderr, " %llx", (unsigned long long)run->internal.data[k]);
+			fprintf(stderr, "\n");
+			goto out;
+		default:
+			fprintf(stderr, "\n[kvmrun] exit reason %d\n", run->exit_reason);
+			goto out;
+		}
+	}
+out:
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	ioctl(vcpufd, KVM_GET_REGS, &regs);
+	fprintf(stderr, "\n[kvmrun] emulated 0fae=%llu iret=%llu\n[kvmrun] stop after %.2fs, rip=%llx; ata0 rd=%llu wr=%llu ata1 rd=%llu wr=%llu; vblk reqs=%llu sect=%llu\n",
+		(unsigned long long)emul_0fae, (unsigned long long)emul_iret, (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9, (unsigned long long)regs.rip,
+		(unsigned long long)chans[0].sect_rd, (unsigned long long)chans[0].sect_wr,
+		(unsigned long long)chans[1].sect_rd, (unsigned long long)chans[1].sect_wr,
+		(unsigned long long)vblk.reqs, (unsigned long long)vblk.sect_rd);
+	if (screen) dump_screen(screen);
+	if (serial_log) fclose(serial_log);
+	return 0;
+}
@@ -0,0 +1,191 @@
+/**
+ * 在主机上用lz4压缩内核: lz4pack <kernel.bin> <输出映像>
+ * 输出映像是12字节的头(魔数、解压后的字节数、压缩数据的字节数)后接一个lz4块,
+ * loader只读入压缩数据所占的扇区,解压到KERNEL_BIN_BASE_ADDR后照常按程序头复制各段.
+ * loader只用到elf头、程序头表和各PT_LOAD段在文件中的内容,其后的符号表、字符串表和调试信息
+ * 只会撑大映像,因此只压缩kernel.bin开头到最后一个被用到的字节为止的部分.
+ * 头的格式和各项上限须与boot.inc中的KERNEL_LZ4_*、KERNEL_SECTORS一致
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#define LZ4K_MAGIC 0x4b345a4c					// "LZ4K"
+#define LZ4K_HDR_SIZE 12
+#define LZ4K_RAW_MAX 0x2e000					// 解压到0x70000后不能越过0x9e000处main线程的pcb
+#define SECTOR_SIZE 512
+#define KERNEL_SECTORS 360						// 硬盘上留给内核映像的扇区数
+
+#define PT_LOAD 1
+
+#define MIN_MATCH 4										// lz4的最短匹配
+#define LAST_LITERALS 5								// 块的最后5个字节必须是字面量
+#define MF_LIMIT 12										// 最后一个匹配须在距块末尾至少12字节处开始
+#define MAX_OFFSET 65535							// 匹配距离用16位表示
+#define HASH_BITS 16
+#define WINDOW_MASK 0xffff						// 哈希链只需覆盖MAX_OFFSET的窗口
+#define CHAIN_DEPTH 256								// 每个位置最多比较的候选数
+
+static uint8_t* out;
+static uint32_t out_len;
+
+static void die(const char* msg) {
+	fprintf(stderr, "lz4pack: %s\n", msg);
+	exit(1);
+}
+
+static uint32_t read32(const uint8_t* p) {
+	uint32_t v;
+	memcpy(&v, p, 4);
+	return v;
+}
+
+static uint16_t read16(const uint8_t* p) {
+	uint16_t v;
+	memcpy(&v, p, 2);
+	return v;
+}
+
+static void write32(uint8_t* p, uint32_t v) {
+	memcpy(p, &v, 4);
+}
+
+static uint32_t hash4(const uint8_t* p) {
+	return (read32(p) * 2654435761u) >> (32 - HASH_BITS);
+}
+
+/* 输出长度中超出15的部分:先输出若干个255,最后一个字节小于255 */
+static void put_len(uint32_t len) {
+	while (len >= 255) {
+		out[out_len++] = 255;
+		len -= 255;
+	}
+	out[out_len++] = len;
+}
+
+/* 输出一个序列: lit_len个字面量,之后是距离为offset、长度为match_len的匹配;match_len为0的是最后一个序列,只有字面量 */
+static void put_sequence(const uint8_t* lit, uint32_t lit_len, uint32_t match_len, uint32_t offset) {
+	uint32_t token_pos = out_len++;
+	out[token_pos] = (lit_len < 15 ? lit_len : 15) << 4;
+	if (lit_len >= 15) put_len(lit_len - 15);
+	memcpy(out + out_len, lit, lit_len);
+	out_len += lit_len;
+	if (match_len == 0) return;
+
+	out[out_len++] = offset & 0xff;
+	out[out_len++] = offset >> 8;
+	uint32_t ml = match_len - MIN_MATCH;
+	out[token_pos] |= ml < 15 ? ml : 15;
+	if (ml >= 15) put_len(ml - 15);
+}
+
+/* 返回loader需要的字节数: elf头、程序头表和PT_LOAD段的文件内容中最靠后的结束位置 */
+static uint32_t elf_load_end(const uint8_t* elf, uint32_t size) {
+	if (size < 52 || memcmp(elf, "\177ELF", 4) != 0 || elf[4] != 1) die("input is not a 32-bit elf file");
+	uint32_t phoff = read32(elf + 28);
+	uint16_t phentsize = read16(elf + 42), phnum = read16(elf + 44);
+	uint32_t end = phoff + (uint32_t)phentsize * phnum;
+	if (phentsize < 32 || end > size) die("bad program header table");
+	uint16_t i;
+	for (i = 0; i < phnum; ++i) {
+		const uint8_t* ph = elf + phoff + (uint32_t)i * phentsize;
+		if (read32(ph) != PT_LOAD) continue;
+		uint32_t seg_end = read32(ph + 4) + read32(ph + 16);		// p_offset + p_filesz
+		if (seg_end > size) die("segment extends past end of file");
+		if (seg_end > end) end = seg_end;
+	}
+	return end;
+}
+
+/* 贪心匹配: 每个位置沿哈希链找最长的匹配,找到就输出一个序列并跳过匹配的部分 */
+static void compress(const uint8_t* src, uint32_t n) {
+	int32_t* head = malloc(sizeof(int32_t) << HASH_BITS);
+	int32_t* chain = malloc(sizeof(int32_t) * (WINDOW_MASK + 1));
+	if (head == NULL || chain == NULL) die("out of memory");
+	memset(head, 0xff, sizeof(int32_t) << HASH_BITS);
+
+	uint32_t match_limit = n > MF_LIMIT ? n - MF_LIMIT : 0;		// 匹配只能从此前开始
+	uint32_t pos = 0, anchor = 0;
+	while (pos < match_limit) {
+		uint32_t h = hash4(src + pos);
+		uint32_t best_len = 0, best_off = 0, depth = CHAIN_DEPTH;
+		int32_t cand = head[h];
+		while (cand >= 0 && (uint32_t)cand < pos && pos - cand <= MAX_OFFSET && depth-- > 0) {
+			if (read32(src + cand) == read32(src + pos)) {
+				uint32_t len = MIN_MATCH;
+				while (pos + len < n - LAST_LITERALS && src[cand + len] == src[pos + len]) ++len;
+				if (len > best_len) {
+					best_len = len;
+					best_off = pos - cand;
+				}
+			}
+			cand = chain[cand & WINDOW_MASK];
+		}
+		chain[pos & WINDOW_MASK] = head[h];
+		head[h] = pos;
+
+		if (best_len < MIN_MATCH) {
+			++pos;
+			continue;
+		}
+		put_sequence(src + anchor, pos - anchor, best_len, best_off);
+		/* 匹配覆盖的位置也加入哈希链,供之后的匹配使用 */
+		uint32_t end = pos + best_len;
+		for (++pos; pos < end && pos < match_limit; ++pos) {
+			h = hash4(src + pos);
+			chain[pos & WINDOW_MASK] = head[h];
+			head[h] = pos;
+		}
+		pos = end;
+		anchor = pos;
+	}
+	put_sequence(src + anchor, n - anchor, 0, 0);
+	free(head);
+	free(chain);
+}
+
+int main(int argc, char** argv) {
+	if (argc != 3) {
+		fprintf(stderr, "usage: lz4pack <kernel.bin> <output>\n");
+		return 1;
+	}
+	FILE* in = fopen(argv[1], "rb");
+	if (in == NULL) die("can not open input file");
+	fseek(in, 0, SEEK_END);
+	long size = ftell(in);
+	if (size <= 0) die("empty input file");
+	fseek(in, 0, SEEK_SET);
+	uint8_t* src = malloc(size);
+	if (src == NULL) die("out of memory");
+	if (fread(src, 1, size, in) != (size_t)size) die("read error");
+	fclose(in);
+
+	uint32_t raw = elf_load_end(src, size);
+	if (raw > LZ4K_RAW_MAX) {
+		fprintf(stderr, "lz4pack: loadable part of kernel is %u bytes, over the %u-byte limit\n", raw, LZ4K_RAW_MAX);
+		return 1;
+	}
+
+	/* 最坏情况下全是字面量,每255字节多1个长度字节 */
+	out = malloc(LZ4K_HDR_SIZE + raw + raw / 255 + 16);
+	if (out == NULL) die("out of memory");
+	out_len = LZ4K_HDR_SIZE;
+	compress(src, raw);
+	write32(out, LZ4K_MAGIC);
+	write32(out + 4, raw);
+	write32(out + 8, out_len - LZ4K_HDR_SIZE);
+	if (out_len > KERNEL_SECTORS * SECTOR_SIZE) {
+		fprintf(stderr, "lz4pack: packed image is %u sectors, over the %u reserved on disk\n",
+			(out_len + SECTOR_SIZE - 1) / SECTOR_SIZE, KERNEL_SECTORS);
+		return 1;
+	}
+
+	FILE* dst = fopen(argv[2], "wb");
+	if (dst == NULL) die("can not open output file");
+	if (fwrite(out, 1, out_len, dst) != out_len) die("write error");
+	fclose(dst);
+	printf("lz4pack: %ld bytes, %u loadable -> %u bytes, %u -> %u sectors\n", size, raw, out_len,
+		(raw + SECTOR_SIZE - 1) / SECTOR_SIZE, (out_len + SECTOR_SIZE - 1) / SECTOR_SIZE);
+	return 0;
+}
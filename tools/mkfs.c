@@ -0,0 +1,240 @@
+/**
+ * 在主机上制作文件系统盘: mkfs <映像> <分区起始扇区> <分区扇区数> [文件...]
+ * 在映像的主引导记录中写入一个分区表项,在该分区上建立文件系统,
+ * 并把命令行给出的文件复制到根目录下,每个文件占一段连续的块
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "fs_disk.h"
+
+#define PART_TYPE_LINUX 0x83
+
+/* 分区表项 */
+struct partition_table_entry {
+	uint8_t bootable;
+	uint8_t start_head;
+	uint8_t start_sec;
+	uint8_t start_chs;
+	uint8_t fs_type;
+	uint8_t end_head;
+	uint8_t end_sec;
+	uint8_t end_chs;
+	uint32_t start_lba;
+	uint32_t sec_cnt;
+} __attribute__((packed));
+
+static FILE* img;
+static uint32_t part_start;
+static fs_super_block sb;
+static uint8_t* block_bitmap;
+static uint8_t* inode_bitmap;
+static uint32_t next_free;					// 数据区中下一个空闲块,块按顺序分配
+static fs_inode root;
+
+static void die(const char* msg) {
+	fprintf(stderr, "mkfs: %s\n", msg);
+	exit(1);
+}
+
+/* 读写分区内第lba个扇区 */
+static void sect_io(uint32_t lba, void* buf, int write) {
+	if (fseek(img, (long)(part_start + lba) * FS_BLOCK_SIZE, SEEK_SET) != 0) die("seek failed");
+	size_t n = write ? fwrite(buf, FS_BLOCK_SIZE, 1, img) : fread(buf, FS_BLOCK_SIZE, 1, img);
+	if (n != 1) die("image too small");
+}
+
+static void bit_set(uint8_t* bits, uint32_t idx) {
+	bits[idx / 8] |= 1 << (idx % 8);
+}
+
+/* 分配cnt个连续块,返回起始块号 */
+static uint32_t alloc_blocks(uint32_t cnt) {
+	uint32_t lba = next_free, i;
+	if (next_free + cnt > sb.sec_cnt) die("no space left");
+	for (i = 0; i < cnt; ++i) bit_set(block_bitmap, lba + i);
+	next_free += cnt;
+	return lba;
+}
+
+/* 把第i_no号inode写入inode表 */
+static void inode_write(uint32_t i_no, fs_inode* di) {
+	uint8_t buf[FS_BLOCK_SIZE];
+	uint32_t lba = sb.inode_table_lba + i_no / FS_INODES_PER_BLOCK;
+	sect_io(lba, buf, 0);
+	memcpy(buf + (i_no % FS_INODES_PER_BLOCK) * sizeof(fs_inode), di, sizeof(fs_inode));
+	sect_io(lba, buf, 1);
+}
+
+/* 根目录第file_blk块所在的扇区 */
+static uint32_t root_map(uint32_t file_blk) {
+	uint32_t i;
+	for (i = 0; i < root.extent_cnt; ++i) {
+		if (file_blk < root.extents[i].len) return root.extents[i].lba + file_blk;
+		file_blk -= root.extents[i].len;
+	}
+	die("bad directory block");
+	return 0;
+}
+
+/* 在根目录末尾追加一个清零的块,返回其文件内块号 */
+static uint32_t root_grow(void) {
+	uint8_t zero[FS_BLOCK_SIZE] = {0};
+	uint32_t blk_cnt = root.i_size / FS_BLOCK_SIZE;
+	uint32_t lba = alloc_blocks(1);
+	fs_extent* last = &root.extents[root.extent_cnt - 1];
+	if (last->lba + last->len == lba) {
+		++last->len;
+	} else {
+		if (root.extent_cnt == FS_INODE_EXTENTS) die("root directory too large");
+		root.extents[root.extent_cnt].lba = lba;
+		root.extents[root.extent_cnt].len = 1;
+		++root.extent_cnt;
+	}
+	root.i_size += FS_BLOCK_SIZE;
+	sect_io(lba, zero, 1);
+	return blk_cnt;
+}
+
+/* 在根目录中添加目录项,与内核的dir_add相同:按哈希选桶,桶链满时在目录末尾追加溢出块 */
+static void root_add(const char* name, uint32_t i_no) {
+	uint8_t buf[FS_BLOCK_SIZE];
+	fs_dir_head* head = (fs_dir_head*)buf;
+	fs_dirent* ents = (fs_dirent*)buf;
+	uint32_t file_blk = fs_name_hash(name) % sb.dir_buckets;
+	while (1) {
+		uint32_t lba = root_map(file_blk);
+		sect_io(lba, buf, 0);
+		if (head->used < FS_DIRENTS_PER_BLOCK) {
+			uint32_t i = 1;
+			while (ents[i].f_type != FT_UNKNOWN) ++i;
+			strcpy(ents[i].name, name);
+			ents[i].i_no = i_no;
+			ents[i].f_type = FT_REGULAR;
+			++head->used;
+			sect_io(lba, buf, 1);
+			return;
+		}
+		if (head->next == 0) {
+			head->next = root_grow();
+			sect_io(lba, buf, 1);
+		}
+		file_blk = head->next;
+	}
+}
+
+/* 把主机上的文件path复制为根目录下的文件,文件名取path的最后一级 */
+static void copy_file(const char* path, uint32_t i_no) {
+	const char* name = strrchr(path, '/');
+	name = name == NULL ? path : name + 1;
+	if (strlen(name) >= FS_NAME_LEN) die("file name too long");
+	if (i_no >= sb.inode_cnt) die("too many files");
+
+	FILE* src = fopen(path, "rb");
+	if (src == NULL) die("can not open input file");
+	struct stat st;
+	fstat(fileno(src), &st);
+
+	fs_inode di;
+	memset(&di, 0, sizeof(di));
+	di.i_size = st.st_size;
+	di.i_type = FT_REGULAR;
+	uint32_t blk_cnt = (st.st_size + FS_BLOCK_SIZE - 1) / FS_BLOCK_SIZE;
+	if (blk_cnt != 0) {
+		di.extent_cnt = 1;
+		di.extents[0].lba = alloc_blocks(blk_cnt);
+		di.extents[0].len = blk_cnt;
+	}
+	uint32_t i;
+	for (i = 0; i < blk_cnt; ++i) {
+		uint8_t buf[FS_BLOCK_SIZE];
+		memset(buf, 0, sizeof(buf));
+		if (fread(buf, 1, FS_BLOCK_SIZE, src) == 0) die("read error");
+		sect_io(di.extents[0].lba + i, buf, 1);
+	}
+	fclose(src);
+
+	bit_set(inode_bitmap, i_no);
+	inode_write(i_no, &di);
+	root_add(name, i_no);
+	printf("mkfs: %s -> inode %u, %u blocks\n", name, i_no, blk_cnt);
+}
+
+int main(int argc, char** argv) {
+	if (argc < 4) {
+		fprintf(stderr, "usage: mkfs <image> <start_lba> <sectors> [files...]\n");
+		return 1;
+	}
+	img = fopen(argv[1], "r+b");
+	if (img == NULL) die("can not open image");
+	part_start = strtoul(argv[2], NULL, 0);
+	uint32_t sec_cnt = strtoul(argv[3], NULL, 0);
+	if (part_start == 0) die("partition can not start at sector 0");
+
+	/* 主引导记录中的分区表,其余的引导代码保持不变 */
+	uint8_t mbr[FS_BLOCK_SIZE];
+	if (fread(mbr, FS_BLOCK_SIZE, 1, img) != 1) die("image too small");
+	struct partition_table_entry* pte = (struct partition_table_entry*)(mbr + 446);
+	memset(pte, 0, 4 * sizeof(*pte));
+	pte->fs_type = PART_TYPE_LINUX;
+	pte->start_lba = part_start;
+	pte->sec_cnt = sec_cnt;
+	mbr[510] = 0x55;
+	mbr[511] = 0xaa;
+	fseek(img, 0, SEEK_SET);
+	fwrite(mbr, FS_BLOCK_SIZE, 1, img);
+
+	/* 依次排列超级块、块位图、inode位图、inode表 */
+	sb.magic = FS_MAGIC;
+	sb.sec_cnt = sec_cnt;
+	sb.inode_cnt = sec_cnt / 16 > 64 ? sec_cnt / 16 : 64;
+	sb.block_bitmap_lba = FS_SUPER_LBA + 1;
+	sb.block_bitmap_sects = (sec_cnt + FS_BITS_PER_BLOCK - 1) / FS_BITS_PER_BLOCK;
+	sb.inode_bitmap_lba = sb.block_bitmap_lba + sb.block_bitmap_sects;
+	sb.inode_bitmap_sects = (sb.inode_cnt + FS_BITS_PER_BLOCK - 1) / FS_BITS_PER_BLOCK;
+	sb.inode_table_lba = sb.inode_bitmap_lba + sb.inode_bitmap_sects;
+	sb.inode_table_sects = (sb.inode_cnt + FS_INODES_PER_BLOCK - 1) / FS_INODES_PER_BLOCK;
+	sb.data_start_lba = sb.inode_table_lba + sb.inode_table_sects;
+	sb.root_inode_no = FS_ROOT_INO;
+	/* 目录中最多有inode_cnt个目录项,桶数按此定出,装满时平均每桶一块,查找不必走长的溢出链 */
+	sb.dir_buckets = (sb.inode_cnt + FS_DIRENTS_PER_BLOCK - 1) / FS_DIRENTS_PER_BLOCK;
+	if (sb.dir_buckets < FS_DIR_MIN_BUCKETS) sb.dir_buckets = FS_DIR_MIN_BUCKETS;
+	if (sb.data_start_lba + sb.dir_buckets > sec_cnt) die("partition too small");
+
+	block_bitmap = calloc(sb.block_bitmap_sects, FS_BLOCK_SIZE);
+	inode_bitmap = calloc(sb.inode_bitmap_sects, FS_BLOCK_SIZE);
+	uint32_t i;
+	/* 元数据所占的块和位图中超出分区的位都置为已用 */
+	for (i = 0; i < sb.data_start_lba; ++i) bit_set(block_bitmap, i);
+	for (i = sec_cnt; i < sb.block_bitmap_sects * FS_BITS_PER_BLOCK; ++i) bit_set(block_bitmap, i);
+	for (i = sb.inode_cnt; i < sb.inode_bitmap_sects * FS_BITS_PER_BLOCK; ++i) bit_set(inode_bitmap, i);
+	next_free = sb.data_start_lba;
+
+	/* 清空inode表 */
+	uint8_t zero[FS_BLOCK_SIZE] = {0};
+	sect_io(0, zero, 1);
+	for (i = 0; i < sb.inode_table_sects; ++i) sect_io(sb.inode_table_lba + i, zero, 1);
+
+	/* 根目录: 各桶的首块 */
+	root.i_type = FT_DIRECTORY;
+	root.extent_cnt = 1;
+	root.extents[0].lba = alloc_blocks(sb.dir_buckets);
+	root.extents[0].len = sb.dir_buckets;
+	root.i_size = sb.dir_buckets * FS_BLOCK_SIZE;
+	for (i = 0; i < sb.dir_buckets; ++i) sect_io(root.extents[0].lba + i, zero, 1);
+	bit_set(inode_bitmap, FS_ROOT_INO);
+
+	for (i = 4; i < (uint32_t)argc; ++i) {
+		copy_file(argv[i], i - 3);
+	}
+	inode_write(FS_ROOT_INO, &root);
+
+	/* 最后写入位图和超级块 */
+	for (i = 0; i < sb.block_bitmap_sects; ++i) sect_io(sb.block_bitmap_lba + i, block_bitmap + i * FS_BLOCK_SIZE, 1);
+	for (i = 0; i < sb.inode_bitmap_sects; ++i) sect_io(sb.inode_bitmap_lba + i, inode_bitmap + i * FS_BLOCK_SIZE, 1);
+	sect_io(FS_SUPER_LBA, &sb, 1);
+	fclose(img);
+	printf("mkfs: %u sectors, %u inodes, %u directory buckets, data starts at %u\n", sec_cnt, sb.inode_cnt, sb.dir_buckets, sb.data_start_lba);
+	return 0;
+}
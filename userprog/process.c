@@ -100,10 +100,10 @@ void process_execute(void* filename, char* name) {
 	block_desc_init(thread->u_block_desc);
 
 	intr_status old_status = intr_disable();
-	ASSERT(!elem_find(&thread_ready_list, &thread->general_tag));
+	ASSERT(!elem_in_list(&thread_ready_list, &thread->general_tag));
 	list_append(&thread_ready_list, &thread->general_tag);
 
-	ASSERT(!elem_find(&thread_all_list, &thread->all_list_tag));
+	ASSERT(!elem_in_list(&thread_all_list, &thread->all_list_tag));
 	list_append(&thread_all_list, &thread->all_list_tag);
 	intr_set_status(old_status);
 }
\ No newline at end of file
@@ -6,28 +6,91 @@
 #include "console.h"
 #include "string.h"
 #include "memory.h"
+#include "wait_exit.h"
+#include "trace.h"
+#include "futex.h"
+#include "lockstat.h"
+#include "bcache.h"
+#include "fs.h"
+#include "uring.h"
+#include "tss.h"
 
-#define syscall_nr 32
+#define syscall_nr 32							// 须与kernel.S中的SYSCALL_NR一致
 typedef void* syscall;
 syscall syscall_table[syscall_nr];
 
+/* sysenter使用的msr */
+#define MSR_SYSENTER_CS 0x174					// 0级代码段选择子,其后依次是0级栈段、3级代码段、3级栈段
+#define MSR_SYSENTER_ESP 0x175				// 进入内核时的esp
+#define MSR_SYSENTER_EIP 0x176				// 内核入口
+
+#define CPUID_SEP (1 << 11)						// cpuid 1号功能返回的edx中的sysenter/sysexit特性位
+
+extern void sysenter_entry(void);
+
+static inline void wrmsr(uint32_t msr, uint32_t value) {
+	asm volatile ("wrmsr" : : "c" (msr), "a" (value), "d" (0));
+}
+
+/* cpu是否支持sysenter/sysexit */
+static bool sysenter_supported(void) {
+	uint32_t eax = 1, ebx, ecx, edx;
+	asm volatile ("cpuid" : "+a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx));
+	if (!(edx & CPUID_SEP)) return false;
+	/* 早期的Pentium Pro(family 6,model和stepping都小于3)报告了SEP,实际并不支持 */
+	uint32_t family = (eax >> 8) & 0xf, model = (eax >> 4) & 0xf, stepping = eax & 0xf;
+	return !(family == 6 && model < 3 && stepping < 3);
+}
+
+/**
+ * 设置sysenter的msr.sysenter不会像中断那样从tss中取0级栈,
+ * 而每个进程的0级栈不同,因此让esp指向tss的esp0字段,由入口代码从中取出当前进程的0级栈顶
+*/
+static void sysenter_init(void) {
+	if (!sysenter_supported()) {
+		put_str("   sysenter not supported, use int 0x80\n");
+		return;
+	}
+	wrmsr(MSR_SYSENTER_CS, SELECTOR_K_CODE_SYSENTER);
+	wrmsr(MSR_SYSENTER_ESP, (uint32_t)tss_esp0_addr());
+	wrmsr(MSR_SYSENTER_EIP, (uint32_t)sysenter_entry);
+	sysenter_enabled = true;
+}
+
+/* 未注册的子功能号,返回-1 */
+static int32_t sys_ni_syscall(void) {
+	return -1;
+}
+
 /* 返回当前任务的pid */
 uint32_t sys_getpid(void) {
 	return running_thread()->pid;
 }
 
-/* 打印字符串str (未实现文件系统前的版本) */
-uint32_t sys_write(char* str) {
-	console_put_str(str);
-	return strlen(str);
-}
-
 /* 初始化系统调用 */
 void syscall_init(void) {
 	put_str("syscall_init start\n");
+	uint32_t i;
+	for (i = 0; i < syscall_nr; ++i) {
+		syscall_table[i] = sys_ni_syscall;
+	}
 	syscall_table[SYS_GETPID] = sys_getpid;
 	syscall_table[SYS_WRITE] = sys_write;
 	syscall_table[SYS_MALLOC] = sys_malloc;
 	syscall_table[SYS_FREE] = sys_free;
+	syscall_table[SYS_EXIT] = sys_exit;
+	syscall_table[SYS_WAIT] = sys_wait;
+	syscall_table[SYS_TRACE_READ] = sys_trace_read;
+	syscall_table[SYS_FUTEX_WAIT] = sys_futex_wait;
+	syscall_table[SYS_FUTEX_WAKE] = sys_futex_wake;
+	syscall_table[SYS_LOCKSTAT_READ] = sys_lockstat_read;
+	syscall_table[SYS_BCACHE_STAT] = sys_bcache_stat;
+	syscall_table[SYS_OPEN] = sys_open;
+	syscall_table[SYS_CLOSE] = sys_close;
+	syscall_table[SYS_READ] = sys_read;
+	syscall_table[SYS_LSEEK] = sys_lseek;
+	syscall_table[SYS_URING_SETUP] = sys_uring_setup;
+	syscall_table[SYS_URING_ENTER] = sys_uring_enter;
+	sysenter_init();
 	put_str("syscall_init done\n");
 }
\ No newline at end of file
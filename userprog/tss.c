@@ -43,6 +43,11 @@ void update_tss_esp(task_struct *pthread) {
 	tss.esp0 = (uint32_t*)((uint32_t)pthread + PG_SIZE);
 }
 
+/* tss中esp0字段的地址,sysenter的入口从这里取得当前任务的0级栈 */
+uint32_t* tss_esp0_addr(void) {
+	return (uint32_t*)&tss.esp0;
+}
+
 static gdt_desc make_gdt_desc(uint32_t *desc_addr, uint32_t limit, uint8_t attr_low, uint8_t attr_high) {
 	uint32_t desc_base = (uint32_t)desc_addr;
 	gdt_desc desc;
@@ -68,12 +73,16 @@ void tss_init() {
 	/* 在gdt中添加dpl为0的TSS描述符 */
 	*((gdt_desc*)0xc0000920) = make_gdt_desc((uint32_t*)(&tss), tss_size - 1, TSS_ATTR_LOW, TSS_ATTR_HIGH);
 	
+	/* 在gdt中添加sysenter使用的dpl为0的代码段和数据段描述符,与loader中的第1、2个相同 */
+	*((gdt_desc*)0xc0000928) = make_gdt_desc((uint32_t*)0, 0xfffff, GDT_CODE_ATTR_LOW_DPL0, GDT_ATTR_HIGH);
+	*((gdt_desc*)0xc0000930) = make_gdt_desc((uint32_t*)0, 0xfffff, GDT_DATA_ATTR_LOW_DPL0, GDT_ATTR_HIGH);
+
 	/* 在gdt中添加dpl为3的数据段和代码段描述符 */
-	*((gdt_desc*)0xc0000928) = make_gdt_desc((uint32_t*)0, 0xfffff, GDT_CODE_ATTR_LOW_DPL3, GDT_ATTR_HIGH);
-	*((gdt_desc*)0xc0000930) = make_gdt_desc((uint32_t*)0, 0xfffff, GDT_DATA_ATTR_LOW_DPL3, GDT_ATTR_HIGH);
+	*((gdt_desc*)0xc0000938) = make_gdt_desc((uint32_t*)0, 0xfffff, GDT_CODE_ATTR_LOW_DPL3, GDT_ATTR_HIGH);
+	*((gdt_desc*)0xc0000940) = make_gdt_desc((uint32_t*)0, 0xfffff, GDT_DATA_ATTR_LOW_DPL3, GDT_ATTR_HIGH);
 
 	/* gdt 16位的limit, 32位的段基址 */
-	uint64_t gdt_operand = ((8 * 7 - 1) | ((uint64_t)(uint32_t)0xc0000900 << 16)); 	// 7个描述符大小
+	uint64_t gdt_operand = ((8 * 9 - 1) | ((uint64_t)(uint32_t)0xc0000900 << 16)); 	// 9个描述符大小
 
 	asm volatile ("lgdt %0" : : "m" (gdt_operand));
 	asm volatile ("ltr %w0" : : "r" (SELECTOR_TSS));
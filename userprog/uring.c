@@ -0,0 +1,238 @@
+#include "uring.h"
+#include "global.h"
+#include "stdint.h"
+#include "thread.h"
+#include "process.h"
+#include "memory.h"
+#include "interrupt.h"
+#include "sync.h"
+#include "wait_queue.h"
+#include "block.h"
+#include "bcache.h"
+#include "fs.h"
+#include "string.h"
+#include "debug.h"
+#include "print.h"
+
+#define MAX_URINGS 16							// 同时存在的环数,每个进程至多一个
+#define URING_BATCH 32						// worker每次从一个环中取的提交项数上限,避免一个进程独占worker
+#define URING_USER_TOP 0xc0000000	// 用户空间的上界
+
+#define barrier() asm volatile ("" : : : "memory")
+
+/* 一个进程的环在内核中的信息,进程不可见 */
+typedef struct {
+	bool in_use;
+	task_struct* owner;						// 建立此环的进程
+	uring_ring* kring;						// 共享页在内核空间的地址
+	uring_ring* uring;						// 共享页在进程空间的地址
+	uint32_t wait_nr;							// 进程在uring_enter中等待的完成项数
+	mutex lock;										// worker处理本环时持有,撤销环时据此等worker处理完
+	wait_queue cq_wq;							// 进程在此等待完成项
+} uring_ctx;
+
+static uring_ctx uring_pool[MAX_URINGS];
+static wait_queue uring_wq;					// worker无事可做时在此睡眠
+
+/* 当前进程的环,没有时返回NULL */
+static uring_ctx* uring_find(task_struct* owner) {
+	uint32_t i;
+	for (i = 0; i < MAX_URINGS; ++i) {
+		if (uring_pool[i].in_use && uring_pool[i].owner == owner) {
+			return &uring_pool[i];
+		}
+	}
+	return NULL;
+}
+
+/* 从块设备读入sec_cnt个扇区到用户缓冲区buf,经过缓冲区缓存以利用预读,并与文件系统的脏数据保持一致 */
+static int32_t uring_block_read(uring_sqe* sqe) {
+	block_device* bdev = sqe->fd < 0 ? NULL : block_get(sqe->fd);
+	if (bdev == NULL || sqe->lba >= bdev->sectors || sqe->len > bdev->sectors - sqe->lba ||
+		sqe->len > URING_USER_TOP / BLOCK_SECTOR_SIZE || !user_range_ok((void*)sqe->addr, sqe->len * BLOCK_SECTOR_SIZE, true)) {
+		return -1;
+	}
+	uint32_t i;
+	for (i = 0; i < sqe->len; ++i) {
+		buf_head* bh = bcache_read(bdev, sqe->lba + i);
+		if (bh == NULL) break;
+		memcpy((void*)(sqe->addr + i * BLOCK_SECTOR_SIZE), bh->data, BLOCK_SECTOR_SIZE);
+		bcache_release(bh);
+	}
+	return (i == 0 && sqe->len != 0) ? -1 : (int32_t)(i * BLOCK_SECTOR_SIZE);
+}
+
+/* 执行一个提交项,此时worker已借用owner的页表,可直接访问其用户空间,用户缓冲区按owner的页表检查 */
+static int32_t uring_exec(task_struct* owner, uring_sqe* sqe) {
+	switch (sqe->opcode) {
+		case URING_OP_NOP:
+			return 0;
+		case URING_OP_WRITE:
+			if (!user_range_ok((void*)sqe->addr, sqe->len, false)) return -1;
+			return fd_write(owner, sqe->fd, (const void*)sqe->addr, sqe->len);
+		case URING_OP_BLOCK_READ:
+			return uring_block_read(sqe);
+		default:
+			return -1;
+	}
+}
+
+/* 完成队列中已有的项数是否达到进程等待的数目,wq_wait_until的谓词 */
+static bool uring_cq_ready(void* arg) {
+	uring_ctx* ctx = arg;
+	return ctx->kring->cq_tail - ctx->kring->cq_head >= ctx->wait_nr;
+}
+
+/* 是否有尚未取走的提交项,且完成队列有空位 */
+static bool uring_pending(uring_ctx* ctx) {
+	uring_ring* ring = ctx->kring;
+	return ring->sq_head != ring->sq_tail && ring->cq_tail - ring->cq_head < URING_CQ_ENTRIES;
+}
+
+/**
+ * 处理ctx中至多URING_BATCH个提交项,返回是否处理了至少一项.
+ * 执行期间worker借用owner的页表,用户缓冲区的地址可直接使用;
+ * pgdir同时写进worker的pcb,中途被调度出去再回来时schedule会重新装入它
+*/
+static bool uring_drain(uring_ctx* ctx) {
+	uring_ring* ring = ctx->kring;
+	if (!uring_pending(ctx)) return false;
+
+	task_struct* cur = running_thread();
+	intr_status old_status = intr_disable();
+	cur->pgdir = ctx->owner->pgdir;
+	page_dir_activate(cur);
+	intr_set_status(old_status);
+
+	uint32_t done = 0;
+	while (done < URING_BATCH && uring_pending(ctx)) {
+		/* 先复制一份,进程可能同时改写队列中的项 */
+		uring_sqe sqe = ring->sqes[ring->sq_head & (URING_SQ_ENTRIES - 1)];
+		barrier();
+		++ring->sq_head;
+
+		int32_t res = uring_exec(ctx->owner, &sqe);
+		uring_cqe* cqe = &ring->cqes[ring->cq_tail & (URING_CQ_ENTRIES - 1)];
+		cqe->user_data = sqe.user_data;
+		cqe->res = res;
+		barrier();
+		++ring->cq_tail;
+		wq_wake_all(&ctx->cq_wq);
+		++done;
+	}
+
+	old_status = intr_disable();
+	cur->pgdir = NULL;
+	page_dir_activate(cur);
+	intr_set_status(old_status);
+	return true;
+}
+
+/* 有环存在待处理的提交项时返回true,是worker睡眠时wq_wait_until的谓词.顺便给各环置上需要唤醒的标志 */
+static bool uring_has_work(void* arg UNUSED) {
+	uint32_t i;
+	for (i = 0; i < MAX_URINGS; ++i) {
+		uring_ctx* ctx = &uring_pool[i];
+		if (!ctx->in_use) continue;
+		ctx->kring->flags |= URING_SQ_NEED_WAKEUP;
+		if (uring_pending(ctx)) return true;
+	}
+	return false;
+}
+
+/* worker线程,轮流处理各进程的提交队列,都空了就睡眠,由uring_enter唤醒 */
+static void uring_worker(void* arg UNUSED) {
+	while (1) {
+		bool busy = false;
+		uint32_t i;
+		for (i = 0; i < MAX_URINGS; ++i) {
+			uring_ctx* ctx = &uring_pool[i];
+			if (!ctx->in_use) continue;
+			mutex_lock(&ctx->lock);
+			/* 加锁前环可能已被撤销 */
+			if (ctx->in_use) {
+				ctx->kring->flags &= ~URING_SQ_NEED_WAKEUP;
+				busy |= uring_drain(ctx);
+			}
+			mutex_unlock(&ctx->lock);
+		}
+		if (!busy) {
+			wq_wait_until(&uring_wq, uring_has_work, NULL, false);
+		}
+	}
+}
+
+/* 初始化环并启动worker */
+void uring_init(void) {
+	put_str("uring_init start\n");
+	uint32_t i;
+	for (i = 0; i < MAX_URINGS; ++i) {
+		mutex_init(&uring_pool[i].lock);
+		wq_init(&uring_pool[i].cq_wq);
+	}
+	wq_init(&uring_wq);
+	thread_start("uring_worker", 31, uring_worker, NULL);
+	put_str("uring_init done\n");
+}
+
+/* 为当前进程建立环,返回共享页在进程空间的地址.已建立过、不是用户进程或内存不足时返回NULL */
+uring_ring* sys_uring_setup(void) {
+	task_struct* cur = running_thread();
+	if (cur->pgdir == NULL || uring_find(cur) != NULL) return NULL;
+
+	uring_ring* kring = get_kernel_pages(1);
+	if (kring == NULL) return NULL;
+	uring_ring* uring = map_to_user(kring, 1);
+	if (uring == NULL) {
+		free_kernel_pages(kring, 1);
+		return NULL;
+	}
+
+	uint32_t i;
+	intr_status old_status = intr_disable();
+	for (i = 0; i < MAX_URINGS; ++i) {
+		uring_ctx* ctx = &uring_pool[i];
+		if (!ctx->in_use) {
+			ctx->owner = cur;
+			ctx->kring = kring;
+			ctx->uring = uring;
+			ctx->in_use = true;
+			intr_set_status(old_status);
+			return uring;
+		}
+	}
+	intr_set_status(old_status);
+	unmap_from_user(uring, 1);
+	free_kernel_pages(kring, 1);
+	return NULL;
+}
+
+/**
+ * 唤醒worker处理已提交的项,并等待完成队列中至少有min_complete项.
+ * 返回完成队列中的项数,当前进程没有环时返回-1
+*/
+int32_t sys_uring_enter(uint32_t min_complete) {
+	uring_ctx* ctx = uring_find(running_thread());
+	if (ctx == NULL) return -1;
+	if (min_complete > URING_CQ_ENTRIES) min_complete = URING_CQ_ENTRIES;
+
+	if (ctx->kring->sq_head != ctx->kring->sq_tail) {
+		wq_wake_all(&uring_wq);
+	}
+	ctx->wait_nr = min_complete;
+	wq_wait_until(&ctx->cq_wq, uring_cq_ready, ctx, false);
+	return ctx->kring->cq_tail - ctx->kring->cq_head;
+}
+
+/* 进程退出时撤销它的环,worker正在处理时等它处理完 */
+void uring_release(void) {
+	uring_ctx* ctx = uring_find(running_thread());
+	if (ctx == NULL) return;
+	uring_ring* kring = ctx->kring;
+	uring_ring* uring = ctx->uring;
+	mutex_lock(&ctx->lock);
+	ctx->in_use = false;				// 此后这一项可能立即被别的进程重新占用
+	mutex_unlock(&ctx->lock);
+	unmap_from_user(uring, 1);
+	free_kernel_pages(kring, 1);
+}
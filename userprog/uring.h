@@ -0,0 +1,61 @@
+#ifndef __USERPROG_URING_H
+#define __USERPROG_URING_H
+
+#include "stdint.h"
+#include "global.h"
+
+#define URING_SQ_ENTRIES 64					// 提交队列的项数,须为2的幂
+#define URING_CQ_ENTRIES 128				// 完成队列的项数,须为2的幂,取提交队列的两倍以容纳尚未收割的完成项
+#define URING_SQ_NEED_WAKEUP 1			// ring.flags: worker已睡眠,提交后须调用uring_enter唤醒它
+
+/* 操作码 */
+enum uring_op {
+	URING_OP_NOP,						// 空操作,直接完成,res为0
+	URING_OP_WRITE,					// 把addr处的len个字节写到文件描述符fd,res同write的返回值
+	URING_OP_BLOCK_READ			// 从编号为fd的块设备的lba扇区起读len个扇区到addr,res为读到的字节数
+};
+
+/* 提交队列项,由进程填写 */
+typedef struct {
+	uint8_t opcode;								// enum uring_op
+	uint8_t pad0[3];
+	int32_t fd;										// 文件描述符或块设备编号(按注册顺序,0为sda)
+	uint32_t addr;								// 用户缓冲区
+	uint32_t len;									// 字节数或扇区数
+	uint32_t lba;									// URING_OP_BLOCK_READ的起始扇区
+	uint32_t user_data;						// 原样带回到完成项中,供进程区分请求
+	uint32_t pad1[2];
+} uring_sqe;
+
+/* 完成队列项,由内核填写 */
+typedef struct {
+	uint32_t user_data;
+	int32_t res;									// 操作结果,出错时为-1
+} uring_cqe;
+
+/**
+ * 进程与内核共享的一页.
+ * 提交队列: 进程写入sqes[sq_tail]后推进sq_tail,worker取走后推进sq_head.
+ * 完成队列: worker写入cqes[cq_tail]后推进cq_tail,进程读取后推进cq_head.
+ * 每个下标只由一方修改,只增不减,取模后访问.
+ * worker在完成队列满时暂停取提交项,直到进程收割.
+ * 提交或收割后若flags中有URING_SQ_NEED_WAKEUP,须调用uring_enter(0)唤醒worker;
+ * worker醒着时会自己取走新的提交项,不必陷入内核
+*/
+typedef struct {
+	volatile uint32_t sq_head;
+	volatile uint32_t sq_tail;
+	volatile uint32_t cq_head;
+	volatile uint32_t cq_tail;
+	volatile uint32_t flags;				// URING_SQ_NEED_WAKEUP
+	uint32_t pad[11];							// 凑够64字节
+	uring_sqe sqes[URING_SQ_ENTRIES];
+	uring_cqe cqes[URING_CQ_ENTRIES];
+} uring_ring;
+
+void uring_init(void);
+uring_ring* sys_uring_setup(void);
+int32_t sys_uring_enter(uint32_t min_complete);
+void uring_release(void);
+
+#endif
@@ -0,0 +1,134 @@
+#include "wait_exit.h"
+#include "global.h"
+#include "debug.h"
+#include "thread.h"
+#include "list.h"
+#include "memory.h"
+#include "bitmap.h"
+#include "process.h"
+#include "interrupt.h"
+#include "fs.h"
+#include "uring.h"
+
+/* 释放用户进程资源: 1 页表中对应的物理页 2 页表本身占用的物理页 3 虚拟内存池位图占用的内核页 */
+static void release_prog_resource(task_struct* release_thread) {
+	ASSERT(release_thread == running_thread());
+	uint32_t* pgdir_vaddr = release_thread->pgdir;
+	uint16_t user_pde_nr = 768, pde_idx = 0;				// 用户空间占页目录的前768项
+	uint16_t user_pte_nr = 1024, pte_idx = 0;
+
+	/* 遍历用户空间的页目录项,回收每个存在的页表所映射的物理页,再回收页表自己 */
+	while (pde_idx < user_pde_nr) {
+		uint32_t* v_pde_ptr = pgdir_vaddr + pde_idx;
+		uint32_t pde = *v_pde_ptr;
+		if (pde & PG_P_1) {
+			/* 当前页目录就是被回收进程的页目录,可直接用pte_ptr访问页表 */
+			uint32_t* first_pte_vaddr_in_pde = pte_ptr(pde_idx * 0x400000);
+			for (pte_idx = 0; pte_idx < user_pte_nr; ++pte_idx) {
+				uint32_t pte = first_pte_vaddr_in_pde[pte_idx];
+				if (pte & PG_P_1) {
+					pfree(pte & 0xfffff000);
+				}
+			}
+			pfree(pde & 0xfffff000);				// 页表来自内核物理内存池
+			*v_pde_ptr = 0;
+		}
+		++pde_idx;
+	}
+	/* 页目录项已清空,重新加载cr3使tlb中残留的用户空间映射失效 */
+	page_dir_activate(release_thread);
+
+	/* 回收用户虚拟地址位图 */
+	uint32_t bitmap_pg_cnt = DIV_ROUND_UP(release_thread->userprog_vaddr.vaddr_bitmap.btmp_bytes_len, PG_SIZE);
+	free_kernel_pages(release_thread->userprog_vaddr.vaddr_bitmap.bits, bitmap_pg_cnt);
+	release_thread->userprog_vaddr.vaddr_bitmap.bits = NULL;
+}
+
+/* list_traversal的回调函数,将父进程为ppid的子进程过继给main_thread */
+static bool adopt_child(list_elem* pelem, int32_t ppid) {
+	task_struct* pthread = elem2entry(task_struct, all_list_tag, pelem);
+	if (pthread->parent_pid == ppid) {
+		pthread->parent_pid = main_thread->pid;
+	}
+	return false;			// 返回false使遍历继续
+}
+
+/* list_traversal的回调函数,查找父进程为ppid且已退出的子进程 */
+static bool find_dead_child(list_elem* pelem, int32_t ppid) {
+	task_struct* pthread = elem2entry(task_struct, all_list_tag, pelem);
+	return pthread->parent_pid == ppid && pthread->status == TASK_DIED;
+}
+
+/* list_traversal的回调函数,查找父进程为ppid的子进程 */
+static bool find_child(list_elem* pelem, int32_t ppid) {
+	task_struct* pthread = elem2entry(task_struct, all_list_tag, pelem);
+	return pthread->parent_pid == ppid;
+}
+
+/* 结束当前任务,释放其用户空间后成为僵尸,由父进程在sys_wait中回收pcb */
+void sys_exit(int32_t status) {
+	task_struct* child = running_thread();
+	ASSERT(child != main_thread);
+	child->exit_status = status;
+
+	/* 将自己的子进程都过继给main_thread,由main_thread充当init的角色.
+	 * 过继来的子进程可能已是僵尸,不会再调用sys_exit唤醒新的父进程,须在此唤醒在sys_wait中等待的main_thread */
+	intr_status old_status = intr_disable();
+	list_traversal(&thread_all_list, adopt_child, child->pid);
+	if (main_thread->status == TASK_WAITING &&
+		list_traversal(&thread_all_list, find_dead_child, main_thread->pid) != NULL) {
+		thread_unblock(main_thread);
+	}
+	intr_set_status(old_status);
+
+	/* 撤销异步系统调用环,关闭打开的文件 */
+	uring_release();
+	fs_release_fds();
+
+	if (child->pgdir != NULL) {
+		release_prog_resource(child);
+	}
+
+	/* 唤醒父进程和阻塞自己须是原子操作,否则父进程可能错过唤醒 */
+	intr_disable();
+	task_struct* parent = pid2thread(child->parent_pid);
+	if (parent != NULL && parent->status == TASK_WAITING) {
+		thread_unblock(parent);
+	}
+	thread_block(TASK_DIED);
+	PANIC("sys_exit: should not be here\n");
+}
+
+/* 等待子进程调用exit,将子进程的退出状态保存到status指向的变量.成功则返回子进程的pid,失败则返回-1 */
+pid_t sys_wait(int32_t* status) {
+	/* 先检查status,不合法时不回收子进程,免得它的退出状态就此丢失 */
+	if (status != NULL && !user_range_ok(status, sizeof(*status), true)) return -1;
+	task_struct* parent = running_thread();
+
+	while (1) {
+		/* 查找和阻塞须关中断,否则子进程可能在两者之间退出而父进程却没被唤醒 */
+		intr_status old_status = intr_disable();
+		list_elem* child_elem = list_traversal(&thread_all_list, find_dead_child, parent->pid);
+		if (child_elem != NULL) {
+			intr_set_status(old_status);
+			task_struct* child = elem2entry(task_struct, all_list_tag, child_elem);
+			if (status != NULL) {
+				*status = child->exit_status;
+			}
+			pid_t child_pid = child->pid;
+			thread_exit(child);			// 回收子进程的pcb、页目录及pid
+			return child_pid;
+		}
+
+		/* 若没有子进程则出错返回 */
+		child_elem = list_traversal(&thread_all_list, find_child, parent->pid);
+		if (child_elem == NULL) {
+			intr_set_status(old_status);
+			return -1;
+		}
+
+		/* 有子进程但都还没退出,阻塞自己等待子进程唤醒 */
+		thread_block(TASK_WAITING);
+		intr_set_status(old_status);
+	}
+}
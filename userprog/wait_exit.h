@@ -0,0 +1,10 @@
+#ifndef __USERPROG_WAITEXIT_H
+#define __USERPROG_WAITEXIT_H
+
+#include "stdint.h"
+#include "thread.h"
+
+void sys_exit(int32_t status);
+pid_t sys_wait(int32_t* status);
+
+#endif